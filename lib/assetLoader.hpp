@@ -0,0 +1,254 @@
+#ifndef ASSET_LOADER_HPP
+#define ASSET_LOADER_HPP
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <functional>
+#include <condition_variable>
+
+#include "texture.hpp"
+#include "mipmaps.hpp"
+#include "textureCache.hpp"
+#include "readers/objReader.hpp"
+#include "readers/mtlReader.hpp"
+#include "readers/ppmReader.hpp"
+
+// Parses asset files on a pool of worker threads.
+// File parsing returns futures that can be waited on from any thread.
+// Textures are decoded on the workers and handed back to the GL thread, which uploads them
+// through a pixel buffer object in ProcessUploads, spending at most a given time budget per call.
+// Mip chains can be built on the workers as well, so the GL thread only copies finished levels.
+class AssetLoader {
+private:
+    struct PendingTexture {
+        GLuint handle;
+        SamplerState sampler;
+        Image image;
+        std::vector<Image> mipLevels; // Empty unless the chain was built on the worker, in which case it starts with a copy of the image
+        std::function<bool(GLuint)> isWanted;
+        std::function<void(const Texture2D&)> onUploaded;
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsAvailable;
+    bool stopping = false;
+
+    std::deque<PendingTexture> readyTextures;
+    std::mutex readyMutex;
+    size_t texturesInFlight = 0;
+
+    GLuint uploadBuffer = 0;
+
+    void WorkerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(jobsMutex);
+                jobsAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    void Enqueue(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            jobs.push_back(std::move(job));
+        }
+        jobsAvailable.notify_one();
+    }
+
+    // Copies every level of a precomputed chain into the staging buffer back to back and specifies the texture from it
+    Texture2D UploadLevels(PendingTexture& pending) {
+        std::vector<ImageView> views = ViewLevels(pending.mipLevels);
+        size_t size = 0;
+        for (const ImageView& view : views) size += view.stride * view.height;
+        if (uploadBuffer == 0) glGenBuffers(1, &uploadBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        uint8_t* mapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        Texture2D result;
+        if (mapped != nullptr) {
+            size_t offset = 0;
+            for (ImageView& view : views) {
+                size_t levelSize = view.stride * view.height;
+                std::memcpy(mapped + offset, view.data, levelSize);
+                view.data = (const uint8_t*)(uintptr_t)offset;
+                offset += levelSize;
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            result = UploadTextureLevels(pending.handle, views.data(), views.size(), pending.sampler.wrapMode, pending.sampler.minFilter, pending.sampler.magFilter);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        } else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            views = ViewLevels(pending.mipLevels);
+            result = UploadTextureLevels(pending.handle, views.data(), views.size(), pending.sampler.wrapMode, pending.sampler.minFilter, pending.sampler.magFilter);
+        }
+        return result;
+    }
+
+    // Copies the image into the staging buffer and specifies the texture from it
+    Texture2D Upload(PendingTexture& pending) {
+        if (!pending.mipLevels.empty()) return UploadLevels(pending);
+        size_t size = pending.image.ByteSize();
+        if (uploadBuffer == 0) glGenBuffers(1, &uploadBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+        // Orphan the previous contents so we never wait on an upload still in flight
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        Texture2D result;
+        if (mapped != nullptr) {
+            std::memcpy(mapped, pending.image.data.data(), size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            // With a bound unpack buffer, the pixel pointer is an offset into it
+            result = UploadTexture(pending.handle, pending.image, (const void*)0, pending.sampler.wrapMode, pending.sampler.minFilter, pending.sampler.magFilter);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        } else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            result = UploadTexture(pending.handle, pending.image, pending.image.data.data(), pending.sampler.wrapMode, pending.sampler.minFilter, pending.sampler.magFilter);
+        }
+        return result;
+    }
+public:
+    AssetLoader(int workerCount = -1) {
+        if (workerCount < 0) {
+            workerCount = (int)std::thread::hardware_concurrency() - 1;
+        }
+        if (workerCount < 1) workerCount = 1;
+        for (int i = 0; i < workerCount; ++i) {
+            workers.emplace_back(&AssetLoader::WorkerLoop, this);
+        }
+    }
+    ~AssetLoader() {
+        Shutdown();
+    }
+
+    // Stops the workers once their queued jobs are done and frees the staging buffer.
+    // Must be called on the GL thread while the context is alive if any texture was streamed.
+    void Shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(jobsMutex);
+            if (stopping) return;
+            stopping = true;
+        }
+        jobsAvailable.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+        if (uploadBuffer != 0) {
+            glDeleteBuffers(1, &uploadBuffer);
+            uploadBuffer = 0;
+        }
+    }
+
+    // Runs a function on a worker thread and returns a future to its result
+    template <typename T>
+    std::shared_future<T> Submit(std::function<T()> func) {
+        auto task = std::make_shared<std::packaged_task<T()>>(func);
+        std::shared_future<T> result = task->get_future().share();
+        Enqueue([task]() { (*task)(); });
+        return result;
+    }
+
+    std::shared_future<std::vector<ObjData>> LoadObj(const std::string& filename, bool calculateTangents = false) {
+        return Submit<std::vector<ObjData>>([filename, calculateTangents]() {
+            return ObjReader::ReadObj(filename, false, calculateTangents);
+        });
+    }
+    std::shared_future<std::vector<RawMtl>> LoadMtl(const std::string& filename) {
+        return Submit<std::vector<RawMtl>>([filename]() {
+            return MtlReader::ReadMtl(filename);
+        });
+    }
+    std::shared_future<Image> LoadPpm(const std::string& filename) {
+        return Submit<Image>([filename]() {
+            return PpmReader::ReadPpm(filename);
+        });
+    }
+
+    // Decodes a texture file on a worker, then fills the given texture handle once ProcessUploads gets to it.
+    // `isWanted` is checked on the GL thread right before uploading, so textures released in the meantime are skipped.
+    // GL may have handed the handle to a newer texture by then, so it should identify the request by something it captured,
+    // such as the texture cache generation, rather than by the handle alone.
+    // With `buildMipChain`, mipmapped textures get their levels from BuildMipChain instead of glGenerateMipmap.
+    void StreamTexture(const std::string& filename, GLuint handle, const SamplerState& sampler,
+        std::function<bool(GLuint)> isWanted = nullptr, std::function<void(const Texture2D&)> onUploaded = nullptr, bool buildMipChain = true) {
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            texturesInFlight++;
+        }
+        Enqueue([this, filename, handle, sampler, isWanted, onUploaded, buildMipChain]() {
+            PendingTexture pending;
+            pending.handle = handle;
+            pending.sampler = sampler;
+            pending.isWanted = isWanted;
+            pending.onUploaded = onUploaded;
+            try {
+                pending.image = PpmReader::ReadPpm(filename);
+                pending.image.Flip(sampler.invertY, sampler.invertX);
+                if (buildMipChain && UsesMipmaps(sampler.minFilter)) {
+                    pending.mipLevels = BuildMipChain(pending.image, sampler.srgb);
+                }
+            } catch (...) {
+                std::cerr << "Failed to decode streamed texture " << filename << ", keeping its placeholder." << std::endl;
+                std::lock_guard<std::mutex> lock(readyMutex);
+                texturesInFlight--;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(readyMutex);
+            readyTextures.push_back(std::move(pending));
+        });
+    }
+
+    // Uploads decoded textures until the budget runs out. At least one texture is uploaded per call
+    // if any is ready, so large textures still make progress. Must be called on the GL thread.
+    // Returns the number of textures uploaded.
+    int ProcessUploads(float budgetMs) {
+        auto start = std::chrono::high_resolution_clock::now();
+        int uploaded = 0;
+        while (true) {
+            PendingTexture pending;
+            {
+                std::lock_guard<std::mutex> lock(readyMutex);
+                if (readyTextures.empty()) break;
+                pending = std::move(readyTextures.front());
+                readyTextures.pop_front();
+                texturesInFlight--;
+            }
+            if (pending.isWanted == nullptr || pending.isWanted(pending.handle)) {
+                Texture2D result = Upload(pending);
+                if (pending.onUploaded != nullptr) pending.onUploaded(result);
+                uploaded++;
+            }
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+            if (elapsed.count() >= budgetMs) break;
+        }
+        return uploaded;
+    }
+
+    // Number of streamed textures that have not been uploaded yet
+    size_t PendingTextureCount() {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        return texturesInFlight;
+    }
+    bool IsIdle() {
+        return PendingTextureCount() == 0;
+    }
+};
+
+#endif
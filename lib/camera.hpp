@@ -50,21 +50,19 @@ public:
 
     // Set the position for the camera
     void SetCameraEyePosition(float x, float y, float z){
-        transform.position.x = x;
-        transform.position.y = y;
-        transform.position.z = z;
+        transform.SetPosition(glm::vec3(x, y, z));
     }
 
     float GetEyeXPosition() const {
-        return transform.position.x;
+        return transform.GetPosition().x;
     }
 
     float GetEyeYPosition() const {
-        return transform.position.y;
+        return transform.GetPosition().y;
     }
 
     float GetEyeZPosition() const {
-        return transform.position.z;
+        return transform.GetPosition().z;
     }
 
     float GetViewXDirection() const {
@@ -93,8 +91,8 @@ public:
         // Think about the second argument and why that is
         // setup as it is.
         return glm::lookAt( 
-            transform.position,
-            transform.position + transform.GetForwardVector(),
+            transform.GetPosition(),
+            transform.GetPosition() + transform.GetForwardVector(),
             transform.GetUpVector()
         );
     }
@@ -0,0 +1,293 @@
+#ifndef AABB_TREE_HPP
+#define AABB_TREE_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <stdint.h>
+
+#include "continuous.hpp"
+#include "bounds.hpp"
+
+// #####################
+// # DYNAMIC AABB TREE #
+// #####################
+// Bounding volume hierarchy over moving items, for queries that are not about pairs: what a ray goes through, what is in a region.
+// Leaves store fat bounds, grown by a margin and by the last displacement, so an item only leaves the tree when it moves out of them.
+// A leaf goes in next to the sibling that grows the total surface area the least, and rotations on the way back up keep the tree
+// balanced, so queries stay logarithmic however the items were inserted.
+template <typename T>
+class DynamicAabbTree {
+public:
+    typedef int32_t Proxy;
+    static const Proxy NULL_PROXY = -1;
+private:
+    struct Node {
+        glm::vec3 minBound;
+        glm::vec3 maxBound;
+        T* value;
+        // Parent while in the tree, next free node while on the free list
+        Proxy parent;
+        Proxy child1;
+        Proxy child2;
+        // 0 for leaves, -1 for free nodes
+        int32_t height;
+
+        bool IsLeaf() const {
+            return child1 == NULL_PROXY;
+        }
+    };
+    // How much further than its last displacement a moved leaf's bounds reach
+    static constexpr float DISPLACEMENT_MULTIPLIER = 2;
+
+    std::vector<Node> nodes;
+    Proxy root = NULL_PROXY;
+    Proxy freeList = NULL_PROXY;
+    size_t leafCount = 0;
+    float margin;
+
+    static float SurfaceArea(const glm::vec3& minBound, const glm::vec3& maxBound) {
+        glm::vec3 size = maxBound - minBound;
+        return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+    float CombinedArea(Proxy a, Proxy b) const {
+        return SurfaceArea(glm::min(nodes[a].minBound, nodes[b].minBound), glm::max(nodes[a].maxBound, nodes[b].maxBound));
+    }
+    void Refit(Proxy index) {
+        Node& node = nodes[index];
+        node.minBound = glm::min(nodes[node.child1].minBound, nodes[node.child2].minBound);
+        node.maxBound = glm::max(nodes[node.child1].maxBound, nodes[node.child2].maxBound);
+        node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+    }
+
+    Proxy Allocate() {
+        Proxy index = freeList;
+        if (index == NULL_PROXY) {
+            index = nodes.size();
+            nodes.emplace_back();
+        } else {
+            freeList = nodes[index].parent;
+        }
+        Node& node = nodes[index];
+        node.value = nullptr;
+        node.parent = node.child1 = node.child2 = NULL_PROXY;
+        node.height = 0;
+        return index;
+    }
+    void Free(Proxy index) {
+        nodes[index].parent = freeList;
+        nodes[index].height = -1;
+        freeList = index;
+    }
+
+    void InsertLeaf(Proxy leaf) {
+        if (root == NULL_PROXY) {
+            root = leaf;
+            nodes[leaf].parent = NULL_PROXY;
+            return;
+        }
+        // Go down towards the sibling that makes the tree cheapest. Every node on the way grows to hold the leaf,
+        // which is the inheritance cost of going further down rather than pairing with the current node.
+        Proxy index = root;
+        while (!nodes[index].IsLeaf()) {
+            const Node& node = nodes[index];
+            float area = SurfaceArea(node.minBound, node.maxBound);
+            float combinedArea = CombinedArea(index, leaf);
+            float cost = 2 * combinedArea;
+            float inheritance = 2 * (combinedArea - area);
+            float cost1 = CombinedArea(node.child1, leaf) + inheritance;
+            float cost2 = CombinedArea(node.child2, leaf) + inheritance;
+            if (!nodes[node.child1].IsLeaf()) cost1 -= SurfaceArea(nodes[node.child1].minBound, nodes[node.child1].maxBound);
+            if (!nodes[node.child2].IsLeaf()) cost2 -= SurfaceArea(nodes[node.child2].minBound, nodes[node.child2].maxBound);
+            if (cost < cost1 && cost < cost2) break;
+            index = cost1 < cost2 ? node.child1 : node.child2;
+        }
+        Proxy sibling = index;
+
+        // A new parent takes the sibling's place, with the sibling and the leaf as children
+        Proxy oldParent = nodes[sibling].parent;
+        Proxy newParent = Allocate();
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].child1 = sibling;
+        nodes[newParent].child2 = leaf;
+        Refit(newParent);
+        if (oldParent == NULL_PROXY) root = newParent;
+        else if (nodes[oldParent].child1 == sibling) nodes[oldParent].child1 = newParent;
+        else nodes[oldParent].child2 = newParent;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+        RefitAncestors(oldParent);
+    }
+    void RemoveLeaf(Proxy leaf) {
+        if (leaf == root) {
+            root = NULL_PROXY;
+            return;
+        }
+        // The sibling takes the parent's place
+        Proxy parent = nodes[leaf].parent;
+        Proxy grandParent = nodes[parent].parent;
+        Proxy sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+        Free(parent);
+        nodes[sibling].parent = grandParent;
+        if (grandParent == NULL_PROXY) {
+            root = sibling;
+            return;
+        }
+        if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+        else nodes[grandParent].child2 = sibling;
+        RefitAncestors(grandParent);
+    }
+    // Balances and refits every node from index up to the root
+    void RefitAncestors(Proxy index) {
+        while (index != NULL_PROXY) {
+            index = Balance(index);
+            Refit(index);
+            index = nodes[index].parent;
+        }
+    }
+
+    // If one child of a is more than one level taller than the other, rotates it up to take a's place and returns it
+    Proxy Balance(Proxy a) {
+        Node& nodeA = nodes[a];
+        if (nodeA.IsLeaf() || nodeA.height < 2) return a;
+        int32_t balance = nodes[nodeA.child2].height - nodes[nodeA.child1].height;
+        if (balance > 1) return Rotate(a, nodeA.child2, false);
+        if (balance < -1) return Rotate(a, nodeA.child1, true);
+        return a;
+    }
+    // Moves the tall child up into a's place. a keeps its short child and takes the shorter grandchild,
+    // while the tall child keeps the taller grandchild next to a.
+    Proxy Rotate(Proxy a, Proxy tall, bool tallIsFirst) {
+        Node& nodeA = nodes[a];
+        Node& nodeTall = nodes[tall];
+        Proxy grandChild1 = nodeTall.child1;
+        Proxy grandChild2 = nodeTall.child2;
+
+        nodeTall.child1 = a;
+        nodeTall.parent = nodeA.parent;
+        nodeA.parent = tall;
+        if (nodeTall.parent == NULL_PROXY) root = tall;
+        else if (nodes[nodeTall.parent].child1 == a) nodes[nodeTall.parent].child1 = tall;
+        else nodes[nodeTall.parent].child2 = tall;
+
+        Proxy kept = nodes[grandChild1].height > nodes[grandChild2].height ? grandChild1 : grandChild2;
+        Proxy moved = kept == grandChild1 ? grandChild2 : grandChild1;
+        nodeTall.child2 = kept;
+        if (tallIsFirst) nodeA.child1 = moved;
+        else nodeA.child2 = moved;
+        nodes[moved].parent = a;
+        Refit(a);
+        Refit(tall);
+        return tall;
+    }
+
+    void Fatten(Proxy leaf, const Bounds& bounds, const glm::vec3& displacement) {
+        Node& node = nodes[leaf];
+        node.minBound = bounds.GetMinBound() - glm::vec3(margin);
+        node.maxBound = bounds.GetMaxBound() + glm::vec3(margin);
+        glm::vec3 reach = DISPLACEMENT_MULTIPLIER * displacement;
+        node.minBound += glm::min(reach, glm::vec3(0));
+        node.maxBound += glm::max(reach, glm::vec3(0));
+    }
+public:
+    // Margin added to the bounds of every leaf, so small moves do not touch the tree
+    DynamicAabbTree(float margin = 0.1f) {
+        this->margin = margin;
+    }
+
+    Proxy Insert(T* value, const Bounds& bounds) {
+        Proxy leaf = Allocate();
+        nodes[leaf].value = value;
+        Fatten(leaf, bounds, glm::vec3(0));
+        InsertLeaf(leaf);
+        leafCount++;
+        return leaf;
+    }
+    void Remove(Proxy leaf) {
+        RemoveLeaf(leaf);
+        Free(leaf);
+        leafCount--;
+    }
+    // Updates the bounds of a leaf after its item moved by displacement. Returns whether it had to be reinserted,
+    // which only happens once the bounds leave the fat ones it was inserted with.
+    bool Move(Proxy leaf, const Bounds& bounds, const glm::vec3& displacement = glm::vec3(0)) {
+        const Node& node = nodes[leaf];
+        if (glm::all(glm::lessThanEqual(node.minBound, bounds.GetMinBound())) && glm::all(glm::lessThanEqual(bounds.GetMaxBound(), node.maxBound))) return false;
+        RemoveLeaf(leaf);
+        Fatten(leaf, bounds, displacement);
+        InsertLeaf(leaf);
+        return true;
+    }
+
+    // Calls func(T*) for every leaf whose fat bounds overlap the given ones
+    template <typename Func>
+    void Query(const Bounds& bounds, Func func) const {
+        if (root == NULL_PROXY) return;
+        glm::vec3 minBound = bounds.GetMinBound();
+        glm::vec3 maxBound = bounds.GetMaxBound();
+        std::vector<Proxy> stack;
+        stack.reserve(64);
+        stack.push_back(root);
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+            if (glm::any(glm::greaterThan(node.minBound, maxBound)) || glm::any(glm::lessThan(node.maxBound, minBound))) continue;
+            if (node.IsLeaf()) {
+                func(node.value);
+                continue;
+            }
+            stack.push_back(node.child1);
+            stack.push_back(node.child2);
+        }
+    }
+    // Calls func(T*, maxDistance) for every leaf whose fat bounds the ray origin + t * direction enters within maxDistance.
+    // func returns the new maxDistance, which lets a search for the closest hit stop looking past the best one so far.
+    // The nearer child of every node is visited first, so the closest hits tend to come early.
+    template <typename Func>
+    void Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Func func) const {
+        float entry, exit;
+        if (root == NULL_PROXY || !RayIntersectsBox(origin, direction, nodes[root].minBound, nodes[root].maxBound, entry, exit) || entry > maxDistance) return;
+        // Nodes the ray enters, with where it enters them
+        std::vector<std::pair<Proxy, float>> stack;
+        stack.reserve(64);
+        stack.push_back({root, entry});
+        while (!stack.empty()) {
+            std::pair<Proxy, float> top = stack.back();
+            stack.pop_back();
+            // A closer hit may have been found since it was pushed
+            if (top.second > maxDistance) continue;
+            const Node& node = nodes[top.first];
+            if (node.IsLeaf()) {
+                maxDistance = func(node.value, maxDistance);
+                continue;
+            }
+            float entry1, entry2;
+            bool hit1 = RayIntersectsBox(origin, direction, nodes[node.child1].minBound, nodes[node.child1].maxBound, entry1, exit) && entry1 <= maxDistance;
+            bool hit2 = RayIntersectsBox(origin, direction, nodes[node.child2].minBound, nodes[node.child2].maxBound, entry2, exit) && entry2 <= maxDistance;
+            if (hit1 && hit2 && entry1 < entry2) {
+                stack.push_back({node.child2, entry2});
+                stack.push_back({node.child1, entry1});
+                continue;
+            }
+            if (hit1) stack.push_back({node.child1, entry1});
+            if (hit2) stack.push_back({node.child2, entry2});
+        }
+    }
+
+    T* GetValue(Proxy leaf) const {
+        return nodes[leaf].value;
+    }
+    Bounds GetFatBounds(Proxy leaf) const {
+        return Bounds(nodes[leaf].minBound, nodes[leaf].maxBound);
+    }
+    size_t Size() const {
+        return leafCount;
+    }
+    // Levels below the root, 0 for a single leaf
+    int32_t GetHeight() const {
+        return root == NULL_PROXY ? 0 : nodes[root].height;
+    }
+};
+
+#endif
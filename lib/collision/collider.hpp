@@ -7,15 +7,36 @@
 
 #include "../gameObject.hpp"
 #include "bounds.hpp"
+#include "meshBvh.hpp"
 #include "../extensions/math.hpp"
 
+// Exact shape of a collider, which picks the narrow phase test used against every other shape
+typedef int ColliderShape;
+const ColliderShape COLLIDER_SPHERE = 0;
+const ColliderShape COLLIDER_ELLIPSOID = 1;
+const ColliderShape COLLIDER_BOX = 2;
+const ColliderShape COLLIDER_MESH = 3;
+const int COLLIDER_SHAPE_COUNT = 4;
+
 class Collider : public Component {
 private:
     bool started = false;
+    // Version of the owner's transform the origin was last taken from
+    uint64_t syncedVersion = 0;
     GLuint vao;
     GLuint vbo;
     unsigned int renderPointCount = 0;
     bool renderDirty = true;
+    // Continuous colliders are tested along the whole path their center moved between two collision checks
+    bool continuous = false;
+    bool sweepStarted = false;
+    glm::vec3 sweepStart = {0,0,0};
+    glm::vec3 sweepEnd = {0,0,0};
+    // Set by the collision world: the layer of the collider, and the bits of the layers it collides with
+    int collisionLayer = -1;
+    uint32_t collisionMask = 0;
+protected:
+    ColliderShape shape;
 public:
     virtual Bounds GetBounds() = 0;
     virtual Collider* Translate(glm::vec3 delta) = 0;
@@ -24,16 +45,13 @@ public:
     virtual bool Contains(glm::vec3 point) = 0;
     virtual std::vector<glm::vec3> GetProbePoints() = 0;
 
+    // Raised by the collision layers once a check is over, with this collider first and the one it touches second
     Event<Collider*, Collider*> OnCollisionEnter;
+    Event<Collider*, Collider*> OnCollisionStay;
+    Event<Collider*, Collider*> OnCollisionExit;
 
-    static void OnMoveCallback(Collider* instance, Transform* t, const glm::vec3& oldPos, const glm::vec3& newPos) {
-        instance->SetOrigin(newPos);
-    }
-    ObjEventHandler<Collider, Transform*, const glm::vec3&, const glm::vec3&> OnMoveHandler;
-    
     // Called only by instantiated subclasses
     Collider() {
-        OnMoveHandler = ObjEventHandler<Collider, Transform*, const glm::vec3&, const glm::vec3&>(this, OnMoveCallback);
         glGenVertexArrays(1, &vao);
         glGenBuffers(1, &vbo);
     }
@@ -42,28 +60,84 @@ public:
         glDeleteBuffers(1, &vbo);
     }
 
-    bool CollidesWith(Collider* other) {
-        for (glm::vec3 p : other->GetProbePoints()) {
-            if (Contains(p)) return true;
-        }
-        for (glm::vec3 p : GetProbePoints()) {
-            if (other->Contains(p)) return true;
-        }
-        return false;
+    ColliderShape GetShape() const {
+        return shape;
+    }
+    // Whether the collider takes part in collision checks at all
+    bool IsActive() {
+        return IsEnabled() && GetGameObject()->IsEnabled();
     }
 
+    void SetCollisionFilter(int layer, uint32_t mask) {
+        collisionLayer = layer;
+        collisionMask = mask;
+    }
+    int GetCollisionLayer() const {
+        return collisionLayer;
+    }
+    uint32_t GetLayerBit() const {
+        return collisionLayer < 0 ? 0 : 1u << collisionLayer;
+    }
+    uint32_t GetCollisionMask() const {
+        return collisionMask;
+    }
+    // Exact overlap test between both shapes. Touching counts as colliding. See narrowPhase.hpp
+    bool CollidesWith(Collider* other);
+
+    // Fast colliders that could pass through others between two checks. See continuous.hpp
+    Collider* SetContinuous(bool continuous) {
+        this->continuous = continuous;
+        sweepStarted = false;
+        return this;
+    }
+    bool IsContinuous() const {
+        return continuous;
+    }
+    // Called by the collision layer on every check. Only the moves between two checks where the collider was active count,
+    // so a collider that gets reused somewhere else starts a new sweep where it stands.
+    void AdvanceSweep(bool active) {
+        Bounds bounds = GetBounds();
+        glm::vec3 center = (bounds.GetMinBound() + bounds.GetMaxBound()) * 0.5f;
+        sweepStart = sweepStarted && active ? sweepEnd : center;
+        sweepEnd = center;
+        sweepStarted = active;
+    }
+    // How far the center moved between the last two checks, zero for discrete colliders
+    glm::vec3 GetMotion() const {
+        return continuous ? sweepEnd - sweepStart : glm::vec3(0);
+    }
+    // Bounds of everything the collider went through since the previous check, for the broadphases
+    Bounds GetSweptBounds() {
+        Bounds bounds = GetBounds();
+        if (!continuous) return bounds;
+        glm::vec3 motion = GetMotion();
+        return Bounds(glm::min(bounds.GetMinBound(), bounds.GetMinBound() - motion), glm::max(bounds.GetMaxBound(), bounds.GetMaxBound() - motion));
+    }
+
+    // Starts following the owner's position
     virtual void Initialize() {
         if (started) return;
         if (this->GetGameObject() != nullptr) {
-            this->GetGameObject()->transform.OnMoved.AddListener(&OnMoveHandler);
             started = true;
+            SyncWithTransform();
         }
     }
 
     void Detach() {
-        if (this->GetGameObject() != nullptr) {
-            this->GetGameObject()->transform.OnMoved.RemoveListener(&OnMoveHandler);
-        }
+        started = false;
+    }
+
+    // Moves the collider to its owner's position if the owner's transform changed since the last sync
+    void SyncWithTransform() {
+        if (!started) return;
+        const Transform& transform = this->GetGameObject()->transform;
+        if (transform.GetVersion() == syncedVersion) return;
+        syncedVersion = transform.GetVersion();
+        FollowTransform(transform);
+    }
+    // Takes whatever the shape follows from the owner's transform, which is only its position unless the shape can turn
+    virtual void FollowTransform(const Transform& transform) {
+        SetOrigin(transform.GetPosition());
     }
 
     virtual std::vector<glm::vec3> GetRenderPoints() {
@@ -96,6 +170,7 @@ public:
     }
 
     virtual void Render(Shader* colliderShader, glm::mat4 viewProjectionMatrix, glm::vec3 color = {0.2,1,0.2}) {
+        SyncWithTransform();
         if (renderDirty) {
             RecalculateRenderData();
         }
@@ -134,6 +209,9 @@ public:
     }
     virtual bool Contains(glm::vec3 point) = 0;
     virtual std::vector<glm::vec3> GetProbePoints() = 0;
+    glm::vec3 GetCenter() const {
+        return center;
+    }
 };
 
 class SphereCollider : public CenteredCollider {
@@ -148,6 +226,7 @@ protected:
     }
 public:
     SphereCollider(glm::vec3 origin, float radius, glm::vec3 offset = {0,0,0}) {
+        this->shape = COLLIDER_SPHERE;
         this->origin = origin;
         this->offset = offset;
         this->center = origin + offset;
@@ -172,6 +251,9 @@ public:
         RecalculateBounds();
         return this;
     }
+    float GetRadius() const {
+        return radius;
+    }
     bool Contains(glm::vec3 point) {
         return SquareMagnitude(point - center) < squareRadius;
     }
@@ -231,23 +313,59 @@ protected:
     }
 public:
     EllipsoidCollider(glm::vec3 origin, float radius, glm::vec3 scale, glm::vec3 offset = {0,0,0}) : SphereCollider(origin, radius, offset) {
+        this->shape = COLLIDER_ELLIPSOID;
         SetScale(scale);
     }
     EllipsoidCollider(glm::vec3 origin, glm::vec3 scale, glm::vec3 offset = {0,0,0}) : SphereCollider(origin, 1, offset) {
+        this->shape = COLLIDER_ELLIPSOID;
         SetScale(scale);
     }
     void SetScale(glm::vec3 scale) {
         this->scale = scale;
         RecalculateBounds();
     }
-    glm::vec3 GetScale() {
+    glm::vec3 GetScale() const {
         return scale;
     }
+    // Half extents along every axis
+    glm::vec3 GetSemiAxes() const {
+        return scale * radius;
+    }
     bool Contains(glm::vec3 point) {
         return SquareMagnitude((point - center) / scale) < squareRadius;
     }
 };
 
+// Line strip going over every edge of the bounds
+inline std::vector<glm::vec3> BoxOutline(const Bounds& bounds) {
+    return {
+        bounds.GetRelativePoint(0,0,0), // LEFT square
+        bounds.GetRelativePoint(0,0,1),
+        bounds.GetRelativePoint(0,1,1),
+        bounds.GetRelativePoint(0,1,0),
+        bounds.GetRelativePoint(1,1,0), // RIGHT square
+        bounds.GetRelativePoint(1,1,1),
+        bounds.GetRelativePoint(1,0,1),
+        bounds.GetRelativePoint(1,0,0), 
+        bounds.GetRelativePoint(1,0,1), // BOTTOM square
+        bounds.GetRelativePoint(1,0,0),
+        bounds.GetRelativePoint(0,0,0),
+        bounds.GetRelativePoint(0,0,1),
+        bounds.GetRelativePoint(0,1,1), // FRONT square
+        bounds.GetRelativePoint(1,1,1),
+        bounds.GetRelativePoint(1,0,1),
+        bounds.GetRelativePoint(0,0,1),
+        bounds.GetRelativePoint(0,1,1), // TOP square
+        bounds.GetRelativePoint(0,1,0),
+        bounds.GetRelativePoint(1,1,0),
+        bounds.GetRelativePoint(1,1,1),
+        bounds.GetRelativePoint(1,1,0), // BACK square
+        bounds.GetRelativePoint(1,0,0),
+        bounds.GetRelativePoint(0,0,0),
+        bounds.GetRelativePoint(0,1,0)
+    };
+}
+
 class BoxCollider : public CenteredCollider {
 protected:
     Bounds bounds;
@@ -259,6 +377,7 @@ protected:
     }
 public:
     BoxCollider(glm::vec3 origin, glm::vec3 size, glm::vec3 offset = {0,0,0}) {
+        this->shape = COLLIDER_BOX;
         this->origin = origin;
         this->offset = offset;
         this->center = origin + offset;
@@ -303,33 +422,218 @@ public:
     }
 
     virtual std::vector<glm::vec3> GetRenderPoints() {
+        return BoxOutline(bounds);
+    }
+};
+
+// Collider following the triangles of a mesh, through a BVH built once for the mesh and shared by every collider placed with it.
+// The BVH stays in the mesh's own space, which maps to the world as center + rotation * (scale * point), like a transform's model matrix.
+// Tests bring the query into that space rather than the triangles out of it. Attached colliders follow the position, rotation
+// and scale of their owner, so they match the mesh it draws. Only the surface collides: a shape entirely inside a closed mesh does not touch it.
+// The BVH is not owned and must outlive the collider.
+class MeshCollider : public CenteredCollider {
+protected:
+    const MeshBvh* bvh;
+    Bounds bounds;
+    // Orthonormal, with the mesh's axes in world space as columns
+    glm::mat3 rotation = glm::mat3(1);
+    glm::vec3 scale = {1,1,1};
+    // rotation * scale, and its inverse
+    glm::mat3 linear = glm::mat3(1);
+    glm::mat3 inverseLinear = glm::mat3(1);
+
+    static glm::mat3 Absolute(const glm::mat3& m) {
+        return glm::mat3(glm::abs(m[0]), glm::abs(m[1]), glm::abs(m[2]));
+    }
+    void RecalculateBounds() {
+        Bounds local = bvh->GetBounds();
+        glm::vec3 localCenter = (local.GetMinBound() + local.GetMaxBound()) * 0.5f;
+        glm::vec3 extent = Absolute(linear) * ((local.GetMaxBound() - local.GetMinBound()) * 0.5f);
+        glm::vec3 worldCenter = ToWorld(localCenter);
+        this->bounds = Bounds(worldCenter - extent, worldCenter + extent);
+        MarkRenderDirty();
+    }
+    void RecalculateLinear() {
+        linear = glm::mat3(rotation[0] * scale.x, rotation[1] * scale.y, rotation[2] * scale.z);
+        inverseLinear = glm::transpose(glm::mat3(rotation[0] / scale.x, rotation[1] / scale.y, rotation[2] / scale.z));
+        RecalculateBounds();
+    }
+    // Mesh space box holding a world space one
+    void LocalBox(const glm::vec3& minBound, const glm::vec3& maxBound, glm::vec3& localMin, glm::vec3& localMax) const {
+        glm::vec3 localCenter = ToLocal((minBound + maxBound) * 0.5f);
+        glm::vec3 extent = Absolute(inverseLinear) * ((maxBound - minBound) * 0.5f);
+        localMin = localCenter - extent;
+        localMax = localCenter + extent;
+    }
+    static bool BoxesOverlap(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB) {
+        return glm::all(glm::lessThanEqual(minA, maxB)) && glm::all(glm::lessThanEqual(minB, maxA));
+    }
+    void WorldTriangle(const MeshBvhTriangle& triangle, glm::vec3* vertices) const {
+        for (int k = 0; k < 3; ++k) vertices[k] = ToWorld(triangle.vertices[k]);
+    }
+public:
+    MeshCollider(const MeshBvh* bvh, glm::vec3 origin, glm::vec3 scale = {1,1,1}, glm::vec3 offset = {0,0,0}) {
+        this->shape = COLLIDER_MESH;
+        this->bvh = bvh;
+        this->origin = origin;
+        this->offset = offset;
+        this->center = origin + offset;
+        this->scale = scale;
+        RecalculateLinear();
+    }
+    Bounds GetBounds() {
+        return bounds;
+    }
+    Collider* SetOrigin(glm::vec3 origin) {
+        CenteredCollider::SetOrigin(origin);
+        RecalculateBounds();
+        return this;
+    }
+    Collider* SetOffset(glm::vec3 offset) {
+        CenteredCollider::SetOffset(offset);
+        RecalculateBounds();
+        return this;
+    }
+    Collider* SetOrientation(const glm::mat3& rotation) {
+        this->rotation = rotation;
+        RecalculateLinear();
+        return this;
+    }
+    Collider* SetScale(glm::vec3 scale) {
+        this->scale = scale;
+        RecalculateLinear();
+        return this;
+    }
+    void FollowTransform(const Transform& transform) {
+        glm::mat3 model = glm::mat3(transform.GetModelMatrix());
+        scale = transform.GetScale();
+        rotation = glm::mat3(model[0] / scale.x, model[1] / scale.y, model[2] / scale.z);
+        CenteredCollider::SetOrigin(transform.GetPosition());
+        RecalculateLinear();
+    }
+    const MeshBvh* GetBvh() const {
+        return bvh;
+    }
+    const glm::mat3& GetRotation() const {
+        return rotation;
+    }
+    glm::vec3 GetScale() const {
+        return scale;
+    }
+
+    glm::vec3 ToLocal(const glm::vec3& point) const {
+        return inverseLinear * (point - center);
+    }
+    glm::vec3 DirectionToLocal(const glm::vec3& direction) const {
+        return inverseLinear * direction;
+    }
+    glm::vec3 ToWorld(const glm::vec3& point) const {
+        return center + linear * point;
+    }
+
+    // The map to mesh space is affine, so t along the ray is the same on both sides of it
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const {
+        uint32_t triangle;
+        return bvh->Raycast(ToLocal(origin), DirectionToLocal(direction), maxDistance, distance, triangle);
+    }
+    // Whether the surface comes within an axis aligned ellipsoid. A sphere, or any ellipsoid while the mesh is not rotated,
+    // stays axis aligned in mesh space. Otherwise the triangles are brought out to the world, within the mesh space box of the ellipsoid.
+    bool OverlapsEllipsoid(const glm::vec3& center, const glm::vec3& semiAxes) {
+        if (!BoxesOverlap(center - semiAxes, center + semiAxes, bounds.GetMinBound(), bounds.GetMaxBound())) return false;
+        if ((semiAxes.x == semiAxes.y && semiAxes.y == semiAxes.z) || rotation == glm::mat3(1)) {
+            return bvh->OverlapsEllipsoid(ToLocal(center), semiAxes / glm::abs(scale));
+        }
+        glm::vec3 localMin, localMax;
+        LocalBox(center - semiAxes, center + semiAxes, localMin, localMax);
+        glm::vec3 point = center / semiAxes;
+        return bvh->Traverse([&](const glm::vec3& minBound, const glm::vec3& maxBound) {
+            return BoxesOverlap(minBound, maxBound, localMin, localMax);
+        }, [&](const MeshBvhTriangle& triangle) {
+            glm::vec3 vertices[3];
+            WorldTriangle(triangle, vertices);
+            glm::vec3 delta = point - ClosestPointOnTriangle(point, vertices[0] / semiAxes, vertices[1] / semiAxes, vertices[2] / semiAxes);
+            return glm::dot(delta, delta) <= 1;
+        });
+    }
+    // Whether the surface comes within an axis aligned box
+    bool OverlapsBox(const glm::vec3& minBound, const glm::vec3& maxBound) {
+        if (!BoxesOverlap(minBound, maxBound, bounds.GetMinBound(), bounds.GetMaxBound())) return false;
+        glm::vec3 localMin, localMax;
+        LocalBox(minBound, maxBound, localMin, localMax);
+        return bvh->Traverse([&](const glm::vec3& nodeMin, const glm::vec3& nodeMax) {
+            return BoxesOverlap(nodeMin, nodeMax, localMin, localMax);
+        }, [&](const MeshBvhTriangle& triangle) {
+            glm::vec3 vertices[3];
+            WorldTriangle(triangle, vertices);
+            return TriangleOverlapsBox(vertices[0], vertices[1], vertices[2], minBound, maxBound);
+        });
+    }
+    // Whether the surfaces of two meshes cross or touch. Every triangle of this mesh near the other one
+    // looks for the triangles of the other mesh within its box, in the other mesh's space.
+    bool OverlapsMesh(MeshCollider* other) {
+        Bounds otherBounds = other->GetBounds();
+        if (!BoxesOverlap(bounds.GetMinBound(), bounds.GetMaxBound(), otherBounds.GetMinBound(), otherBounds.GetMaxBound())) return false;
+        glm::vec3 nearMin, nearMax;
+        LocalBox(otherBounds.GetMinBound(), otherBounds.GetMaxBound(), nearMin, nearMax);
+        return bvh->Traverse([&](const glm::vec3& minBound, const glm::vec3& maxBound) {
+            return BoxesOverlap(minBound, maxBound, nearMin, nearMax);
+        }, [&](const MeshBvhTriangle& triangle) {
+            glm::vec3 vertices[3];
+            WorldTriangle(triangle, vertices);
+            glm::vec3 otherMin, otherMax;
+            other->LocalBox(glm::min(vertices[0], glm::min(vertices[1], vertices[2])), glm::max(vertices[0], glm::max(vertices[1], vertices[2])), otherMin, otherMax);
+            return other->bvh->Traverse([&](const glm::vec3& minBound, const glm::vec3& maxBound) {
+                return BoxesOverlap(minBound, maxBound, otherMin, otherMax);
+            }, [&](const MeshBvhTriangle& otherTriangle) {
+                glm::vec3 otherVertices[3];
+                other->WorldTriangle(otherTriangle, otherVertices);
+                return TrianglesOverlap(vertices, otherVertices);
+            });
+        });
+    }
+    // Distance from a point to the closest point of the surface. World distances are at least the mesh space ones
+    // times the smallest scale, which is enough to skip nodes farther than the best triangle so far.
+    float DistanceTo(const glm::vec3& point) const {
+        glm::vec3 local = ToLocal(point);
+        glm::vec3 absoluteScale = glm::abs(scale);
+        float smallestScale = std::min(absoluteScale.x, std::min(absoluteScale.y, absoluteScale.z));
+        float best = INFINITY;
+        bvh->Traverse([&](const glm::vec3& minBound, const glm::vec3& maxBound) {
+            glm::vec3 delta = local - glm::clamp(local, minBound, maxBound);
+            return glm::dot(delta, delta) * smallestScale * smallestScale <= best;
+        }, [&](const MeshBvhTriangle& triangle) {
+            glm::vec3 vertices[3];
+            WorldTriangle(triangle, vertices);
+            glm::vec3 delta = point - ClosestPointOnTriangle(point, vertices[0], vertices[1], vertices[2]);
+            best = std::min(best, glm::dot(delta, delta));
+            return false;
+        });
+        return std::sqrt(best);
+    }
+    // Inside a closed mesh, a ray crosses the surface an odd number of times. The direction avoids running along the axes,
+    // where it would be likelier to graze the edges of axis aligned triangles.
+    bool Contains(glm::vec3 point) {
+        if (!bounds.Contains(point)) return false;
+        return bvh->CountCrossings(ToLocal(point), glm::vec3(0.5773f, 0.6671f, 0.4713f)) % 2 == 1;
+    }
+    inline std::vector<glm::vec3> GetProbePoints() {
         return {
-            bounds.GetRelativePoint(0,0,0), // LEFT square
+            bounds.GetRelativePoint(0,0,0),
             bounds.GetRelativePoint(0,0,1),
-            bounds.GetRelativePoint(0,1,1),
             bounds.GetRelativePoint(0,1,0),
-            bounds.GetRelativePoint(1,1,0), // RIGHT square
-            bounds.GetRelativePoint(1,1,1),
-            bounds.GetRelativePoint(1,0,1),
-            bounds.GetRelativePoint(1,0,0), 
-            bounds.GetRelativePoint(1,0,1), // BOTTOM square
+            bounds.GetRelativePoint(0,1,1),
             bounds.GetRelativePoint(1,0,0),
-            bounds.GetRelativePoint(0,0,0),
-            bounds.GetRelativePoint(0,0,1),
-            bounds.GetRelativePoint(0,1,1), // FRONT square
-            bounds.GetRelativePoint(1,1,1),
             bounds.GetRelativePoint(1,0,1),
-            bounds.GetRelativePoint(0,0,1),
-            bounds.GetRelativePoint(0,1,1), // TOP square
-            bounds.GetRelativePoint(0,1,0),
             bounds.GetRelativePoint(1,1,0),
-            bounds.GetRelativePoint(1,1,1),
-            bounds.GetRelativePoint(1,1,0), // BACK square
-            bounds.GetRelativePoint(1,0,0),
-            bounds.GetRelativePoint(0,0,0),
-            bounds.GetRelativePoint(0,1,0)
+            bounds.GetRelativePoint(1,1,1)
         };
     }
+    virtual std::vector<glm::vec3> GetRenderPoints() {
+        return BoxOutline(bounds);
+    }
 };
 
+#include "narrowPhase.hpp"
+#include "continuous.hpp"
+
 #endif
\ No newline at end of file
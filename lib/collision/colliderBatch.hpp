@@ -0,0 +1,292 @@
+#ifndef COLLIDER_BATCH_HPP
+#define COLLIDER_BATCH_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COLLIDER_BATCH_SSE2
+#endif
+
+#include "collider.hpp"
+
+// ##################
+// # COLLIDER BATCH #
+// ##################
+// Copy of a set of colliders laid out in columns (bounds, centers, scales, radii, shapes and masks), so a single collider
+// can be tested against four of them per SSE instruction. Every lane runs the same exact test as Collider::CollidesWith,
+// with the shape specific branches computed side by side and blended by shape. The costly ellipsoid root search only
+// runs on packs where some lane needs it and passed the bounds test. Meshes take part in the bounds test, then run the scalar test.
+// The batch is a snapshot: fill it after the colliders moved, build it, then query it as often as needed.
+
+typedef int ColliderBatchColumn;
+const ColliderBatchColumn BATCH_MIN_X = 0;
+const ColliderBatchColumn BATCH_MIN_Y = 1;
+const ColliderBatchColumn BATCH_MIN_Z = 2;
+const ColliderBatchColumn BATCH_MAX_X = 3;
+const ColliderBatchColumn BATCH_MAX_Y = 4;
+const ColliderBatchColumn BATCH_MAX_Z = 5;
+const ColliderBatchColumn BATCH_CENTER_X = 6;
+const ColliderBatchColumn BATCH_CENTER_Y = 7;
+const ColliderBatchColumn BATCH_CENTER_Z = 8;
+// Scale of round shapes (1 for spheres), unused by boxes
+const ColliderBatchColumn BATCH_SCALE_X = 9;
+const ColliderBatchColumn BATCH_SCALE_Y = 10;
+const ColliderBatchColumn BATCH_SCALE_Z = 11;
+const ColliderBatchColumn BATCH_RADIUS = 12;
+const int BATCH_COLUMN_COUNT = 13;
+
+class ColliderBatch {
+private:
+    // Everything the narrow phase tests read from a collider
+    struct Shape {
+        glm::vec3 minBound;
+        glm::vec3 maxBound;
+        glm::vec3 center;
+        glm::vec3 scale;
+        float radius;
+        ColliderShape shape;
+    };
+    // Columns are padded to a multiple of four with entries whose mask is 0, so they never hit
+    std::vector<float> columns[BATCH_COLUMN_COUNT];
+    std::vector<int32_t> shapes;
+    std::vector<uint32_t> masks;
+    std::vector<Collider*> colliders;
+    size_t count = 0;
+
+    static Shape Describe(Collider* collider) {
+        Shape shape;
+        Bounds bounds = collider->GetBounds();
+        shape.minBound = bounds.GetMinBound();
+        shape.maxBound = bounds.GetMaxBound();
+        shape.shape = collider->GetShape();
+        shape.scale = glm::vec3(1);
+        shape.radius = 0;
+        if (shape.shape == COLLIDER_BOX || shape.shape == COLLIDER_MESH) {
+            shape.center = (shape.minBound + shape.maxBound) * 0.5f;
+            return shape;
+        }
+        SphereCollider* sphere = static_cast<SphereCollider*>(collider);
+        shape.center = sphere->GetCenter();
+        shape.radius = sphere->GetRadius();
+        if (shape.shape == COLLIDER_ELLIPSOID) shape.scale = static_cast<EllipsoidCollider*>(collider)->GetScale();
+        return shape;
+    }
+    void Push(const Shape& shape, uint32_t mask, Collider* collider) {
+        const float values[BATCH_COLUMN_COUNT] = {
+            shape.minBound.x, shape.minBound.y, shape.minBound.z,
+            shape.maxBound.x, shape.maxBound.y, shape.maxBound.z,
+            shape.center.x, shape.center.y, shape.center.z,
+            shape.scale.x, shape.scale.y, shape.scale.z,
+            shape.radius
+        };
+        for (int c = 0; c < BATCH_COLUMN_COUNT; ++c) columns[c].push_back(values[c]);
+        shapes.push_back(shape.shape);
+        masks.push_back(mask);
+        colliders.push_back(collider);
+    }
+
+#ifdef COLLIDER_BATCH_SSE2
+    static __m128 Select(__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+    static __m128 Dot(__m128 x, __m128 y, __m128 z) {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    }
+    static __m128 Clamp(__m128 value, __m128 low, __m128 high) {
+        return _mm_min_ps(_mm_max_ps(value, low), high);
+    }
+    // Four lanes of SquareDistanceToBox
+    static __m128 SquareDistanceToBox4(const __m128 point[3], const __m128 minBound[3], const __m128 maxBound[3]) {
+        __m128 delta[3];
+        for (int k = 0; k < 3; ++k) delta[k] = _mm_sub_ps(point[k], Clamp(point[k], minBound[k], maxBound[k]));
+        return Dot(delta[0], delta[1], delta[2]);
+    }
+    // Four lanes of SquareDistanceToEllipsoid, bisecting every lane the same number of times
+    static __m128 SquareDistanceToEllipsoid4(const __m128 point[3], const __m128 semiAxes[3]) {
+        __m128 one = _mm_set1_ps(1);
+        __m128 scaled[3], squareAxes[3], weighted[3];
+        for (int k = 0; k < 3; ++k) {
+            scaled[k] = _mm_div_ps(point[k], semiAxes[k]);
+            squareAxes[k] = _mm_mul_ps(semiAxes[k], semiAxes[k]);
+            weighted[k] = _mm_mul_ps(semiAxes[k], point[k]);
+        }
+        __m128 inside = _mm_cmple_ps(Dot(scaled[0], scaled[1], scaled[2]), one);
+        __m128 low = _mm_setzero_ps();
+        __m128 high = _mm_sqrt_ps(Dot(weighted[0], weighted[1], weighted[2]));
+        __m128 half = _mm_set1_ps(0.5f);
+        for (int i = 0; i < ELLIPSOID_DISTANCE_ITERATIONS; ++i) {
+            __m128 t = _mm_mul_ps(_mm_add_ps(low, high), half);
+            __m128 ratio[3];
+            for (int k = 0; k < 3; ++k) ratio[k] = _mm_div_ps(weighted[k], _mm_add_ps(t, squareAxes[k]));
+            __m128 outside = _mm_cmpgt_ps(Dot(ratio[0], ratio[1], ratio[2]), one);
+            low = Select(outside, t, low);
+            high = Select(outside, high, t);
+        }
+        __m128 delta[3];
+        for (int k = 0; k < 3; ++k) {
+            delta[k] = _mm_sub_ps(_mm_div_ps(_mm_mul_ps(squareAxes[k], point[k]), _mm_add_ps(high, squareAxes[k])), point[k]);
+        }
+        return _mm_andnot_ps(inside, Dot(delta[0], delta[1], delta[2]));
+    }
+
+    // Bit i is set if the query hits entry start + i. Only the lanes set in lanes are tested.
+    int PackHits(Collider* queryCollider, const Shape& query, uint32_t queryMask, size_t start, int lanes) const {
+        __m128i laneMasks = _mm_and_si128(_mm_loadu_si128((const __m128i*)(masks.data() + start)), _mm_set1_epi32(queryMask));
+        __m128 allowed = _mm_castsi128_ps(_mm_xor_si128(_mm_cmpeq_epi32(laneMasks, _mm_setzero_si128()), _mm_set1_epi32(-1)));
+
+        __m128 minBound[3], maxBound[3];
+        __m128 hits = allowed;
+        for (int k = 0; k < 3; ++k) {
+            minBound[k] = _mm_loadu_ps(columns[BATCH_MIN_X + k].data() + start);
+            maxBound[k] = _mm_loadu_ps(columns[BATCH_MAX_X + k].data() + start);
+            hits = _mm_and_ps(hits, _mm_cmple_ps(_mm_set1_ps(query.minBound[k]), maxBound[k]));
+            hits = _mm_and_ps(hits, _mm_cmple_ps(minBound[k], _mm_set1_ps(query.maxBound[k])));
+        }
+        int bits = _mm_movemask_ps(hits) & lanes;
+        if (bits == 0) return 0;
+
+        // Lanes with a mesh on either side go through the scalar test, and are left out of the vector ones
+        __m128i laneShapes = _mm_loadu_si128((const __m128i*)(shapes.data() + start));
+        int meshBits = query.shape == COLLIDER_MESH ? bits : bits & _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(laneShapes, _mm_set1_epi32(COLLIDER_MESH))));
+        int meshHits = 0;
+        for (int lane = 0; meshBits >> lane != 0; ++lane) {
+            Collider* collider = colliders[start + lane];
+            if ((meshBits >> lane & 1) && collider != queryCollider && queryCollider->CollidesWith(collider)) meshHits |= 1 << lane;
+        }
+        bits &= ~meshBits;
+        if (bits == 0) return meshHits;
+
+        __m128 isBox = _mm_castsi128_ps(_mm_cmpeq_epi32(laneShapes, _mm_set1_epi32(COLLIDER_BOX)));
+        __m128 center[3], scale[3];
+        for (int k = 0; k < 3; ++k) {
+            center[k] = _mm_loadu_ps(columns[BATCH_CENTER_X + k].data() + start);
+            scale[k] = _mm_loadu_ps(columns[BATCH_SCALE_X + k].data() + start);
+        }
+        __m128 radius = _mm_loadu_ps(columns[BATCH_RADIUS].data() + start);
+
+        if (query.shape == COLLIDER_BOX) {
+            // Box lanes are settled by the bounds. Round lanes test the query box in their own scaled space.
+            if ((_mm_movemask_ps(isBox) & bits) == bits) return bits | meshHits;
+            __m128 point[3], boxMin[3], boxMax[3];
+            for (int k = 0; k < 3; ++k) {
+                point[k] = _mm_div_ps(center[k], scale[k]);
+                boxMin[k] = _mm_div_ps(_mm_set1_ps(query.minBound[k]), scale[k]);
+                boxMax[k] = _mm_div_ps(_mm_set1_ps(query.maxBound[k]), scale[k]);
+            }
+            __m128 round = _mm_cmple_ps(SquareDistanceToBox4(point, boxMin, boxMax), _mm_mul_ps(radius, radius));
+            return (bits & _mm_movemask_ps(Select(isBox, hits, round))) | meshHits;
+        }
+
+        // Round query: box lanes are tested in the query's scaled space
+        __m128 queryRadius = _mm_set1_ps(query.radius * query.radius);
+        __m128 queryCenter[3], queryScale[3];
+        for (int k = 0; k < 3; ++k) {
+            queryCenter[k] = _mm_set1_ps(query.center[k]);
+            queryScale[k] = _mm_set1_ps(query.scale[k]);
+        }
+        int result = meshHits;
+        int boxBits = bits & _mm_movemask_ps(isBox);
+        if (boxBits != 0) {
+            __m128 point[3], boxMin[3], boxMax[3];
+            for (int k = 0; k < 3; ++k) {
+                point[k] = _mm_div_ps(queryCenter[k], queryScale[k]);
+                boxMin[k] = _mm_div_ps(minBound[k], queryScale[k]);
+                boxMax[k] = _mm_div_ps(maxBound[k], queryScale[k]);
+            }
+            result |= boxBits & _mm_movemask_ps(_mm_cmple_ps(SquareDistanceToBox4(point, boxMin, boxMax), queryRadius));
+        }
+        // Two spheres compare their center distance, anything else with an ellipsoid needs the root search
+        __m128 isSphere = _mm_castsi128_ps(_mm_cmpeq_epi32(laneShapes, _mm_set1_epi32(COLLIDER_SPHERE)));
+        int sphereBits = query.shape == COLLIDER_SPHERE ? bits & _mm_movemask_ps(isSphere) : 0;
+        if (sphereBits != 0) {
+            __m128 delta[3];
+            for (int k = 0; k < 3; ++k) delta[k] = _mm_sub_ps(center[k], queryCenter[k]);
+            __m128 radii = _mm_add_ps(radius, _mm_set1_ps(query.radius));
+            result |= sphereBits & _mm_movemask_ps(_mm_cmple_ps(Dot(delta[0], delta[1], delta[2]), _mm_mul_ps(radii, radii)));
+        }
+        int ellipsoidBits = bits & ~boxBits & ~sphereBits;
+        if (ellipsoidBits != 0) {
+            __m128 offset[3], semiAxes[3];
+            for (int k = 0; k < 3; ++k) {
+                offset[k] = _mm_div_ps(_mm_sub_ps(queryCenter[k], center[k]), queryScale[k]);
+                semiAxes[k] = _mm_div_ps(_mm_mul_ps(scale[k], radius), queryScale[k]);
+            }
+            result |= ellipsoidBits & _mm_movemask_ps(_mm_cmple_ps(SquareDistanceToEllipsoid4(offset, semiAxes), queryRadius));
+        }
+        return result;
+    }
+#endif
+public:
+    // Starts a new build, forgetting every collider
+    void Clear() {
+        for (std::vector<float>& column : columns) column.clear();
+        shapes.clear();
+        masks.clear();
+        colliders.clear();
+        count = 0;
+    }
+    // Copies the collider's current shape. Only queries sharing a bit with mask can hit it.
+    void Add(Collider* collider, uint32_t mask = ~0u) {
+        Push(Describe(collider), mask, collider);
+        count++;
+    }
+    // Pads the columns to a whole number of packs. Call after the last Add and before querying.
+    void Build() {
+        Shape empty = {glm::vec3(0), glm::vec3(0), glm::vec3(0), glm::vec3(1), 0, COLLIDER_BOX};
+        while (colliders.size() % 4 != 0) Push(empty, 0, nullptr);
+    }
+    size_t Size() const {
+        return count;
+    }
+
+    // Calls func(Collider*) for every collider of the batch the query overlaps, in the order they were added.
+    // The query itself is skipped if it is part of the batch.
+    template <typename Func>
+    void Query(Collider* query, uint32_t queryMask, Func func) const {
+        QueryFrom(0, query, queryMask, func);
+    }
+    template <typename Func>
+    void Query(Collider* query, Func func) const {
+        QueryFrom(0, query, ~0u, func);
+    }
+    // Like Query, over the colliders added from the first-th one on. Querying with each collider of the batch
+    // from the one after it finds every overlapping pair of the batch once.
+    template <typename Func>
+    void QueryFrom(size_t first, Collider* query, uint32_t queryMask, Func func) const {
+#ifdef COLLIDER_BATCH_SSE2
+        Shape shape = Describe(query);
+        for (size_t start = first - first % 4; start < colliders.size(); start += 4) {
+            int lanes = start < first ? 0xF & (0xF << (first - start)) : 0xF;
+            int bits = PackHits(query, shape, queryMask, start, lanes);
+            for (int lane = 0; bits != 0; ++lane, bits >>= 1) {
+                if ((bits & 1) && colliders[start + lane] != query) func(colliders[start + lane]);
+            }
+        }
+#else
+        for (size_t i = first; i < colliders.size(); ++i) {
+            Collider* collider = colliders[i];
+            if (collider == nullptr || collider == query || (masks[i] & queryMask) == 0) continue;
+            if (query->CollidesWith(collider)) func(collider);
+        }
+#endif
+    }
+    // Calls func(Collider*) for every collider of the batch whose bounds overlap the given ones, leaving the exact test to the caller
+    template <typename Func>
+    void QueryBounds(const Bounds& bounds, uint32_t queryMask, Func func) const {
+        glm::vec3 minBound = bounds.GetMinBound();
+        glm::vec3 maxBound = bounds.GetMaxBound();
+        for (size_t i = 0; i < colliders.size(); ++i) {
+            if ((masks[i] & queryMask) == 0) continue;
+            bool overlaps = true;
+            for (int k = 0; k < 3 && overlaps; ++k) {
+                overlaps = minBound[k] <= columns[BATCH_MAX_X + k][i] && columns[BATCH_MIN_X + k][i] <= maxBound[k];
+            }
+            if (overlaps) func(colliders[i]);
+        }
+    }
+};
+
+#endif
@@ -14,4 +14,20 @@ struct Collision {
     }
 };
 
-#endif
\ No newline at end of file
+// Whether a pair of colliders started touching, kept touching or stopped touching since the previous check
+typedef int ContactEventType;
+const ContactEventType CONTACT_ENTER = 0;
+const ContactEventType CONTACT_STAY = 1;
+const ContactEventType CONTACT_EXIT = 2;
+
+struct ContactEvent : public Collision {
+    ContactEventType type;
+    // Fraction of the last move at which continuous colliders touched, 1 when neither is continuous and on exits
+    float time;
+    ContactEvent(ContactEventType type, Collider* col1, Collider* col2, float time = 1) : Collision(col1, col2) {
+        this->type = type;
+        this->time = time;
+    }
+};
+
+#endif
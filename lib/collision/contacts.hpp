@@ -0,0 +1,144 @@
+#ifndef CONTACTS_HPP
+#define CONTACTS_HPP
+
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "collider.hpp"
+#include "collision.hpp"
+
+// #################
+// # CONTACT CACHE #
+// #################
+// Remembers which pairs of colliders touched on the previous check, so that every pair found by a check becomes
+// an enter or a stay event, and every remembered pair that was not found again becomes an exit event.
+// Events are only queued here: whoever runs the check dispatches the whole buffer once detection is over.
+// Contacts are kept in the order they started and events in the order pairs were touched, so both are deterministic.
+class ContactCache {
+private:
+    struct Contact {
+        Collider* col;
+        Collider* other;
+        // Last check that touched the pair
+        uint32_t stamp;
+    };
+    struct PairHash {
+        size_t operator()(const std::pair<Collider*, Collider*>& pair) const {
+            uint64_t key = (uint64_t)(uintptr_t)pair.first * 0x9E3779B97F4A7C15ull;
+            return key ^ ((uint64_t)(uintptr_t)pair.second + (key >> 29));
+        }
+    };
+
+    std::vector<Contact> contacts;
+    // Pair of colliders to its index in contacts
+    std::unordered_map<std::pair<Collider*, Collider*>, uint32_t, PairHash> contactIndices;
+    std::vector<ContactEvent> events;
+    uint32_t stamp = 0;
+
+    // Drops the contacts failing keep, keeping the others in order
+    template <typename Keep>
+    void Compact(Keep keep) {
+        size_t kept = 0;
+        for (size_t i = 0; i < contacts.size(); ++i) {
+            Contact& contact = contacts[i];
+            if (!keep(contact)) {
+                contactIndices.erase({contact.col, contact.other});
+                continue;
+            }
+            if (kept != i) contactIndices[{contact.col, contact.other}] = kept;
+            contacts[kept++] = contact;
+        }
+        contacts.resize(kept);
+    }
+public:
+    // Starts a new check, clearing the events of the previous one
+    void Begin() {
+        stamp++;
+        events.clear();
+    }
+    // Records that both colliders touch on this check, from the given time of impact on.
+    // A pair touched twice in one check is only reported once.
+    void Touch(Collider* col, Collider* other, float time = 1) {
+        auto found = contactIndices.find({col, other});
+        if (found == contactIndices.end()) {
+            contactIndices[{col, other}] = contacts.size();
+            contacts.push_back({col, other, stamp});
+            events.emplace_back(CONTACT_ENTER, col, other, time);
+            return;
+        }
+        Contact& contact = contacts[found->second];
+        if (contact.stamp == stamp) return;
+        contact.stamp = stamp;
+        events.emplace_back(CONTACT_STAY, col, other, time);
+    }
+    // Ends the check: every contact that was not touched exits
+    void End() {
+        Compact([&](const Contact& contact) {
+            if (contact.stamp == stamp) return true;
+            events.emplace_back(CONTACT_EXIT, contact.col, contact.other);
+            return false;
+        });
+    }
+
+    // Forgets a single pair without an exit, so touching again is a new enter
+    void Drop(Collider* col, Collider* other) {
+        if (contactIndices.count({col, other}) == 0) return;
+        Compact([&](const Contact& contact) {
+            return contact.col != col || contact.other != other;
+        });
+    }
+    // Forgets every contact of a collider that is going away, without exits as there is nothing left to exit from.
+    // Its queued events are cleared, and skipped when dispatching.
+    void Forget(Collider* collider) {
+        Compact([&](const Contact& contact) {
+            return contact.col != collider && contact.other != collider;
+        });
+        for (ContactEvent& event : events) {
+            if (event.collider1 != collider && event.collider2 != collider) continue;
+            event.collider1 = nullptr;
+            event.collider2 = nullptr;
+        }
+    }
+
+    // Raises every event of the last check on both of its colliders, in order.
+    // Enters and stays whose colliders were disabled by earlier callbacks are skipped, and their contacts dropped
+    // since the pair did not get to touch: touching again is a new enter.
+    void Dispatch() {
+        for (size_t i = 0; i < events.size(); ++i) {
+            const ContactEvent event = events[i];
+            Collider* col = event.collider1;
+            Collider* other = event.collider2;
+            // Forgotten while dispatching, because one side was destroyed
+            if (col == nullptr) continue;
+            if (event.type == CONTACT_EXIT) {
+                col->OnCollisionExit.Invoke(col, other);
+                other->OnCollisionExit.Invoke(other, col);
+                continue;
+            }
+            if (!col->IsActive() || !other->IsActive()) {
+                Drop(col, other);
+                continue;
+            }
+            if (event.type == CONTACT_STAY) {
+                col->OnCollisionStay.Invoke(col, other);
+                other->OnCollisionStay.Invoke(other, col);
+                continue;
+            }
+            col->OnCollisionEnter.Invoke(col, other);
+            other->OnCollisionEnter.Invoke(other, col);
+            std::cout << col->GetGameObject()->objectName << " (" << col->GetBounds().ToString() << ") collided with " << other->GetGameObject()->objectName << " (" << other->GetBounds().ToString() << ")" << std::endl;
+        }
+    }
+
+    // Events of the last check: enters and stays in the order the pairs were touched, then exits
+    const std::vector<ContactEvent>& GetEvents() const {
+        return events;
+    }
+    size_t Size() const {
+        return contacts.size();
+    }
+};
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef CONTINUOUS_HPP
+#define CONTINUOUS_HPP
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+
+#include "collider.hpp"
+#include "narrowPhase.hpp"
+
+// ##################################
+// # CONTINUOUS COLLISION DETECTION #
+// ##################################
+// Swept tests for colliders that moved between two checks, so fast ones cannot tunnel through thin or small ones.
+// Both colliders move in a straight line from where they were on the previous check to where they are now,
+// and the tests find the first fraction of that step, their time of impact, at which the shapes touch.
+// Two spheres solve a quadratic. Anything else first casts a ray against the box of both bounds added together,
+// which is exact for two boxes and a lower bound otherwise, then closes in on the contact with Newton steps on the exact distance between the shapes.
+// Meshes have no such distance, so shapes are sampled along their move against them instead.
+
+// Fraction of the move within which a time of impact is settled
+const float CONTINUOUS_TIME_TOLERANCE = 1e-5f;
+const int CONTINUOUS_MAX_ITERATIONS = 64;
+
+// Shape of a collider at some point of its sweep, as everything the swept tests read from it
+struct SweptShape {
+    ColliderShape shape;
+    glm::vec3 center;
+    glm::vec3 semiAxes;
+};
+
+// Meshes are described by their bounds, like boxes
+inline SweptShape DescribeSweptShape(Collider* collider) {
+    SweptShape result;
+    result.shape = collider->GetShape();
+    if (result.shape == COLLIDER_BOX || result.shape == COLLIDER_MESH) {
+        Bounds bounds = collider->GetBounds();
+        result.center = (bounds.GetMinBound() + bounds.GetMaxBound()) * 0.5f;
+        result.semiAxes = (bounds.GetMaxBound() - bounds.GetMinBound()) * 0.5f;
+        return result;
+    }
+    SphereCollider* sphere = static_cast<SphereCollider*>(collider);
+    result.center = sphere->GetCenter();
+    result.semiAxes = result.shape == COLLIDER_ELLIPSOID ? static_cast<EllipsoidCollider*>(collider)->GetSemiAxes() : glm::vec3(sphere->GetRadius());
+    return result;
+}
+
+// Slab test of the ray origin + t * direction against an axis aligned box.
+// On a hit, [entry, exit] is the range of t inside the box, which may start behind the origin.
+inline bool RayIntersectsBox(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& minBound, const glm::vec3& maxBound, float& entry, float& exit) {
+    entry = -INFINITY;
+    exit = INFINITY;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (direction[axis] == 0) {
+            if (origin[axis] < minBound[axis] || origin[axis] > maxBound[axis]) return false;
+            continue;
+        }
+        float inverse = 1 / direction[axis];
+        float nearTime = (minBound[axis] - origin[axis]) * inverse;
+        float farTime = (maxBound[axis] - origin[axis]) * inverse;
+        if (nearTime > farTime) std::swap(nearTime, farTime);
+        entry = std::max(entry, nearTime);
+        exit = std::min(exit, farTime);
+        if (entry > exit) return false;
+    }
+    return exit >= 0;
+}
+
+// First t in [0, 1] at which spheres offset by start + t * motion from each other are within radii, if any
+inline bool SweptSphereSphere(const glm::vec3& start, const glm::vec3& motion, float radii, float& time) {
+    float c = glm::dot(start, start) - radii * radii;
+    if (c <= 0) {
+        time = 0;
+        return true;
+    }
+    float a = glm::dot(motion, motion);
+    float b = glm::dot(start, motion);
+    // Not moving, or moving apart
+    if (a == 0 || b >= 0) return false;
+    float discriminant = b * b - a * c;
+    if (discriminant < 0) return false;
+    time = (-b - std::sqrt(discriminant)) / a;
+    return time <= 1;
+}
+
+// Whether a mesh touches a shape described somewhere else than where its collider stands
+inline bool MeshTouchesShape(MeshCollider* mesh, const SweptShape& shape) {
+    if (shape.shape == COLLIDER_BOX) return mesh->OverlapsBox(shape.center - shape.semiAxes, shape.center + shape.semiAxes);
+    return mesh->OverlapsEllipsoid(shape.center, shape.semiAxes);
+}
+
+// The mesh stays where it ended while the other shape moves relative to it. The shape is sampled along the part of the move
+// where it is within the mesh's bounds, in steps of about its smallest semi axis (at most CONTINUOUS_MAX_ITERATIONS of them),
+// and the first touching sample is refined by bisection. This approximates the exact sweep: a shape cannot pass through the
+// surface between two samples, but it can graze an edge or corner of the mesh only between them and be reported as missing it.
+// Two meshes are only tested where they stand.
+inline bool MeshTimeOfImpact(Collider* a, Collider* b, float& time) {
+    bool firstMesh = a->GetShape() == COLLIDER_MESH;
+    MeshCollider* mesh = static_cast<MeshCollider*>(firstMesh ? a : b);
+    Collider* other = firstMesh ? b : a;
+    if (other->GetShape() == COLLIDER_MESH) {
+        time = 1;
+        return a->CollidesWith(b);
+    }
+    SweptShape shape = DescribeSweptShape(other);
+    glm::vec3 motion = other->GetMotion() - mesh->GetMotion();
+    glm::vec3 start = shape.center - motion;
+    Bounds bounds = mesh->GetBounds();
+    float entry, exit;
+    if (!RayIntersectsBox(start, motion, bounds.GetMinBound() - shape.semiAxes, bounds.GetMaxBound() + shape.semiAxes, entry, exit) || entry > 1) return false;
+    float first = std::max(entry, 0.0f);
+    float last = std::min(exit, 1.0f);
+    float smallestAxis = std::min(shape.semiAxes.x, std::min(shape.semiAxes.y, shape.semiAxes.z));
+    float length = glm::length(motion) * (last - first);
+    int steps = smallestAxis > 0 && length < smallestAxis * CONTINUOUS_MAX_ITERATIONS ? std::max(1, (int)std::ceil(length / smallestAxis)) : CONTINUOUS_MAX_ITERATIONS;
+    float step = (last - first) / steps;
+    for (int i = 0; i <= steps; ++i) {
+        float t = i == steps ? last : first + step * i;
+        shape.center = start + motion * t;
+        if (!MeshTouchesShape(mesh, shape)) continue;
+        if (i == 0) {
+            time = t;
+            return true;
+        }
+        float low = t - step;
+        float high = t;
+        while (high - low > CONTINUOUS_TIME_TOLERANCE) {
+            float middle = (low + high) * 0.5f;
+            shape.center = start + motion * middle;
+            if (MeshTouchesShape(mesh, shape)) high = middle;
+            else low = middle;
+        }
+        time = high;
+        return true;
+    }
+    return false;
+}
+
+// Finds whether two colliders touched at some point of their last move, and the earliest fraction of it at which they did.
+// Colliders that did not move are tested where they stand, with a time of 1.
+inline bool TimeOfImpact(Collider* a, Collider* b, float& time) {
+    glm::vec3 motion = a->GetMotion() - b->GetMotion();
+    if (motion == glm::vec3(0)) {
+        time = 1;
+        return a->CollidesWith(b);
+    }
+    if (a->GetShape() == COLLIDER_MESH || b->GetShape() == COLLIDER_MESH) return MeshTimeOfImpact(a, b, time);
+    // Only the relative motion matters, so b stays where it started while a moves
+    SweptShape first = DescribeSweptShape(a);
+    SweptShape second = DescribeSweptShape(b);
+    first.center -= a->GetMotion();
+    second.center -= b->GetMotion();
+    if (first.shape == COLLIDER_SPHERE && second.shape == COLLIDER_SPHERE) {
+        return SweptSphereSphere(first.center - second.center, motion, first.semiAxes.x + second.semiAxes.x, time);
+    }
+
+    // The center of a enters the sum of both boxes no later than the shapes touch
+    float entry, exit;
+    glm::vec3 reach = first.semiAxes + second.semiAxes;
+    if (!RayIntersectsBox(first.center, motion, second.center - reach, second.center + reach, entry, exit) || entry > 1) return false;
+    float t = std::max(entry, 0.0f);
+    if (first.shape == COLLIDER_BOX && second.shape == COLLIDER_BOX) {
+        time = t;
+        return true;
+    }
+
+    // In the space scaled by the semi axes of a round shape, it is a unit sphere while boxes stay boxes and ellipsoids stay ellipsoids,
+    // so the distance between both shapes is exactly the distance from its center to the other one minus 1.
+    // Along a line that distance is convex in t, so a Newton step from before the contact never passes it.
+    bool firstRound = first.shape != COLLIDER_BOX;
+    const SweptShape& round = firstRound ? first : second;
+    const SweptShape& other = firstRound ? second : first;
+    glm::vec3 point = round.center / round.semiAxes;
+    glm::vec3 otherCenter = other.center / round.semiAxes;
+    glm::vec3 otherAxes = other.semiAxes / round.semiAxes;
+    glm::vec3 scaledMotion = (firstRound ? motion : -motion) / round.semiAxes;
+    float end = std::min(exit, 1.0f);
+    for (int i = 0; i < CONTINUOUS_MAX_ITERATIONS && t <= end; ++i) {
+        glm::vec3 position = point + scaledMotion * t;
+        glm::vec3 closest = other.shape == COLLIDER_BOX
+            ? glm::clamp(position, otherCenter - otherAxes, otherCenter + otherAxes)
+            : otherCenter + ClosestPointOnEllipsoid(position - otherCenter, otherAxes);
+        glm::vec3 away = position - closest;
+        float distance = glm::length(away) - 1;
+        if (distance <= 0) {
+            time = t;
+            return true;
+        }
+        // Once the distance stops shrinking it never shrinks again
+        float closing = -glm::dot(scaledMotion, away) / (distance + 1);
+        if (closing <= 0) return false;
+        float step = distance / closing;
+        if (step <= CONTINUOUS_TIME_TOLERANCE) {
+            time = std::min(t + step, 1.0f);
+            return t + step <= end;
+        }
+        t += step;
+    }
+    // Still closing in on a grazing contact when running out of iterations, so settle for where they ended up
+    if (t <= end) {
+        time = 1;
+        return a->CollidesWith(b);
+    }
+    return false;
+}
+
+// Exact test of a candidate pair, swept along their last move if either one is continuous
+inline bool CollidersTouch(Collider* a, Collider* b, float& time) {
+    if (a->IsContinuous() || b->IsContinuous()) return TimeOfImpact(a, b, time);
+    time = 1;
+    return a->CollidesWith(b);
+}
+
+#endif
@@ -3,24 +3,93 @@
 
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
+#include <stdint.h>
 
 #include "collider.hpp"
 #include "collision.hpp"
+#include "contacts.hpp"
+#include "spatialHash.hpp"
+#include "sweepAndPrune.hpp"
+#include "colliderBatch.hpp"
 #include "../gameObject.hpp"
+#include "../jobs.hpp"
 #include "../extensions/collectionUtils.hpp"
 
-bool ColliderComparer(Collider* c1, Collider* c2) {
-    return c1->GetBounds().GetMinBound().x < c2->GetBounds().GetMinBound().x;
-}
+// How a layer, or a collision world, finds candidate pairs before running the exact collider tests
+typedef int CollisionBroadphase;
+// Sort every collider by min X and sweep along it. Degrades when many colliders share an X range.
+const CollisionBroadphase BROADPHASE_SWEEP = 0;
+// Bucket colliders into a uniform grid and only test the ones sharing a cell
+const CollisionBroadphase BROADPHASE_GRID = 1;
+// Keep this layer and the ones it checks against in a persistent sweep and prune on all three axes,
+// which tracks overlapping pairs from frame to frame. Cheapest when things move a little every frame.
+const CollisionBroadphase BROADPHASE_PERSISTENT = 2;
+// Copy the enabled colliders into a ColliderBatch and test every collider checked against this layer with all of them,
+// four at a time. No broadphase at all, which is the cheapest for small layers such as a formation hit by a few bullets.
+// A collision world batches all of its colliders and tests each one with the ones after it.
+const CollisionBroadphase BROADPHASE_BATCH = 3;
+
+// Colliders each job of a parallel collision check goes through
+const size_t COLLISION_JOB_GRAIN = 64;
 
 class CollisionLayer {
 private:
     std::vector<CollisionLayer*> collisionable;
+    // Layers that check against this one, and so may hold contacts with its colliders
+    std::vector<CollisionLayer*> checkedBy;
     std::vector<Collider*> layerColliders;
+    CollisionBroadphase broadphase = BROADPHASE_GRID;
+    // Enabled colliders of this layer, rebuilt by CollisionPrep when using the grid
+    SpatialHashGrid<Collider> grid;
+    // Enabled colliders of this layer, copied by CollisionPrep when batching
+    ColliderBatch batch;
+    // Min X of every collider, in the same order, while sweeping
+    std::vector<float> sweepKeys;
+    // Widest collider along X, which bounds how far back a sweep has to start
+    float sweepWidth = 0;
+
+    // Persistent broadphase state. Our colliders pair with the ones of the other layers, never among themselves.
+    static const uint32_t OWN_GROUP = 1;
+    static const uint32_t OTHER_GROUP = 2;
+    struct ProxyEntry {
+        SweepAndPrune<Collider>::Handle handle;
+        uint32_t group;
+        // Last sync that found the collider enabled
+        uint32_t stamp;
+    };
+    SweepAndPrune<Collider> sweepAndPrune;
+    std::unordered_map<Collider*, ProxyEntry> proxies;
+    uint32_t syncStamp = 0;
+
+    // Pairs touching on the previous check, and the events of the last one
+    ContactCache contacts;
+
+    // Collision found by CheckCollisions, waiting to be reported
+    struct FoundPair {
+        // Time of impact for continuous colliders, 1 otherwise
+        float time;
+        uint64_t order;
+        Collider* col;
+        Collider* other;
+    };
+    // Finds the pairs against one of the layers we check against, over a range of the colliders it iterates
+    typedef void (CollisionLayer::*PairFinder)(size_t layer, size_t begin, size_t end, std::vector<FoundPair>& out);
+    std::vector<FoundPair> foundPairs;
+    // Pairs found by every chunk of a parallel check, kept between checks to reuse their memory
+    std::vector<std::vector<FoundPair>> chunkPairs;
+
+    // Colliders added or removed by collision callbacks wait here until the check is over
+    bool checking = false;
+    std::vector<Collider*> pendingAdd;
+    std::vector<Collider*> pendingRemove;
 
     ObjEventHandler<CollisionLayer, Component*> OnColliderDestroyedHandler;
     static void OnColliderDestroyedCallback(CollisionLayer* layer, Component* c) {
-        layer->RemoveCollider(static_cast<Collider*>(c));
+        Collider* collider = static_cast<Collider*>(c);
+        layer->RemoveCollider(collider);
+        layer->contacts.Forget(collider);
+        for (CollisionLayer* checker : layer->checkedBy) checker->contacts.Forget(collider);
     }    
 public:
     CollisionLayer() {
@@ -28,64 +97,314 @@ public:
     }
     CollisionLayer* CollidesWith(CollisionLayer* other) {
         collisionable.push_back(other);
+        other->checkedBy.push_back(this);
         return this;
     }
     CollisionLayer* AddCollider(Collider* collider) {
-        layerColliders.push_back(collider);
         collider->OnDestroyed.AddListener(&OnColliderDestroyedHandler);
+        if (checking) pendingAdd.push_back(collider);
+        else layerColliders.push_back(collider);
         return this;
     }
     CollisionLayer* RemoveCollider(Collider* collider) {
-        Remove(layerColliders, collider);
+        if (checking) pendingRemove.push_back(collider);
+        else Remove(layerColliders, collider);
+        return this;
     }
+    CollisionLayer* SetBroadphase(CollisionBroadphase broadphase) {
+        this->broadphase = broadphase;
+        return this;
+    }
+    CollisionBroadphase GetBroadphase() const {
+        return broadphase;
+    }
+    // Edge length of the grid cells. Around the size of the layer's typical collider works best.
+    CollisionLayer* SetCellSize(float cellSize) {
+        grid.SetCellSize(cellSize);
+        return this;
+    }
+    const std::vector<Collider*>& GetColliders() const {
+        return layerColliders;
+    }
+
+    // Brings every collider up to date with its transform, then prepares the broadphase with their swept bounds:
+    // sorts them along the X axis for the sweep, or buckets the enabled ones into the grid.
+    // The persistent broadphase is updated by CheckCollisions, once every layer is prepared. Its layers, and batched ones,
+    // are still kept sorted along X (nearly free from frame to frame), so sweeping layers can check against them.
     void CollisionPrep() {
-        if (layerColliders.size() < 2) return;
-        std::sort(layerColliders.begin(), layerColliders.end(), ColliderComparer);
-    }
-    vector<Collision> CheckCollisions() {
-        if (collisionable.size() == 0 || layerColliders.size() == 0) return {};
-        for (CollisionLayer* otherLayer : collisionable) {
-            if (otherLayer->layerColliders.size() == 0) continue;
-            // Traverse through own colliders in axis order
-            int leftIdx = 0;
-            for (Collider* col : layerColliders) {
-                if (!col->IsEnabled() || !col->GetGameObject()->IsEnabled()) continue;
-                
-                /* FASTER ALGORITHM BELOW, requires sorted bounds */
-                float boundMin = col->GetBounds().GetMinBound().x; 
-                float boundMax = col->GetBounds().GetMaxBound().x; 
-                
-                // Advance the leftIdx pointer up to the feasible range.
-                while (leftIdx < otherLayer->layerColliders.size()) {
-                    Collider* other = otherLayer->layerColliders.at(leftIdx);
-                    if (!other->IsEnabled() || 
-                        !other->GetGameObject()->IsEnabled() || 
-                        other->GetBounds().GetMaxBound().x < boundMin) {
-                        leftIdx++;
-                        continue;
-                    } else {
-                        break;
-                    }
+        for (Collider* collider : layerColliders) {
+            collider->SyncWithTransform();
+            if (collider->IsContinuous()) collider->AdvanceSweep(IsActive(collider));
+        }
+        if (broadphase == BROADPHASE_GRID) {
+            grid.Clear();
+            for (Collider* collider : layerColliders) {
+                if (!collider->IsEnabled() || !collider->GetGameObject()->IsEnabled()) continue;
+                grid.Insert(collider, collider->GetSweptBounds());
+            }
+            grid.Build();
+            return;
+        }
+        if (broadphase == BROADPHASE_BATCH) {
+            batch.Clear();
+            for (Collider* collider : layerColliders) {
+                if (collider->IsEnabled() && collider->GetGameObject()->IsEnabled()) batch.Add(collider);
+            }
+            batch.Build();
+        }
+        SortAlongX();
+    }
+    // The colliders are still sorted from the previous frame, so an insertion sort on cached keys
+    // only does work for the ones that moved past each other
+    void SortAlongX() {
+        sweepKeys.resize(layerColliders.size());
+        sweepWidth = 0;
+        for (size_t i = 0; i < layerColliders.size(); ++i) {
+            Bounds bounds = layerColliders[i]->GetSweptBounds();
+            sweepKeys[i] = bounds.GetMinBound().x;
+            sweepWidth = std::max(sweepWidth, bounds.GetMaxBound().x - sweepKeys[i]);
+        }
+        for (size_t i = 1; i < layerColliders.size(); ++i) {
+            float key = sweepKeys[i];
+            Collider* collider = layerColliders[i];
+            size_t j = i;
+            for (; j > 0 && sweepKeys[j - 1] > key; --j) {
+                sweepKeys[j] = sweepKeys[j - 1];
+                layerColliders[j] = layerColliders[j - 1];
+            }
+            sweepKeys[j] = key;
+            layerColliders[j] = collider;
+        }
+    }
+    // Finds every collision between this layer and the ones it checks against, turns them into contact events, then dispatches them.
+    // Finding only reads the colliders, so with a job system it is split into chunks run across threads, each with its own
+    // list of pairs. The pairs are then sorted into an order that does not depend on the chunks.
+    // No callback runs before detection is over: the events are queued into one buffer, then dispatched in order on the calling thread.
+    // Returns that buffer, valid until the next check.
+    const std::vector<ContactEvent>& CheckCollisions(JobSystem* jobs = nullptr) {
+        foundPairs.clear();
+        if (broadphase == BROADPHASE_PERSISTENT) {
+            SyncSweepAndPrune();
+            FindInParallel(jobs, 0, sweepAndPrune.GetPairs().size(), &CollisionLayer::FindPersistent);
+        } else if (layerColliders.size() != 0) {
+            for (size_t layer = 0; layer < collisionable.size(); ++layer) {
+                CollisionLayer* otherLayer = collisionable[layer];
+                // The sweep needs both layers sorted, otherwise one of them has a grid or a batch to look up
+                if (otherLayer->broadphase == BROADPHASE_BATCH) FindInParallel(jobs, layer, layerColliders.size(), &CollisionLayer::FindAgainstBatch);
+                else if (otherLayer->broadphase == BROADPHASE_GRID) FindInParallel(jobs, layer, layerColliders.size(), &CollisionLayer::FindAgainstGrid);
+                else if (broadphase == BROADPHASE_GRID) FindInParallel(jobs, layer, otherLayer->layerColliders.size(), &CollisionLayer::FindGridAgainst);
+                else FindInParallel(jobs, layer, layerColliders.size(), &CollisionLayer::FindAgainstSweep);
+            }
+        }
+        // Earliest impacts first, so a projectile that went through several colliders in one step reports the first one it hit first
+        std::stable_sort(foundPairs.begin(), foundPairs.end(), [](const FoundPair& a, const FoundPair& b) {
+            return a.time < b.time || (a.time == b.time && a.order < b.order);
+        });
+
+        contacts.Begin();
+        for (const FoundPair& pair : foundPairs) contacts.Touch(pair.col, pair.other, pair.time);
+        contacts.End();
+
+        // Callbacks may spawn or destroy colliders on this layer or the ones it checks against
+        SetChecking(true);
+        for (CollisionLayer* otherLayer : collisionable) otherLayer->SetChecking(true);
+        contacts.Dispatch();
+        for (CollisionLayer* otherLayer : collisionable) otherLayer->SetChecking(false);
+        SetChecking(false);
+        return contacts.GetEvents();
+    }
+
+    static bool IsActive(Collider* collider) {
+        return collider->IsActive();
+    }
+    // Pairs sort by the layer they were found against, then by the collider whose lookup found them
+    static uint64_t PairOrder(size_t layer, size_t driver) {
+        return ((uint64_t)layer << 40) | driver;
+    }
+
+    // Runs finder over [0, count) of whatever it iterates, in chunks spread over the job system if there is one,
+    // and gathers what every chunk found into foundPairs
+    void FindInParallel(JobSystem* jobs, size_t layer, size_t count, PairFinder finder) {
+        size_t chunks = jobs == nullptr ? 1 : std::min(JobSystem::MAX_PARALLEL_CHUNKS, (count + COLLISION_JOB_GRAIN - 1) / COLLISION_JOB_GRAIN);
+        if (chunks <= 1) {
+            (this->*finder)(layer, 0, count, foundPairs);
+            return;
+        }
+        if (chunkPairs.size() < chunks) chunkPairs.resize(chunks);
+        size_t chunkSize = (count + chunks - 1) / chunks;
+        jobs->ParallelFor(chunks, 1, [&](size_t first, size_t last) {
+            for (size_t chunk = first; chunk < last; ++chunk) {
+                chunkPairs[chunk].clear();
+                (this->*finder)(layer, std::min(count, chunk * chunkSize), std::min(count, (chunk + 1) * chunkSize), chunkPairs[chunk]);
+            }
+        });
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            foundPairs.insert(foundPairs.end(), chunkPairs[chunk].begin(), chunkPairs[chunk].end());
+        }
+    }
+
+    // Tests each of our colliders against the other layer's whole batch, which runs the exact tests itself.
+    // Continuous colliders only use it to find candidates, with the batch as it stands at the end of the move.
+    void FindAgainstBatch(size_t layer, size_t begin, size_t end, std::vector<FoundPair>& out) {
+        const ColliderBatch& otherBatch = collisionable[layer]->batch;
+        if (otherBatch.Size() == 0) return;
+        for (size_t i = begin; i < end; ++i) {
+            Collider* col = layerColliders[i];
+            if (!IsActive(col)) continue;
+            uint64_t order = PairOrder(layer, i);
+            if (col->IsContinuous()) {
+                otherBatch.QueryBounds(col->GetSweptBounds(), ~0u, [&](Collider* other) {
+                    float time;
+                    if (other != col && TimeOfImpact(col, other, time)) out.push_back({time, order, col, other});
+                });
+                continue;
+            }
+            otherBatch.Query(col, [&](Collider* other) {
+                out.push_back({1, order, col, other});
+            });
+        }
+    }
+
+    // Looks up each of our colliders in the other layer's grid
+    void FindAgainstGrid(size_t layer, size_t begin, size_t end, std::vector<FoundPair>& out) {
+        const SpatialHashGrid<Collider>& otherGrid = collisionable[layer]->grid;
+        if (otherGrid.Size() == 0) return;
+        for (size_t i = begin; i < end; ++i) {
+            Collider* col = layerColliders[i];
+            if (!IsActive(col)) continue;
+            uint64_t order = PairOrder(layer, i);
+            otherGrid.Query(col->GetSweptBounds(), [&](Collider* other) {
+                float time;
+                if (other != col && CollidersTouch(col, other, time)) out.push_back({time, order, col, other});
+            });
+        }
+    }
+
+    // Looks up each of the other layer's colliders in our grid
+    void FindGridAgainst(size_t layer, size_t begin, size_t end, std::vector<FoundPair>& out) {
+        if (grid.Size() == 0) return;
+        const std::vector<Collider*>& others = collisionable[layer]->layerColliders;
+        for (size_t i = begin; i < end; ++i) {
+            Collider* other = others[i];
+            if (!IsActive(other)) continue;
+            uint64_t order = PairOrder(layer, i);
+            grid.Query(other->GetSweptBounds(), [&](Collider* col) {
+                float time;
+                if (other != col && CollidersTouch(col, other, time)) out.push_back({time, order, col, other});
+            });
+        }
+    }
+
+    // Mirrors the enabled colliders of this layer and of the ones it checks against into the sweep and prune,
+    // dropping the colliders that were disabled or removed since the last check
+    void SyncSweepAndPrune() {
+        syncStamp++;
+        SyncProxies(layerColliders, OWN_GROUP);
+        for (CollisionLayer* otherLayer : collisionable) SyncProxies(otherLayer->layerColliders, OTHER_GROUP);
+        for (auto it = proxies.begin(); it != proxies.end();) {
+            if (it->second.stamp == syncStamp) {
+                ++it;
+                continue;
+            }
+            sweepAndPrune.Remove(it->second.handle);
+            it = proxies.erase(it);
+        }
+        sweepAndPrune.Update();
+    }
+    void SyncProxies(const std::vector<Collider*>& colliders, uint32_t group) {
+        uint32_t mask = group == OWN_GROUP ? OTHER_GROUP : OWN_GROUP;
+        for (Collider* collider : colliders) {
+            if (!collider->IsEnabled() || !collider->GetGameObject()->IsEnabled()) continue;
+            auto found = proxies.find(collider);
+            if (found == proxies.end()) {
+                proxies[collider] = {sweepAndPrune.Add(collider, collider->GetSweptBounds(), group, mask), group, syncStamp};
+                continue;
+            }
+            ProxyEntry& entry = found->second;
+            if (entry.stamp == syncStamp) continue;
+            entry.stamp = syncStamp;
+            if (entry.group == group) {
+                sweepAndPrune.Move(entry.handle, collider->GetSweptBounds());
+                continue;
+            }
+            // A new collider where a destroyed one from another layer used to live
+            sweepAndPrune.Remove(entry.handle);
+            entry = {sweepAndPrune.Add(collider, collider->GetSweptBounds(), group, mask), group, syncStamp};
+        }
+    }
+    // Runs the exact tests on the pairs the sweep and prune found overlapping
+    void FindPersistent(size_t, size_t begin, size_t end, std::vector<FoundPair>& out) {
+        const std::vector<SweepAndPrune<Collider>::Pair>& pairs = sweepAndPrune.GetPairs();
+        for (size_t i = begin; i < end; ++i) {
+            // Our colliders have the lower group, so they come first
+            Collider* col = sweepAndPrune.GetValue(pairs[i].first);
+            Collider* other = sweepAndPrune.GetValue(pairs[i].second);
+            float time;
+            if (CollidersTouch(col, other, time)) out.push_back({time, PairOrder(0, i), col, other});
+        }
+    }
+
+    // Sweeps both layers along X. Requires them to be sorted by CollisionPrep.
+    void FindAgainstSweep(size_t layer, size_t begin, size_t end, std::vector<FoundPair>& out) {
+        const CollisionLayer* otherLayer = collisionable[layer];
+        const std::vector<Collider*>& others = otherLayer->layerColliders;
+        if (others.size() == 0 || begin == end) return;
+        // Every chunk starts its own sweep. Colliders with a min X further back than the widest one of their layer
+        // cannot reach the first of our colliders, so they are skipped at once.
+        const std::vector<float>& otherKeys = otherLayer->sweepKeys;
+        float reach = layerColliders[begin]->GetSweptBounds().GetMinBound().x - otherLayer->sweepWidth;
+        auto sortedEnd = otherKeys.begin() + std::min(otherKeys.size(), others.size());
+        // Traverse through own colliders in axis order
+        size_t leftIdx = std::lower_bound(otherKeys.begin(), sortedEnd, reach) - otherKeys.begin();
+        for (size_t i = begin; i < end; ++i) {
+            Collider* col = layerColliders[i];
+            if (!IsActive(col)) continue;
+            
+            /* FASTER ALGORITHM BELOW, requires sorted bounds */
+            Bounds bounds = col->GetSweptBounds();
+            float boundMin = bounds.GetMinBound().x; 
+            float boundMax = bounds.GetMaxBound().x; 
+            
+            // Advance the leftIdx pointer up to the feasible range.
+            while (leftIdx < others.size()) {
+                Collider* other = others[leftIdx];
+                if (!IsActive(other) || other->GetSweptBounds().GetMaxBound().x < boundMin) {
+                    leftIdx++;
+                    continue;
+                } else {
+                    break;
+                }
+            }
+            // Check all colliders until they can't collide with the current collider
+            for (size_t j = leftIdx; j < others.size(); ++j) {
+                Collider* other = others[j];
+                if (other->GetSweptBounds().GetMinBound().x > boundMax) {
+                    // No more colliders from the other layer can collide with this one
+                    break;
                 }
-                // Check all colliders until they can't collide with the current collider
-                for (int i = leftIdx; i < otherLayer->layerColliders.size(); ++i) {
-                    Collider* other = otherLayer->layerColliders.at(i);
-                    if (other->GetBounds().GetMinBound().x > boundMax) {
-                        // No more colliders from the other layer can collide with this one
-                        break;
-                    }
-                    if (!other->IsEnabled() || !other->GetGameObject()->IsEnabled()) {
-                        continue;
-                    }
-                    // Standard case!
-                    if (col->CollidesWith(other)) {
-                        col->OnCollisionEnter.Invoke(col, other);
-                        other->OnCollisionEnter.Invoke(other, col);
-                        std::cout << col->GetGameObject()->objectName << " (" << col->GetBounds().ToString() << ") collided with " << other->GetGameObject()->objectName << " (" << other->GetBounds().ToString() << ")" << std::endl;
-                    }
+                if (!IsActive(other)) {
+                    continue;
                 }
-            } 
+                // Standard case!
+                float time;
+                if (CollidersTouch(col, other, time)) out.push_back({time, PairOrder(layer, i), col, other});
+            }
+        } 
+    }
+
+    // While checking, membership changes are queued. They are applied once checking ends.
+    void SetChecking(bool checking) {
+        this->checking = checking;
+        if (checking) return;
+        for (Collider* collider : pendingRemove) {
+            Remove(layerColliders, collider);
+            Remove(pendingAdd, collider);
+        }
+        for (Collider* collider : pendingAdd) {
+            layerColliders.push_back(collider);
         }
+        pendingAdd.clear();
+        pendingRemove.clear();
     }
 
 };
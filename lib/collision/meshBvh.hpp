@@ -0,0 +1,476 @@
+#ifndef MESH_BVH_HPP
+#define MESH_BVH_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <stdint.h>
+
+#include "../geometry/mesh.hpp"
+#include "bounds.hpp"
+
+// ##################
+// # TRIANGLE TESTS #
+// ##################
+// Exact tests against a single triangle, for the mesh colliders. Touching counts as overlapping.
+
+// Closest point of the triangle abc to p, by the Voronoi region of the triangle p falls in
+inline glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0) return a;
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3) return b;
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6) return c;
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    float denominator = 1 / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+// Finds whether the ray origin + t * direction crosses the triangle abc for some t in [0, maxDistance], from either side.
+// Rays in the plane of the triangle never cross it.
+inline bool RayIntersectsTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float maxDistance, float& distance) {
+    glm::vec3 edge1 = b - a;
+    glm::vec3 edge2 = c - a;
+    glm::vec3 p = glm::cross(direction, edge2);
+    float determinant = glm::dot(edge1, p);
+    if (determinant == 0) return false;
+    float inverse = 1 / determinant;
+    glm::vec3 s = origin - a;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0 || u > 1) return false;
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = glm::dot(direction, q) * inverse;
+    if (v < 0 || u + v > 1) return false;
+    float t = glm::dot(edge2, q) * inverse;
+    if (t < 0 || t > maxDistance) return false;
+    distance = t;
+    return true;
+}
+
+// Whether the projections of both point sets on the axis overlap
+inline bool OverlapOnAxis(const glm::vec3& axis, const glm::vec3* first, int firstCount, const glm::vec3* second, int secondCount) {
+    float firstMin = INFINITY, firstMax = -INFINITY, secondMin = INFINITY, secondMax = -INFINITY;
+    for (int i = 0; i < firstCount; ++i) {
+        float projection = glm::dot(axis, first[i]);
+        firstMin = std::min(firstMin, projection);
+        firstMax = std::max(firstMax, projection);
+    }
+    for (int i = 0; i < secondCount; ++i) {
+        float projection = glm::dot(axis, second[i]);
+        secondMin = std::min(secondMin, projection);
+        secondMax = std::max(secondMax, projection);
+    }
+    return firstMin <= secondMax && secondMin <= firstMax;
+}
+
+// Separating axis test of the triangle abc against an axis aligned box: the box faces, the triangle's plane,
+// and every cross product of a box axis with a triangle edge
+inline bool TriangleOverlapsBox(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& minBound, const glm::vec3& maxBound) {
+    glm::vec3 center = (minBound + maxBound) * 0.5f;
+    glm::vec3 extent = (maxBound - minBound) * 0.5f;
+    glm::vec3 vertices[3] = {a - center, b - center, c - center};
+    for (int axis = 0; axis < 3; ++axis) {
+        float low = std::min(vertices[0][axis], std::min(vertices[1][axis], vertices[2][axis]));
+        float high = std::max(vertices[0][axis], std::max(vertices[1][axis], vertices[2][axis]));
+        if (low > extent[axis] || high < -extent[axis]) return false;
+    }
+    glm::vec3 edges[3] = {vertices[1] - vertices[0], vertices[2] - vertices[1], vertices[0] - vertices[2]};
+    glm::vec3 normal = glm::cross(edges[0], edges[1]);
+    if (std::abs(glm::dot(normal, vertices[0])) > glm::dot(extent, glm::abs(normal))) return false;
+    for (int axis = 0; axis < 3; ++axis) {
+        glm::vec3 boxAxis(0);
+        boxAxis[axis] = 1;
+        for (const glm::vec3& edge : edges) {
+            glm::vec3 separating = glm::cross(boxAxis, edge);
+            float radius = glm::dot(extent, glm::abs(separating));
+            float p0 = glm::dot(separating, vertices[0]);
+            float p1 = glm::dot(separating, vertices[1]);
+            float p2 = glm::dot(separating, vertices[2]);
+            if (std::min(p0, std::min(p1, p2)) > radius || std::max(p0, std::max(p1, p2)) < -radius) return false;
+        }
+    }
+    return true;
+}
+
+// Separating axis test of two triangles: both normals, the cross products of their edges,
+// and the in plane normals of every edge, which separate coplanar triangles
+inline bool TrianglesOverlap(const glm::vec3* first, const glm::vec3* second) {
+    glm::vec3 firstEdges[3] = {first[1] - first[0], first[2] - first[1], first[0] - first[2]};
+    glm::vec3 secondEdges[3] = {second[1] - second[0], second[2] - second[1], second[0] - second[2]};
+    glm::vec3 firstNormal = glm::cross(firstEdges[0], firstEdges[1]);
+    glm::vec3 secondNormal = glm::cross(secondEdges[0], secondEdges[1]);
+    if (!OverlapOnAxis(firstNormal, first, 3, second, 3) || !OverlapOnAxis(secondNormal, first, 3, second, 3)) return false;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            if (!OverlapOnAxis(glm::cross(firstEdges[i], secondEdges[j]), first, 3, second, 3)) return false;
+        }
+        if (!OverlapOnAxis(glm::cross(firstNormal, firstEdges[i]), first, 3, second, 3)) return false;
+        if (!OverlapOnAxis(glm::cross(secondNormal, secondEdges[i]), first, 3, second, 3)) return false;
+    }
+    return true;
+}
+
+// ############
+// # MESH BVH #
+// ############
+// Static bounding volume hierarchy over the triangles of a mesh, in the mesh's own space. Built once per mesh and shared
+// by every collider placed with it. Nodes are 32 bytes, stored depth first in a single array: the first child of a node
+// directly follows it and the node keeps the index of its second one. Leaves keep a range of the triangles, which are
+// copied out of the mesh in leaf order, so a leaf reads its triangles from one contiguous block.
+// Splits are picked by the surface area heuristic, over the triangle centroids binned along each axis.
+
+struct MeshBvhNode {
+    glm::vec3 minBound;
+    // Leaves: first triangle. Inner nodes: second child.
+    uint32_t index;
+    glm::vec3 maxBound;
+    // 0 for inner nodes
+    uint32_t triangleCount;
+
+    bool IsLeaf() const {
+        return triangleCount != 0;
+    }
+};
+static_assert(sizeof(MeshBvhNode) == 32, "Mesh BVH nodes are laid out to fill half a cache line");
+
+struct MeshBvhTriangle {
+    glm::vec3 vertices[3];
+};
+
+const int MESH_BVH_BINS = 16;
+const uint32_t MESH_BVH_MAX_LEAF_TRIANGLES = 4;
+// Cost of visiting a node relative to testing a triangle
+const float MESH_BVH_TRAVERSAL_COST = 1;
+// Deeper nodes become leaves whatever their size, which bounds the traversal stacks
+const int MESH_BVH_MAX_DEPTH = 60;
+const int MESH_BVH_STACK_SIZE = 64;
+// A traversal holds at most one pending sibling per level, plus both children of the deepest inner node
+static_assert(MESH_BVH_STACK_SIZE >= MESH_BVH_MAX_DEPTH + 1, "Mesh BVH traversal stacks must hold a path of the deepest tree");
+
+class MeshBvh {
+private:
+    std::vector<MeshBvhNode> nodes;
+    std::vector<MeshBvhTriangle> triangles;
+
+    // Triangle being sorted into the tree
+    struct BuildItem {
+        glm::vec3 minBound;
+        glm::vec3 maxBound;
+        glm::vec3 centroid;
+        uint32_t triangle;
+    };
+    struct Bin {
+        glm::vec3 minBound = glm::vec3(INFINITY);
+        glm::vec3 maxBound = glm::vec3(-INFINITY);
+        uint32_t count = 0;
+    };
+
+    static float SurfaceArea(const glm::vec3& minBound, const glm::vec3& maxBound) {
+        glm::vec3 size = glm::max(maxBound - minBound, glm::vec3(0));
+        return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    void BuildNode(std::vector<BuildItem>& items, uint32_t begin, uint32_t end, int depth) {
+        uint32_t index = nodes.size();
+        nodes.emplace_back();
+        glm::vec3 minBound(INFINITY), maxBound(-INFINITY), minCentroid(INFINITY), maxCentroid(-INFINITY);
+        for (uint32_t i = begin; i < end; ++i) {
+            minBound = glm::min(minBound, items[i].minBound);
+            maxBound = glm::max(maxBound, items[i].maxBound);
+            minCentroid = glm::min(minCentroid, items[i].centroid);
+            maxCentroid = glm::max(maxCentroid, items[i].centroid);
+        }
+        nodes[index].minBound = minBound;
+        nodes[index].maxBound = maxBound;
+        uint32_t count = end - begin;
+
+        // Cheapest split between two bins, on any axis
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = INFINITY;
+        for (int axis = 0; axis < 3 && count > 1; ++axis) {
+            float extent = maxCentroid[axis] - minCentroid[axis];
+            if (extent <= 0) continue;
+            Bin bins[MESH_BVH_BINS];
+            float binScale = MESH_BVH_BINS / extent;
+            for (uint32_t i = begin; i < end; ++i) {
+                Bin& bin = bins[std::min(MESH_BVH_BINS - 1, (int)((items[i].centroid[axis] - minCentroid[axis]) * binScale))];
+                bin.minBound = glm::min(bin.minBound, items[i].minBound);
+                bin.maxBound = glm::max(bin.maxBound, items[i].maxBound);
+                bin.count++;
+            }
+            // Cost of everything left of each split, then added to the cost of everything right of it
+            float leftCosts[MESH_BVH_BINS - 1];
+            Bin left;
+            for (int split = 0; split < MESH_BVH_BINS - 1; ++split) {
+                left.minBound = glm::min(left.minBound, bins[split].minBound);
+                left.maxBound = glm::max(left.maxBound, bins[split].maxBound);
+                left.count += bins[split].count;
+                leftCosts[split] = left.count * SurfaceArea(left.minBound, left.maxBound);
+            }
+            Bin right;
+            for (int split = MESH_BVH_BINS - 2; split >= 0; --split) {
+                right.minBound = glm::min(right.minBound, bins[split + 1].minBound);
+                right.maxBound = glm::max(right.maxBound, bins[split + 1].maxBound);
+                right.count += bins[split + 1].count;
+                float cost = leftCosts[split] + right.count * SurfaceArea(right.minBound, right.maxBound);
+                if (right.count > 0 && right.count < count && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        float area = SurfaceArea(minBound, maxBound);
+        bool splitPays = bestAxis >= 0 && MESH_BVH_TRAVERSAL_COST * area + bestCost < count * area;
+        if (count <= 1 || depth >= MESH_BVH_MAX_DEPTH || (count <= MESH_BVH_MAX_LEAF_TRIANGLES && !splitPays)) {
+            nodes[index].index = begin;
+            nodes[index].triangleCount = count;
+            return;
+        }
+        uint32_t middle;
+        if (bestAxis >= 0) {
+            float binScale = MESH_BVH_BINS / (maxCentroid[bestAxis] - minCentroid[bestAxis]);
+            middle = std::partition(items.begin() + begin, items.begin() + end, [&](const BuildItem& item) {
+                return std::min(MESH_BVH_BINS - 1, (int)((item.centroid[bestAxis] - minCentroid[bestAxis]) * binScale)) <= bestSplit;
+            }) - items.begin();
+        } else {
+            // Every centroid in the same place, so any halves are as good as the others
+            middle = begin + count / 2;
+        }
+        BuildNode(items, begin, middle, depth + 1);
+        nodes[index].index = nodes.size();
+        nodes[index].triangleCount = 0;
+        BuildNode(items, middle, end, depth + 1);
+    }
+
+    // Slab test against the inverse of the ray direction, where zero components were nudged to tiny ones
+    static bool RayEntersBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const MeshBvhNode& node, float maxDistance, float& entry) {
+        glm::vec3 near = (node.minBound - origin) * inverseDirection;
+        glm::vec3 far = (node.maxBound - origin) * inverseDirection;
+        glm::vec3 low = glm::min(near, far);
+        glm::vec3 high = glm::max(near, far);
+        entry = std::max(std::max(low.x, low.y), std::max(low.z, 0.0f));
+        float exit = std::min(std::min(high.x, high.y), std::min(high.z, maxDistance));
+        return entry <= exit;
+    }
+    static glm::vec3 InverseDirection(const glm::vec3& direction) {
+        glm::vec3 result;
+        for (int axis = 0; axis < 3; ++axis) {
+            result[axis] = 1 / (direction[axis] != 0 ? direction[axis] : 1e-30f);
+        }
+        return result;
+    }
+public:
+    // Builds the hierarchy over the triangles given by every three indices into positions
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices) {
+        nodes.clear();
+        triangles.clear();
+        std::vector<BuildItem> items(indices.size() / 3);
+        for (size_t i = 0; i < items.size(); ++i) {
+            BuildItem& item = items[i];
+            item.triangle = i;
+            item.minBound = glm::vec3(INFINITY);
+            item.maxBound = glm::vec3(-INFINITY);
+            for (int k = 0; k < 3; ++k) {
+                const glm::vec3& position = positions.at(indices[i * 3 + k]);
+                item.minBound = glm::min(item.minBound, position);
+                item.maxBound = glm::max(item.maxBound, position);
+            }
+            item.centroid = (item.minBound + item.maxBound) * 0.5f;
+        }
+        if (items.empty()) return;
+        nodes.reserve(items.size() * 2);
+        BuildNode(items, 0, items.size(), 0);
+        nodes.shrink_to_fit();
+        triangles.resize(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            for (int k = 0; k < 3; ++k) {
+                triangles[i].vertices[k] = positions[indices[items[i].triangle * 3 + k]];
+            }
+        }
+    }
+    void Build(const RefMesh& mesh) {
+        std::vector<glm::vec3> positions;
+        for (const VertexData& data : mesh.GetData()) positions.push_back(data.pos);
+        std::vector<GLuint> elements = mesh.GetElementArrayBuffer();
+        Build(positions, std::vector<uint32_t>(elements.begin(), elements.end()));
+    }
+    // Takes over a hierarchy built earlier, such as one read back from an asset pack.
+    // Throws invalid_argument, keeping the current hierarchy, unless the nodes form a tree Build could have made.
+    void Assign(const MeshBvhNode* nodes, size_t nodeCount, const MeshBvhTriangle* triangles, size_t triangleCount) {
+        if (!IsWellFormed(nodes, nodeCount, triangleCount)) throw std::invalid_argument("Mesh BVH nodes do not form a tree over the triangles they were given");
+        this->nodes.assign(nodes, nodes + nodeCount);
+        this->triangles.assign(triangles, triangles + triangleCount);
+    }
+    // Whether the nodes are laid out like Build lays them out, so traversals stay within the triangles and their stacks.
+    // Every node is reached exactly once from the root, children come after their parent, and no node is deeper than MESH_BVH_MAX_DEPTH.
+    static bool IsWellFormed(const MeshBvhNode* nodes, size_t nodeCount, size_t triangleCount) {
+        if (nodeCount == 0) return triangleCount == 0;
+        std::vector<bool> reached(nodeCount, false);
+        std::vector<std::pair<uint32_t, int>> stack = {{0, 0}};
+        while (!stack.empty()) {
+            std::pair<uint32_t, int> top = stack.back();
+            stack.pop_back();
+            if (reached[top.first] || top.second > MESH_BVH_MAX_DEPTH) return false;
+            reached[top.first] = true;
+            const MeshBvhNode& node = nodes[top.first];
+            if (node.IsLeaf()) {
+                if ((uint64_t)node.index + node.triangleCount > triangleCount) return false;
+                continue;
+            }
+            uint32_t first = top.first + 1;
+            if (first >= nodeCount || node.index <= first || node.index >= nodeCount) return false;
+            stack.push_back({first, top.second + 1});
+            stack.push_back({node.index, top.second + 1});
+        }
+        return true;
+    }
+
+    const std::vector<MeshBvhNode>& GetNodes() const {
+        return nodes;
+    }
+    const std::vector<MeshBvhTriangle>& GetTriangles() const {
+        return triangles;
+    }
+    bool Empty() const {
+        return nodes.empty();
+    }
+    // Bounds of the whole mesh
+    Bounds GetBounds() const {
+        if (nodes.empty()) return Bounds();
+        return Bounds(nodes[0].minBound, nodes[0].maxBound);
+    }
+    // Levels below the root, 0 for a single leaf
+    int GetDepth() const {
+        int depth = 0;
+        std::vector<std::pair<uint32_t, int>> stack;
+        if (!nodes.empty()) stack.push_back({0, 0});
+        while (!stack.empty()) {
+            std::pair<uint32_t, int> top = stack.back();
+            stack.pop_back();
+            depth = std::max(depth, top.second);
+            if (nodes[top.first].IsLeaf()) continue;
+            stack.push_back({top.first + 1, top.second + 1});
+            stack.push_back({nodes[top.first].index, top.second + 1});
+        }
+        return depth;
+    }
+
+    // Visits every node nodeTest(minBound, maxBound) accepts, and calls triangleTest(triangle) on the triangles of accepted leaves.
+    // Stops as soon as triangleTest returns true, and returns whether it did.
+    template <typename NodeTest, typename TriangleTest>
+    bool Traverse(NodeTest nodeTest, TriangleTest triangleTest) const {
+        if (nodes.empty()) return false;
+        uint32_t stack[MESH_BVH_STACK_SIZE];
+        int size = 0;
+        stack[size++] = 0;
+        while (size > 0) {
+            uint32_t index = stack[--size];
+            const MeshBvhNode& node = nodes[index];
+            if (!nodeTest(node.minBound, node.maxBound)) continue;
+            if (node.IsLeaf()) {
+                for (uint32_t i = node.index; i < node.index + node.triangleCount; ++i) {
+                    if (triangleTest(triangles[i])) return true;
+                }
+                continue;
+            }
+            stack[size++] = node.index;
+            stack[size++] = index + 1;
+        }
+        return false;
+    }
+
+    // Finds the first triangle the ray origin + t * direction crosses within maxDistance, and the t at which it does.
+    // The nearer child of every node is visited first, and every hit shortens the ray.
+    bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance, uint32_t& triangle) const {
+        if (nodes.empty()) return false;
+        glm::vec3 inverseDirection = InverseDirection(direction);
+        float entry;
+        if (!RayEntersBox(origin, inverseDirection, nodes[0], maxDistance, entry)) return false;
+        struct Pending {
+            uint32_t node;
+            float entry;
+        };
+        Pending stack[MESH_BVH_STACK_SIZE];
+        int size = 0;
+        stack[size++] = {0, entry};
+        bool found = false;
+        while (size > 0) {
+            Pending top = stack[--size];
+            if (top.entry > maxDistance) continue;
+            const MeshBvhNode& node = nodes[top.node];
+            if (node.IsLeaf()) {
+                for (uint32_t i = node.index; i < node.index + node.triangleCount; ++i) {
+                    const glm::vec3* vertices = triangles[i].vertices;
+                    if (RayIntersectsTriangle(origin, direction, vertices[0], vertices[1], vertices[2], maxDistance, distance)) {
+                        maxDistance = distance;
+                        triangle = i;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            float entry1, entry2;
+            bool hit1 = RayEntersBox(origin, inverseDirection, nodes[top.node + 1], maxDistance, entry1);
+            bool hit2 = RayEntersBox(origin, inverseDirection, nodes[node.index], maxDistance, entry2);
+            if (hit1 && hit2 && entry2 < entry1) {
+                stack[size++] = {top.node + 1, entry1};
+                stack[size++] = {node.index, entry2};
+                continue;
+            }
+            if (hit2) stack[size++] = {node.index, entry2};
+            if (hit1) stack[size++] = {top.node + 1, entry1};
+        }
+        if (found) distance = maxDistance;
+        return found;
+    }
+    // Number of triangles the ray origin + t * direction crosses for t >= 0, odd when it starts inside a closed mesh
+    int CountCrossings(const glm::vec3& origin, const glm::vec3& direction) const {
+        glm::vec3 inverseDirection = InverseDirection(direction);
+        int crossings = 0;
+        Traverse([&](const glm::vec3& minBound, const glm::vec3& maxBound) {
+            MeshBvhNode node = {minBound, 0, maxBound, 0};
+            float entry;
+            return RayEntersBox(origin, inverseDirection, node, INFINITY, entry);
+        }, [&](const MeshBvhTriangle& triangle) {
+            float distance;
+            if (RayIntersectsTriangle(origin, direction, triangle.vertices[0], triangle.vertices[1], triangle.vertices[2], INFINITY, distance)) crossings++;
+            return false;
+        });
+        return crossings;
+    }
+    // Whether the surface comes within an axis aligned ellipsoid. Dividing space by its semi axes turns it into a unit sphere,
+    // while nodes stay boxes and triangles stay triangles.
+    bool OverlapsEllipsoid(const glm::vec3& center, const glm::vec3& semiAxes) const {
+        glm::vec3 inverseAxes = 1.0f / semiAxes;
+        glm::vec3 point = center * inverseAxes;
+        return Traverse([&](const glm::vec3& minBound, const glm::vec3& maxBound) {
+            glm::vec3 delta = point - glm::clamp(point, minBound * inverseAxes, maxBound * inverseAxes);
+            return glm::dot(delta, delta) <= 1;
+        }, [&](const MeshBvhTriangle& triangle) {
+            glm::vec3 delta = point - ClosestPointOnTriangle(point, triangle.vertices[0] * inverseAxes, triangle.vertices[1] * inverseAxes, triangle.vertices[2] * inverseAxes);
+            return glm::dot(delta, delta) <= 1;
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef NARROW_PHASE_HPP
+#define NARROW_PHASE_HPP
+
+#include <glm/glm.hpp>
+
+#include "collider.hpp"
+
+// ################
+// # NARROW PHASE #
+// ################
+// Exact overlap tests for every pair of collider shapes, picked from a table by the shapes of both colliders.
+// Every test is closed form except the ones involving an ellipsoid and a round shape, which refine a single root by bisection,
+// and the ones involving a mesh, which walk its BVH down to the triangles. Nothing here allocates. Touching shapes count as overlapping.
+
+typedef bool (*NarrowPhaseTest)(Collider*, Collider*);
+
+// Bisection steps when finding the distance to an ellipsoid, enough to exhaust float precision
+const int ELLIPSOID_DISTANCE_ITERATIONS = 32;
+
+// Squared distance from a point to the closest point of an axis aligned box, 0 if inside
+inline float SquareDistanceToBox(const glm::vec3& point, const glm::vec3& minBound, const glm::vec3& maxBound) {
+    glm::vec3 delta = point - glm::clamp(point, minBound, maxBound);
+    return glm::dot(delta, delta);
+}
+
+// Closest point of an axis aligned ellipsoid centered at the origin, the point itself if inside.
+// It is semiAxes² * point / (t + semiAxes²) for the one root t > 0 of
+// sum((semiAxes * point / (t + semiAxes²))²) = 1, which decreases monotonically in t and is bracketed by [0, |semiAxes * point|].
+inline glm::vec3 ClosestPointOnEllipsoid(const glm::vec3& point, const glm::vec3& semiAxes) {
+    glm::vec3 scaled = point / semiAxes;
+    if (glm::dot(scaled, scaled) <= 1) return point;
+    glm::vec3 squareAxes = semiAxes * semiAxes;
+    glm::vec3 weighted = semiAxes * point;
+    float low = 0;
+    float high = glm::length(weighted);
+    for (int i = 0; i < ELLIPSOID_DISTANCE_ITERATIONS; ++i) {
+        float t = (low + high) * 0.5f;
+        glm::vec3 ratio = weighted / (t + squareAxes);
+        if (glm::dot(ratio, ratio) > 1) low = t;
+        else high = t;
+    }
+    return squareAxes * point / (high + squareAxes);
+}
+
+// Squared distance from a point to an axis aligned ellipsoid centered at the origin, 0 if inside
+inline float SquareDistanceToEllipsoid(const glm::vec3& point, const glm::vec3& semiAxes) {
+    glm::vec3 delta = ClosestPointOnEllipsoid(point, semiAxes) - point;
+    return glm::dot(delta, delta);
+}
+
+inline bool SphereSphere(Collider* a, Collider* b) {
+    SphereCollider* sphereA = static_cast<SphereCollider*>(a);
+    SphereCollider* sphereB = static_cast<SphereCollider*>(b);
+    glm::vec3 delta = sphereB->GetCenter() - sphereA->GetCenter();
+    float radii = sphereA->GetRadius() + sphereB->GetRadius();
+    return glm::dot(delta, delta) <= radii * radii;
+}
+
+inline bool SphereBox(Collider* a, Collider* b) {
+    SphereCollider* sphere = static_cast<SphereCollider*>(a);
+    Bounds box = b->GetBounds();
+    float radius = sphere->GetRadius();
+    return SquareDistanceToBox(sphere->GetCenter(), box.GetMinBound(), box.GetMaxBound()) <= radius * radius;
+}
+
+// Dividing space by the ellipsoid's scale turns it into a sphere, and the box into another axis aligned box
+inline bool EllipsoidBox(Collider* a, Collider* b) {
+    EllipsoidCollider* ellipsoid = static_cast<EllipsoidCollider*>(a);
+    Bounds box = b->GetBounds();
+    glm::vec3 scale = ellipsoid->GetScale();
+    float radius = ellipsoid->GetRadius();
+    return SquareDistanceToBox(ellipsoid->GetCenter() / scale, box.GetMinBound() / scale, box.GetMaxBound() / scale) <= radius * radius;
+}
+
+// Spheres are ellipsoids of scale 1. In the space of the first one, scaled to a sphere,
+// the second one is still an axis aligned ellipsoid, and they overlap if it is within the sphere's radius from its center.
+inline bool EllipsoidEllipsoid(Collider* a, Collider* b) {
+    SphereCollider* first = static_cast<SphereCollider*>(a);
+    SphereCollider* second = static_cast<SphereCollider*>(b);
+    glm::vec3 firstScale = a->GetShape() == COLLIDER_ELLIPSOID ? static_cast<EllipsoidCollider*>(a)->GetScale() : glm::vec3(1);
+    glm::vec3 secondAxes = b->GetShape() == COLLIDER_ELLIPSOID ? static_cast<EllipsoidCollider*>(b)->GetSemiAxes() : glm::vec3(second->GetRadius());
+    glm::vec3 offset = (first->GetCenter() - second->GetCenter()) / firstScale;
+    float radius = first->GetRadius();
+    return SquareDistanceToEllipsoid(offset, secondAxes / firstScale) <= radius * radius;
+}
+
+inline bool BoxBox(Collider* a, Collider* b) {
+    Bounds boxA = a->GetBounds();
+    Bounds boxB = b->GetBounds();
+    return glm::all(glm::lessThanEqual(boxA.GetMinBound(), boxB.GetMaxBound()))
+        && glm::all(glm::lessThanEqual(boxB.GetMinBound(), boxA.GetMaxBound()));
+}
+
+inline bool MeshRound(Collider* a, Collider* b) {
+    SphereCollider* round = static_cast<SphereCollider*>(b);
+    glm::vec3 semiAxes = b->GetShape() == COLLIDER_ELLIPSOID ? static_cast<EllipsoidCollider*>(b)->GetSemiAxes() : glm::vec3(round->GetRadius());
+    return static_cast<MeshCollider*>(a)->OverlapsEllipsoid(round->GetCenter(), semiAxes);
+}
+
+inline bool MeshBox(Collider* a, Collider* b) {
+    Bounds box = b->GetBounds();
+    return static_cast<MeshCollider*>(a)->OverlapsBox(box.GetMinBound(), box.GetMaxBound());
+}
+
+inline bool MeshMesh(Collider* a, Collider* b) {
+    return static_cast<MeshCollider*>(a)->OverlapsMesh(static_cast<MeshCollider*>(b));
+}
+
+// Tests for shapes that only exist the other way around in the table
+template <NarrowPhaseTest Test>
+inline bool Swapped(Collider* a, Collider* b) {
+    return Test(b, a);
+}
+
+// Indexed by the shape of the first collider, then the shape of the second one
+const NarrowPhaseTest NARROW_PHASE_TESTS[COLLIDER_SHAPE_COUNT][COLLIDER_SHAPE_COUNT] = {
+    // COLLIDER_SPHERE
+    { SphereSphere, EllipsoidEllipsoid, SphereBox, Swapped<MeshRound> },
+    // COLLIDER_ELLIPSOID
+    { EllipsoidEllipsoid, EllipsoidEllipsoid, EllipsoidBox, Swapped<MeshRound> },
+    // COLLIDER_BOX
+    { Swapped<SphereBox>, Swapped<EllipsoidBox>, BoxBox, Swapped<MeshBox> },
+    // COLLIDER_MESH
+    { MeshRound, MeshRound, MeshBox, MeshMesh }
+};
+
+inline bool Collider::CollidesWith(Collider* other) {
+    return NARROW_PHASE_TESTS[shape][other->shape](this, other);
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef COLLISION_QUERIES_HPP
+#define COLLISION_QUERIES_HPP
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+
+#include "collider.hpp"
+#include "narrowPhase.hpp"
+#include "continuous.hpp"
+
+// #####################
+// # COLLISION QUERIES #
+// #####################
+// Exact tests of a ray, a point or a box against a single collider, for queries that ask about a region of space
+// rather than about pairs of colliders. Rays have a unit direction, so every distance is in world units.
+
+// Where a ray enters a collider
+struct RaycastHit {
+    Collider* collider;
+    float distance;
+    glm::vec3 point;
+};
+// A collider found by an overlap query, with its distance from the center of the query
+struct OverlapHit {
+    Collider* collider;
+    float distance;
+};
+
+// Finds whether the ray origin + t * direction enters the collider within maxDistance, and the distance at which it does.
+// A ray starting inside hits at 0, except for meshes where only the surface counts. Round shapes become a unit sphere
+// in the space scaled by their semi axes, where t still measures the original ray.
+inline bool RaycastCollider(Collider* collider, const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) {
+    if (collider->GetShape() == COLLIDER_MESH) return static_cast<MeshCollider*>(collider)->Raycast(origin, direction, maxDistance, distance);
+    SweptShape shape = DescribeSweptShape(collider);
+    if (shape.shape == COLLIDER_BOX) {
+        float entry, exit;
+        if (!RayIntersectsBox(origin, direction, shape.center - shape.semiAxes, shape.center + shape.semiAxes, entry, exit)) return false;
+        distance = std::max(entry, 0.0f);
+        return distance <= maxDistance;
+    }
+    glm::vec3 start = (origin - shape.center) / shape.semiAxes;
+    glm::vec3 scaledDirection = direction / shape.semiAxes;
+    float c = glm::dot(start, start) - 1;
+    if (c <= 0) {
+        distance = 0;
+        return true;
+    }
+    float a = glm::dot(scaledDirection, scaledDirection);
+    float b = glm::dot(start, scaledDirection);
+    if (b >= 0) return false;
+    float discriminant = b * b - a * c;
+    if (discriminant < 0) return false;
+    distance = (-b - std::sqrt(discriminant)) / a;
+    return distance <= maxDistance;
+}
+
+// Distance from a point to the closest point of a collider, 0 if inside. Meshes measure to their surface.
+inline float DistanceToCollider(Collider* collider, const glm::vec3& point) {
+    if (collider->GetShape() == COLLIDER_MESH) return static_cast<MeshCollider*>(collider)->DistanceTo(point);
+    SweptShape shape = DescribeSweptShape(collider);
+    if (shape.shape == COLLIDER_BOX) return std::sqrt(SquareDistanceToBox(point, shape.center - shape.semiAxes, shape.center + shape.semiAxes));
+    if (shape.shape == COLLIDER_SPHERE) return std::max(glm::length(point - shape.center) - shape.semiAxes.x, 0.0f);
+    return std::sqrt(SquareDistanceToEllipsoid(point - shape.center, shape.semiAxes));
+}
+
+// Whether an axis aligned box overlaps a collider. Like EllipsoidBox, round shapes become a unit sphere in their scaled space.
+inline bool BoxOverlapsCollider(Collider* collider, const glm::vec3& minBound, const glm::vec3& maxBound) {
+    if (collider->GetShape() == COLLIDER_MESH) return static_cast<MeshCollider*>(collider)->OverlapsBox(minBound, maxBound);
+    SweptShape shape = DescribeSweptShape(collider);
+    if (shape.shape == COLLIDER_BOX) {
+        return glm::all(glm::lessThanEqual(minBound, shape.center + shape.semiAxes))
+            && glm::all(glm::lessThanEqual(shape.center - shape.semiAxes, maxBound));
+    }
+    return SquareDistanceToBox(shape.center / shape.semiAxes, minBound / shape.semiAxes, maxBound / shape.semiAxes) <= 1;
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef SPATIAL_HASH_HPP
+#define SPATIAL_HASH_HPP
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+
+#include "bounds.hpp"
+
+// #####################
+// # UNIFORM GRID HASH #
+// #####################
+// Buckets items by the grid cells their bounds overlap. Cells live in an open addressing table keyed by
+// their integer coordinates, so only occupied cells cost memory, and every buffer is reused between builds.
+// Building is linear in the number of (item, cell) entries: cells are counted, given a range, then filled.
+// Works best with a cell size around the size of a typical item; an item spans every cell its bounds touch.
+template <typename T>
+class SpatialHashGrid {
+private:
+    struct Item {
+        T* value;
+        glm::vec3 minBound;
+        glm::vec3 maxBound;
+        glm::ivec3 minCell;
+        glm::ivec3 maxCell;
+    };
+    struct Cell {
+        uint64_t key;
+        uint32_t start;
+        uint32_t count;
+    };
+    static const uint64_t EMPTY_KEY = ~(uint64_t)0;
+    // Cell coordinates are packed in 21 bits each, enough for a million cells along every axis
+    static const int COORDINATE_BITS = 21;
+    static const int COORDINATE_OFFSET = 1 << (COORDINATE_BITS - 1);
+
+    float cellSize;
+    float inverseCellSize;
+    // Set by SetCellSize, used from the next Build on
+    float pendingCellSize;
+    std::vector<Item> items;
+    std::vector<Cell> cells;
+    uint64_t cellMask = 0;
+    // Item indices, grouped by cell
+    std::vector<uint32_t> cellItems;
+
+    static uint64_t Key(int x, int y, int z) {
+        const uint64_t mask = (1 << COORDINATE_BITS) - 1;
+        return ((uint64_t)(x + COORDINATE_OFFSET) & mask)
+            | (((uint64_t)(y + COORDINATE_OFFSET) & mask) << COORDINATE_BITS)
+            | (((uint64_t)(z + COORDINATE_OFFSET) & mask) << (2 * COORDINATE_BITS));
+    }
+    static uint64_t Hash(uint64_t key) {
+        key ^= key >> 31;
+        key *= 0x9E3779B97F4A7C15ull;
+        return key ^ (key >> 29);
+    }
+    // Finds the cell with the given key, or the empty slot where it belongs
+    Cell& Find(uint64_t key) {
+        uint64_t slot = Hash(key) & cellMask;
+        while (cells[slot].key != key && cells[slot].key != EMPTY_KEY) {
+            slot = (slot + 1) & cellMask;
+        }
+        return cells[slot];
+    }
+    const Cell* Lookup(uint64_t key) const {
+        if (cells.empty()) return nullptr;
+        uint64_t slot = Hash(key) & cellMask;
+        while (cells[slot].key != EMPTY_KEY) {
+            if (cells[slot].key == key) return &cells[slot];
+            slot = (slot + 1) & cellMask;
+        }
+        return nullptr;
+    }
+    static bool Overlaps(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB) {
+        return minA.x <= maxB.x && maxA.x >= minB.x
+            && minA.y <= maxB.y && maxA.y >= minB.y
+            && minA.z <= maxB.z && maxA.z >= minB.z;
+    }
+public:
+    SpatialHashGrid(float cellSize = 1) {
+        this->cellSize = cellSize;
+        this->inverseCellSize = 1 / cellSize;
+        this->pendingCellSize = cellSize;
+    }
+    // Takes effect on the next Build. Until then, queries keep using the cells of the last one.
+    void SetCellSize(float cellSize) {
+        this->pendingCellSize = cellSize;
+    }
+    // Size of the cells of the last Build
+    float GetCellSize() const {
+        return cellSize;
+    }
+
+    glm::ivec3 CellOf(const glm::vec3& point) const {
+        return glm::ivec3(glm::floor(point * inverseCellSize));
+    }
+
+    // Starts a new build, forgetting every item
+    void Clear() {
+        items.clear();
+    }
+    void Insert(T* value, const Bounds& bounds) {
+        Item item;
+        item.value = value;
+        item.minBound = bounds.GetMinBound();
+        item.maxBound = bounds.GetMaxBound();
+        items.push_back(item);
+    }
+    // Buckets the inserted items into their cells. Call after the last Insert and before querying.
+    void Build() {
+        cellSize = pendingCellSize;
+        inverseCellSize = 1 / cellSize;
+        size_t entryCount = 0;
+        for (Item& item : items) {
+            item.minCell = CellOf(item.minBound);
+            item.maxCell = CellOf(item.maxBound);
+            glm::ivec3 span = item.maxCell - item.minCell + 1;
+            entryCount += span.x * span.y * span.z;
+        }
+        size_t tableSize = 16;
+        while (tableSize < entryCount * 2) tableSize <<= 1;
+        cells.assign(tableSize, {EMPTY_KEY, 0, 0});
+        cellMask = tableSize - 1;
+
+        // Count the items of every cell, give each cell its range, then fill the ranges
+        for (const Item& item : items) {
+            for (int z = item.minCell.z; z <= item.maxCell.z; ++z)
+            for (int y = item.minCell.y; y <= item.maxCell.y; ++y)
+            for (int x = item.minCell.x; x <= item.maxCell.x; ++x) {
+                uint64_t key = Key(x, y, z);
+                Cell& cell = Find(key);
+                cell.key = key;
+                cell.count++;
+            }
+        }
+        uint32_t offset = 0;
+        for (Cell& cell : cells) {
+            if (cell.key == EMPTY_KEY) continue;
+            cell.start = offset;
+            offset += cell.count;
+            cell.count = 0;
+        }
+        cellItems.resize(offset);
+        for (uint32_t i = 0; i < items.size(); ++i) {
+            const Item& item = items[i];
+            for (int z = item.minCell.z; z <= item.maxCell.z; ++z)
+            for (int y = item.minCell.y; y <= item.maxCell.y; ++y)
+            for (int x = item.minCell.x; x <= item.maxCell.x; ++x) {
+                Cell& cell = Find(Key(x, y, z));
+                cellItems[cell.start + cell.count++] = i;
+            }
+        }
+    }
+
+    // Calls func(T*) once for every item whose bounds overlap the given ones.
+    // An item sharing several cells with the query is only reported from the cell holding the lowest corner of their overlap.
+    template <typename Func>
+    void Query(const Bounds& bounds, Func func) const {
+        glm::vec3 minBound = bounds.GetMinBound();
+        glm::vec3 maxBound = bounds.GetMaxBound();
+        glm::ivec3 minCell = CellOf(minBound);
+        glm::ivec3 maxCell = CellOf(maxBound);
+        for (int z = minCell.z; z <= maxCell.z; ++z)
+        for (int y = minCell.y; y <= maxCell.y; ++y)
+        for (int x = minCell.x; x <= maxCell.x; ++x) {
+            const Cell* cell = Lookup(Key(x, y, z));
+            if (cell == nullptr) continue;
+            for (uint32_t i = cell->start; i < cell->start + cell->count; ++i) {
+                const Item& item = items[cellItems[i]];
+                if (!Overlaps(minBound, maxBound, item.minBound, item.maxBound)) continue;
+                glm::ivec3 owner = CellOf(glm::max(minBound, item.minBound));
+                if (owner.x != x || owner.y != y || owner.z != z) continue;
+                func(item.value);
+            }
+        }
+    }
+
+    size_t Size() const {
+        return items.size();
+    }
+    // Number of (item, cell) entries of the last build, a measure of how well the cell size fits the items
+    size_t EntryCount() const {
+        return cellItems.size();
+    }
+};
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef SWEEP_AND_PRUNE_HPP
+#define SWEEP_AND_PRUNE_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <stdint.h>
+
+#include "bounds.hpp"
+
+// ###################
+// # SWEEP AND PRUNE #
+// ###################
+// Persistent broadphase that keeps the bound endpoints of every proxy sorted along all three axes.
+// Sorting happens in place with insertion sort, which is close to linear when things only move a little every frame.
+// Every swap of a min and a max endpoint is an overlap starting or ending on that axis, so the overlapping pairs are
+// kept up to date from the swaps alone: the cost of an update is the number of proxies plus the amount they moved past each other.
+// Adding many proxies at once would make the insertion sort quadratic, so such updates sort from scratch and find the pairs with
+// a single sweep instead. Proxies only pair when one's group is in the other's mask.
+template <typename T>
+class SweepAndPrune {
+public:
+    typedef uint32_t Handle;
+    struct Pair {
+        // The proxy with the lower group (or handle, if they share one) comes first
+        Handle first;
+        Handle second;
+    };
+private:
+    struct Proxy {
+        T* value;
+        glm::vec3 minBound;
+        glm::vec3 maxBound;
+        uint32_t group;
+        uint32_t mask;
+        bool alive;
+    };
+    // The endpoint's value, and its proxy shifted left by one with the lowest bit set on max endpoints
+    struct Endpoint {
+        float value;
+        uint32_t data;
+    };
+
+    std::vector<Proxy> proxies;
+    std::vector<Handle> freeHandles;
+    // Proxies removed since the last update, whose endpoints have not been dropped yet
+    std::vector<Handle> removedHandles;
+    std::vector<Endpoint> endpoints[3];
+    std::vector<Pair> pairs;
+    // Pair key to its index in pairs
+    std::unordered_map<uint64_t, uint32_t> pairIndices;
+    // Proxies added since the last update
+    size_t addedCount = 0;
+    size_t swapCount = 0;
+    // Proxies whose min has been passed but not their max while rebuilding, and where each one is in that list
+    std::vector<Handle> activeHandles;
+    std::vector<uint32_t> activeIndices;
+
+    static Handle ProxyOf(const Endpoint& endpoint) {
+        return endpoint.data >> 1;
+    }
+    static bool IsMax(const Endpoint& endpoint) {
+        return endpoint.data & 1;
+    }
+    // Mins sort before maxes of the same value, so touching bounds overlap
+    static bool Less(const Endpoint& a, const Endpoint& b) {
+        return a.value < b.value || (a.value == b.value && !IsMax(a) && IsMax(b));
+    }
+    static uint64_t PairKey(Handle a, Handle b) {
+        if (a > b) std::swap(a, b);
+        return ((uint64_t)a << 32) | b;
+    }
+
+    bool CanPair(const Proxy& a, const Proxy& b) const {
+        return (a.group & b.mask) != 0 || (b.group & a.mask) != 0;
+    }
+    static bool Overlaps(const Proxy& a, const Proxy& b) {
+        return a.minBound.x <= b.maxBound.x && a.maxBound.x >= b.minBound.x
+            && a.minBound.y <= b.maxBound.y && a.maxBound.y >= b.minBound.y
+            && a.minBound.z <= b.maxBound.z && a.maxBound.z >= b.minBound.z;
+    }
+
+    // Two proxies started overlapping along one axis. They pair if they now overlap along the others as well.
+    void BeginOverlap(Handle a, Handle b) {
+        if (a == b) return;
+        const Proxy& proxyA = proxies[a];
+        const Proxy& proxyB = proxies[b];
+        if (!proxyA.alive || !proxyB.alive || !CanPair(proxyA, proxyB) || !Overlaps(proxyA, proxyB)) return;
+        AddPair(a, b);
+    }
+    void AddPair(Handle a, Handle b) {
+        uint64_t key = PairKey(a, b);
+        if (pairIndices.count(key) != 0) return;
+        if (proxies[b].group < proxies[a].group || (proxies[b].group == proxies[a].group && b < a)) std::swap(a, b);
+        pairIndices[key] = pairs.size();
+        pairs.push_back({a, b});
+    }
+    void EndOverlap(Handle a, Handle b) {
+        auto found = pairIndices.find(PairKey(a, b));
+        if (found == pairIndices.end()) return;
+        RemovePairAt(found->second);
+        pairIndices.erase(found);
+    }
+    // Swap-removes a pair, keeping the index of the one moved into its place
+    void RemovePairAt(uint32_t index) {
+        if (index + 1 != pairs.size()) {
+            pairs[index] = pairs.back();
+            pairIndices[PairKey(pairs[index].first, pairs[index].second)] = index;
+        }
+        pairs.pop_back();
+    }
+
+    void SortAxis(int axis) {
+        std::vector<Endpoint>& axisEndpoints = endpoints[axis];
+        for (size_t i = 1; i < axisEndpoints.size(); ++i) {
+            Endpoint endpoint = axisEndpoints[i];
+            size_t j = i;
+            while (j > 0 && Less(endpoint, axisEndpoints[j - 1])) {
+                const Endpoint& passed = axisEndpoints[j - 1];
+                // A min moving below a max starts an overlap, a max moving below a min ends one
+                if (!IsMax(endpoint) && IsMax(passed)) BeginOverlap(ProxyOf(endpoint), ProxyOf(passed));
+                else if (IsMax(endpoint) && !IsMax(passed)) EndOverlap(ProxyOf(endpoint), ProxyOf(passed));
+                axisEndpoints[j] = passed;
+                --j;
+                swapCount++;
+            }
+            axisEndpoints[j] = endpoint;
+        }
+    }
+
+    // Axis along which the proxy centers are the most spread out, the one where a sweep meets the fewest overlaps
+    int WidestAxis() const {
+        glm::vec3 sum(0), squareSum(0);
+        size_t alive = 0;
+        for (const Proxy& proxy : proxies) {
+            if (!proxy.alive) continue;
+            glm::vec3 center = (proxy.minBound + proxy.maxBound) * 0.5f;
+            sum += center;
+            squareSum += center * center;
+            alive++;
+        }
+        if (alive == 0) return 0;
+        glm::vec3 variance = squareSum / (float)alive - (sum / (float)alive) * (sum / (float)alive);
+        if (variance.x >= variance.y && variance.x >= variance.z) return 0;
+        return variance.y >= variance.z ? 1 : 2;
+    }
+    // Finds every pair from scratch by sweeping the (already sorted) endpoints of one axis
+    void RebuildPairs() {
+        pairs.clear();
+        pairIndices.clear();
+        activeHandles.clear();
+        activeIndices.resize(proxies.size());
+        for (const Endpoint& endpoint : endpoints[WidestAxis()]) {
+            Handle handle = ProxyOf(endpoint);
+            if (IsMax(endpoint)) {
+                uint32_t index = activeIndices[handle];
+                activeHandles[index] = activeHandles.back();
+                activeIndices[activeHandles[index]] = index;
+                activeHandles.pop_back();
+                continue;
+            }
+            const Proxy& proxy = proxies[handle];
+            for (Handle active : activeHandles) {
+                if (CanPair(proxy, proxies[active]) && Overlaps(proxy, proxies[active])) AddPair(handle, active);
+            }
+            activeIndices[handle] = activeHandles.size();
+            activeHandles.push_back(handle);
+        }
+    }
+public:
+    // Adds a proxy. Its pairs show up on the next Update.
+    Handle Add(T* value, const Bounds& bounds, uint32_t group = 1, uint32_t mask = ~0u) {
+        Handle handle;
+        if (!freeHandles.empty()) {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        } else {
+            handle = proxies.size();
+            proxies.emplace_back();
+        }
+        proxies[handle] = {value, bounds.GetMinBound(), bounds.GetMaxBound(), group, mask, true};
+        addedCount++;
+        // New endpoints start past every other one, so the proxy overlaps nothing until it is sorted into place
+        for (int axis = 0; axis < 3; ++axis) {
+            endpoints[axis].push_back({proxies[handle].minBound[axis], handle << 1});
+            endpoints[axis].push_back({proxies[handle].maxBound[axis], (handle << 1) | 1});
+        }
+        return handle;
+    }
+    // Removes a proxy and every pair it was part of
+    void Remove(Handle handle) {
+        Proxy& proxy = proxies[handle];
+        if (!proxy.alive) return;
+        proxy.alive = false;
+        proxy.value = nullptr;
+        for (size_t i = pairs.size(); i-- > 0;) {
+            if (pairs[i].first != handle && pairs[i].second != handle) continue;
+            pairIndices.erase(PairKey(pairs[i].first, pairs[i].second));
+            RemovePairAt(i);
+        }
+        removedHandles.push_back(handle);
+    }
+    // Caches the new bounds of a proxy. Its endpoints move on the next Update.
+    void Move(Handle handle, const Bounds& bounds) {
+        proxies[handle].minBound = bounds.GetMinBound();
+        proxies[handle].maxBound = bounds.GetMaxBound();
+    }
+
+    // Brings the endpoints up to date with the cached bounds and re-sorts them, updating the pairs along the way
+    void Update() {
+        swapCount = 0;
+        // Past a quarter of new proxies, sorting from scratch beats moving each of them into place
+        bool rebuild = addedCount * 4 > Size();
+        addedCount = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            std::vector<Endpoint>& axisEndpoints = endpoints[axis];
+            if (!removedHandles.empty()) {
+                size_t kept = 0;
+                for (const Endpoint& endpoint : axisEndpoints) {
+                    if (proxies[ProxyOf(endpoint)].alive) axisEndpoints[kept++] = endpoint;
+                }
+                axisEndpoints.resize(kept);
+            }
+            for (Endpoint& endpoint : axisEndpoints) {
+                const Proxy& proxy = proxies[ProxyOf(endpoint)];
+                endpoint.value = IsMax(endpoint) ? proxy.maxBound[axis] : proxy.minBound[axis];
+            }
+            if (rebuild) std::sort(axisEndpoints.begin(), axisEndpoints.end(), Less);
+            else SortAxis(axis);
+        }
+        if (rebuild) RebuildPairs();
+        // Only now that no endpoint refers to them can the handles be reused
+        freeHandles.insert(freeHandles.end(), removedHandles.begin(), removedHandles.end());
+        removedHandles.clear();
+    }
+
+    T* GetValue(Handle handle) const {
+        return proxies[handle].value;
+    }
+    uint32_t GetGroup(Handle handle) const {
+        return proxies[handle].group;
+    }
+    // Pairs of proxies whose bounds overlapped on the last Update, in no particular order
+    const std::vector<Pair>& GetPairs() const {
+        return pairs;
+    }
+    size_t Size() const {
+        return proxies.size() - freeHandles.size() - removedHandles.size();
+    }
+    // Endpoint swaps done by the last Update, which is how much the proxies moved past each other
+    size_t SwapCount() const {
+        return swapCount;
+    }
+};
+
+#endif
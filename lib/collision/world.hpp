@@ -0,0 +1,467 @@
+#ifndef COLLISION_WORLD_HPP
+#define COLLISION_WORLD_HPP
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <stdint.h>
+
+#include "aabbTree.hpp"
+#include "collider.hpp"
+#include "collision.hpp"
+#include "contacts.hpp"
+#include "layer.hpp"
+#include "queries.hpp"
+#include "spatialHash.hpp"
+#include "sweepAndPrune.hpp"
+#include "../gameObject.hpp"
+#include "../jobs.hpp"
+#include "../extensions/collectionUtils.hpp"
+
+// ###################
+// # COLLISION WORLD #
+// ###################
+// Every collider of a scene, each on one of up to 32 layers. Which layers collide is a symmetric matrix of bits, and every
+// collider carries the index of its layer and the mask of the layers it collides with. A check gathers the active colliders once,
+// runs a single broadphase over all of them and only keeps the candidates whose layers interact, so nothing is built per layer.
+// Like CollisionLayer, pairs are found across the job system, sorted by time of impact and reported as contact events
+// once detection is over. The first collider of a pair is the one on the lower layer.
+// Every collider also lives in a dynamic AABB tree, which answers raycasts and overlap queries on any set of layers.
+
+typedef int CollisionLayerIndex;
+const int COLLISION_WORLD_MAX_LAYERS = 32;
+
+class CollisionWorld {
+private:
+    // What the broadphases read from an active collider, gathered once per check
+    struct Entry {
+        Collider* collider;
+        Bounds bounds;
+        uint32_t layerBit;
+        uint32_t layerMask;
+        CollisionLayerIndex layer;
+    };
+    struct FoundPair {
+        // Time of impact for continuous colliders, 1 otherwise
+        float time;
+        uint64_t order;
+        Collider* col;
+        Collider* other;
+    };
+    typedef void (CollisionWorld::*PairFinder)(size_t begin, size_t end, std::vector<FoundPair>& out);
+
+    // Bits of the layers each layer collides with
+    uint32_t layerMasks[COLLISION_WORLD_MAX_LAYERS] = {};
+    std::vector<Collider*> colliders;
+    // Active colliders of the current check. With the sweep, sorted by the min X of their swept bounds.
+    std::vector<Entry> entries;
+    CollisionBroadphase broadphase = BROADPHASE_GRID;
+    SpatialHashGrid<Entry> grid;
+    std::vector<float> sweepKeys;
+    // The entries in the same order, with continuous colliders masked out since the batch only tests where they ended
+    ColliderBatch batch;
+
+    // Persistent broadphase state, with the layer bits as groups so the sweep and prune filters pairs itself
+    struct ProxyEntry {
+        SweepAndPrune<Collider>::Handle handle;
+        uint32_t group;
+        uint32_t mask;
+        // Last check that found the collider active
+        uint32_t stamp;
+    };
+    SweepAndPrune<Collider> sweepAndPrune;
+    std::unordered_map<Collider*, ProxyEntry> proxies;
+    uint32_t syncStamp = 0;
+
+    // Every collider, active or not, for the queries
+    DynamicAabbTree<Collider> queryTree;
+    std::unordered_map<Collider*, DynamicAabbTree<Collider>::Proxy> queryProxies;
+
+    std::vector<FoundPair> foundPairs;
+    std::vector<std::vector<FoundPair>> chunkPairs;
+    ContactCache contacts;
+
+    // Colliders added or removed by collision callbacks wait here until the check is over
+    bool checking = false;
+    std::vector<Collider*> pendingAdd;
+    std::vector<Collider*> pendingRemove;
+
+    ObjEventHandler<CollisionWorld, Component*> OnColliderDestroyedHandler;
+    static void OnColliderDestroyedCallback(CollisionWorld* world, Component* c) {
+        Collider* collider = static_cast<Collider*>(c);
+        world->RemoveCollider(collider);
+        world->contacts.Forget(collider);
+        auto found = world->proxies.find(collider);
+        if (found != world->proxies.end()) {
+            world->sweepAndPrune.Remove(found->second.handle);
+            world->proxies.erase(found);
+        }
+    }
+
+    static void CheckLayer(CollisionLayerIndex layer) {
+        if (layer < 0 || layer >= COLLISION_WORLD_MAX_LAYERS) throw std::out_of_range("Collision layers go from 0 to 31");
+    }
+public:
+    CollisionWorld() {
+        OnColliderDestroyedHandler = ObjEventHandler<CollisionWorld, Component*>(this, OnColliderDestroyedCallback);
+    }
+    // Makes both layers collide, or stop colliding, with each other. A layer may collide with itself.
+    CollisionWorld* SetLayersCollide(CollisionLayerIndex a, CollisionLayerIndex b, bool collide = true) {
+        CheckLayer(a);
+        CheckLayer(b);
+        if (collide) {
+            layerMasks[a] |= 1u << b;
+            layerMasks[b] |= 1u << a;
+        } else {
+            layerMasks[a] &= ~(1u << b);
+            layerMasks[b] &= ~(1u << a);
+        }
+        for (Collider* collider : colliders) collider->SetCollisionFilter(collider->GetCollisionLayer(), layerMasks[collider->GetCollisionLayer()]);
+        for (Collider* collider : pendingAdd) collider->SetCollisionFilter(collider->GetCollisionLayer(), layerMasks[collider->GetCollisionLayer()]);
+        return this;
+    }
+    bool LayersCollide(CollisionLayerIndex a, CollisionLayerIndex b) const {
+        CheckLayer(a);
+        CheckLayer(b);
+        return (layerMasks[a] >> b) & 1;
+    }
+    CollisionWorld* AddCollider(Collider* collider, CollisionLayerIndex layer) {
+        CheckLayer(layer);
+        collider->SetCollisionFilter(layer, layerMasks[layer]);
+        collider->OnDestroyed.AddListener(&OnColliderDestroyedHandler);
+        if (queryProxies.find(collider) == queryProxies.end()) {
+            collider->SyncWithTransform();
+            queryProxies[collider] = queryTree.Insert(collider, collider->GetBounds());
+        }
+        if (checking) pendingAdd.push_back(collider);
+        else colliders.push_back(collider);
+        return this;
+    }
+    CollisionWorld* RemoveCollider(Collider* collider) {
+        auto found = queryProxies.find(collider);
+        if (found != queryProxies.end()) {
+            queryTree.Remove(found->second);
+            queryProxies.erase(found);
+        }
+        if (checking) pendingRemove.push_back(collider);
+        else Remove(colliders, collider);
+        return this;
+    }
+    // Removes every collider at once, without the search through the colliders that removing them one by one takes
+    CollisionWorld* Clear() {
+        if (checking) throw std::logic_error("Collision worlds cannot be cleared by their own collision callbacks");
+        for (Collider* collider : colliders) collider->OnDestroyed.RemoveListener(&OnColliderDestroyedHandler);
+        colliders.clear();
+        entries.clear();
+        sweepAndPrune = SweepAndPrune<Collider>();
+        proxies.clear();
+        queryTree = DynamicAabbTree<Collider>();
+        queryProxies.clear();
+        contacts = ContactCache();
+        return this;
+    }
+    // Batching tests every pair, four at a time, so it is only meant for worlds of a few dozen colliders
+    CollisionWorld* SetBroadphase(CollisionBroadphase broadphase) {
+        this->broadphase = broadphase;
+        return this;
+    }
+    CollisionBroadphase GetBroadphase() const {
+        return broadphase;
+    }
+    // Edge length of the grid cells. Around the size of a typical collider works best.
+    CollisionWorld* SetCellSize(float cellSize) {
+        grid.SetCellSize(cellSize);
+        return this;
+    }
+    const std::vector<Collider*>& GetColliders() const {
+        return colliders;
+    }
+
+    // Brings every collider up to date with its transform, finds every collision between colliders on interacting layers,
+    // turns them into contact events and dispatches them on the calling thread. With a job system, the pairs are found across
+    // its threads, then sorted into an order that does not depend on them. Returns the events, valid until the next check.
+    const std::vector<ContactEvent>& CheckCollisions(JobSystem* jobs = nullptr) {
+        Gather();
+        UpdateQueryTree();
+        foundPairs.clear();
+        if (broadphase == BROADPHASE_PERSISTENT) {
+            SyncSweepAndPrune();
+            FindInParallel(jobs, sweepAndPrune.GetPairs().size(), &CollisionWorld::FindPersistent);
+        } else if (broadphase == BROADPHASE_GRID) {
+            grid.Clear();
+            for (Entry& entry : entries) grid.Insert(&entry, entry.bounds);
+            grid.Build();
+            FindInParallel(jobs, entries.size(), &CollisionWorld::FindInGrid);
+        } else if (broadphase == BROADPHASE_BATCH) {
+            batch.Clear();
+            for (const Entry& entry : entries) batch.Add(entry.collider, entry.collider->IsContinuous() ? 0 : entry.layerBit);
+            batch.Build();
+            FindInParallel(jobs, entries.size(), &CollisionWorld::FindInBatch);
+        } else {
+            FindInParallel(jobs, entries.size(), &CollisionWorld::FindInSweep);
+        }
+        // Earliest impacts first, so a projectile that went through several colliders in one step reports the first one it hit first
+        std::stable_sort(foundPairs.begin(), foundPairs.end(), [](const FoundPair& a, const FoundPair& b) {
+            return a.time < b.time || (a.time == b.time && a.order < b.order);
+        });
+
+        contacts.Begin();
+        for (const FoundPair& pair : foundPairs) contacts.Touch(pair.col, pair.other, pair.time);
+        contacts.End();
+        SetChecking(true);
+        contacts.Dispatch();
+        SetChecking(false);
+        return contacts.GetEvents();
+    }
+
+    // Moves every collider in the query tree to where its transform is. Checks do it on their own,
+    // so queries only need this when colliders moved since the last check and have to be found where they are now.
+    void UpdateQueryTree() {
+        for (auto& item : queryProxies) {
+            Collider* collider = item.first;
+            collider->SyncWithTransform();
+            queryTree.Move(item.second, collider->GetBounds(), collider->GetMotion());
+        }
+    }
+
+    // Every active collider on the layers of layerMask that the ray from origin along direction enters within maxDistance,
+    // nearest first. The direction does not need to be normalized.
+    std::vector<RaycastHit> Raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = INFINITY, uint32_t layerMask = ~0u) const {
+        std::vector<RaycastHit> hits;
+        float length = glm::length(direction);
+        if (length == 0) return hits;
+        glm::vec3 unit = direction / length;
+        queryTree.Raycast(origin, unit, maxDistance, [&](Collider* collider, float maxDistance) {
+            float distance;
+            if (IsQueried(collider, layerMask) && RaycastCollider(collider, origin, unit, maxDistance, distance)) {
+                hits.push_back({collider, distance, origin + unit * distance});
+            }
+            return maxDistance;
+        });
+        std::stable_sort(hits.begin(), hits.end(), [](const RaycastHit& a, const RaycastHit& b) {
+            return a.distance < b.distance;
+        });
+        return hits;
+    }
+    // Only the nearest hit of Raycast. Every hit shortens the ray, so the tree skips whatever lies behind it.
+    bool RaycastFirst(const glm::vec3& origin, const glm::vec3& direction, RaycastHit& hit, float maxDistance = INFINITY, uint32_t layerMask = ~0u) const {
+        float length = glm::length(direction);
+        if (length == 0) return false;
+        glm::vec3 unit = direction / length;
+        bool found = false;
+        queryTree.Raycast(origin, unit, maxDistance, [&](Collider* collider, float maxDistance) {
+            float distance;
+            if (!IsQueried(collider, layerMask) || !RaycastCollider(collider, origin, unit, maxDistance, distance)) return maxDistance;
+            if (found && distance >= hit.distance) return maxDistance;
+            hit = {collider, distance, origin + unit * distance};
+            found = true;
+            return distance;
+        });
+        return found;
+    }
+    // Every active collider on the layers of layerMask within radius of center, nearest to it first
+    std::vector<OverlapHit> SphereOverlap(const glm::vec3& center, float radius, uint32_t layerMask = ~0u) const {
+        std::vector<OverlapHit> hits;
+        queryTree.Query(Bounds(center - glm::vec3(radius), center + glm::vec3(radius)), [&](Collider* collider) {
+            if (!IsQueried(collider, layerMask)) return;
+            float distance = DistanceToCollider(collider, center);
+            if (distance <= radius) hits.push_back({collider, distance});
+        });
+        SortByDistance(hits);
+        return hits;
+    }
+    // Every active collider on the layers of layerMask that overlaps the box, nearest to its center first
+    std::vector<OverlapHit> BoxOverlap(const Bounds& box, uint32_t layerMask = ~0u) const {
+        std::vector<OverlapHit> hits;
+        glm::vec3 minBound = box.GetMinBound();
+        glm::vec3 maxBound = box.GetMaxBound();
+        glm::vec3 center = (minBound + maxBound) * 0.5f;
+        queryTree.Query(box, [&](Collider* collider) {
+            if (IsQueried(collider, layerMask) && BoxOverlapsCollider(collider, minBound, maxBound)) {
+                hits.push_back({collider, DistanceToCollider(collider, center)});
+            }
+        });
+        SortByDistance(hits);
+        return hits;
+    }
+    const DynamicAabbTree<Collider>& GetQueryTree() const {
+        return queryTree;
+    }
+
+    static bool IsQueried(Collider* collider, uint32_t layerMask) {
+        return (collider->GetLayerBit() & layerMask) != 0 && collider->IsActive();
+    }
+    static void SortByDistance(std::vector<OverlapHit>& hits) {
+        std::stable_sort(hits.begin(), hits.end(), [](const OverlapHit& a, const OverlapHit& b) {
+            return a.distance < b.distance;
+        });
+    }
+
+    // Syncs every collider with its transform and gathers the active ones on a layer that collides with something.
+    // The sweep keeps the colliders sorted along X from one check to the next, so gathering them keeps the entries sorted.
+    void Gather() {
+        for (Collider* collider : colliders) {
+            collider->SyncWithTransform();
+            if (collider->IsContinuous()) collider->AdvanceSweep(collider->IsActive());
+        }
+        if (broadphase == BROADPHASE_SWEEP) SortAlongX();
+        entries.clear();
+        for (Collider* collider : colliders) {
+            if (collider->GetCollisionMask() == 0 || !collider->IsActive()) continue;
+            entries.push_back({collider, collider->GetSweptBounds(), collider->GetLayerBit(), collider->GetCollisionMask(), collider->GetCollisionLayer()});
+        }
+    }
+    // Insertion sort on cached keys, which only does work for the colliders that moved past each other since the last check
+    void SortAlongX() {
+        sweepKeys.resize(colliders.size());
+        for (size_t i = 0; i < colliders.size(); ++i) {
+            sweepKeys[i] = colliders[i]->GetSweptBounds().GetMinBound().x;
+        }
+        for (size_t i = 1; i < colliders.size(); ++i) {
+            float key = sweepKeys[i];
+            Collider* collider = colliders[i];
+            size_t j = i;
+            for (; j > 0 && sweepKeys[j - 1] > key; --j) {
+                sweepKeys[j] = sweepKeys[j - 1];
+                colliders[j] = colliders[j - 1];
+            }
+            sweepKeys[j] = key;
+            colliders[j] = collider;
+        }
+    }
+
+    // Runs finder over [0, count) of whatever it iterates, in chunks spread over the job system if there is one,
+    // and gathers what every chunk found into foundPairs
+    void FindInParallel(JobSystem* jobs, size_t count, PairFinder finder) {
+        size_t chunks = jobs == nullptr ? 1 : std::min(JobSystem::MAX_PARALLEL_CHUNKS, (count + COLLISION_JOB_GRAIN - 1) / COLLISION_JOB_GRAIN);
+        if (chunks <= 1) {
+            (this->*finder)(0, count, foundPairs);
+            return;
+        }
+        if (chunkPairs.size() < chunks) chunkPairs.resize(chunks);
+        size_t chunkSize = (count + chunks - 1) / chunks;
+        jobs->ParallelFor(chunks, 1, [&](size_t first, size_t last) {
+            for (size_t chunk = first; chunk < last; ++chunk) {
+                chunkPairs[chunk].clear();
+                (this->*finder)(std::min(count, chunk * chunkSize), std::min(count, (chunk + 1) * chunkSize), chunkPairs[chunk]);
+            }
+        });
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            foundPairs.insert(foundPairs.end(), chunkPairs[chunk].begin(), chunkPairs[chunk].end());
+        }
+    }
+    // Runs the exact test on a candidate pair whose layers interact, with the collider on the lower layer first
+    static void TestPair(const Entry& a, const Entry& b, uint64_t order, std::vector<FoundPair>& out) {
+        if ((a.layerBit & b.layerMask) == 0) return;
+        const Entry& first = b.layer < a.layer ? b : a;
+        const Entry& second = b.layer < a.layer ? a : b;
+        float time;
+        if (CollidersTouch(first.collider, second.collider, time)) out.push_back({time, order, first.collider, second.collider});
+    }
+
+    // Looks up every entry in the shared grid. Each pair is found from both sides, so only the lookup of its first entry keeps it.
+    void FindInGrid(size_t begin, size_t end, std::vector<FoundPair>& out) {
+        for (size_t i = begin; i < end; ++i) {
+            const Entry& entry = entries[i];
+            grid.Query(entry.bounds, [&](Entry* other) {
+                if (other > &entry) TestPair(entry, *other, i, out);
+            });
+        }
+    }
+
+    // Tests every entry against the ones after it in the batch, four at a time. Continuous colliders are left out of the batch
+    // and instead test the bounds of their whole move against every entry, the continuous ones after them only.
+    void FindInBatch(size_t begin, size_t end, std::vector<FoundPair>& out) {
+        for (size_t i = begin; i < end; ++i) {
+            const Entry& entry = entries[i];
+            if (!entry.collider->IsContinuous()) {
+                batch.QueryFrom(i + 1, entry.collider, entry.layerMask, [&](Collider* other) {
+                    bool lower = other->GetCollisionLayer() < entry.layer;
+                    out.push_back({1, i, lower ? other : entry.collider, lower ? entry.collider : other});
+                });
+                continue;
+            }
+            for (size_t j = 0; j < entries.size(); ++j) {
+                const Entry& other = entries[j];
+                if (j == i || (j < i && other.collider->IsContinuous())) continue;
+                if (glm::all(glm::lessThanEqual(entry.bounds.GetMinBound(), other.bounds.GetMaxBound()))
+                    && glm::all(glm::lessThanEqual(other.bounds.GetMinBound(), entry.bounds.GetMaxBound()))) TestPair(entry, other, i, out);
+            }
+        }
+    }
+
+    // Sweeps the entries along X. Every entry is tested against the ones after it that start before it ends.
+    void FindInSweep(size_t begin, size_t end, std::vector<FoundPair>& out) {
+        for (size_t i = begin; i < end; ++i) {
+            const Entry& entry = entries[i];
+            glm::vec3 minBound = entry.bounds.GetMinBound();
+            glm::vec3 maxBound = entry.bounds.GetMaxBound();
+            for (size_t j = i + 1; j < entries.size(); ++j) {
+                const Entry& other = entries[j];
+                glm::vec3 otherMin = other.bounds.GetMinBound();
+                if (otherMin.x > maxBound.x) break;
+                glm::vec3 otherMax = other.bounds.GetMaxBound();
+                if (otherMin.y > maxBound.y || otherMax.y < minBound.y || otherMin.z > maxBound.z || otherMax.z < minBound.z) continue;
+                TestPair(entry, other, i, out);
+            }
+        }
+    }
+
+    // Mirrors the entries into the sweep and prune, dropping the colliders that went inactive or were removed since the last check
+    void SyncSweepAndPrune() {
+        syncStamp++;
+        for (const Entry& entry : entries) {
+            auto found = proxies.find(entry.collider);
+            if (found == proxies.end()) {
+                proxies[entry.collider] = {sweepAndPrune.Add(entry.collider, entry.bounds, entry.layerBit, entry.layerMask), entry.layerBit, entry.layerMask, syncStamp};
+                continue;
+            }
+            ProxyEntry& proxy = found->second;
+            proxy.stamp = syncStamp;
+            if (proxy.group == entry.layerBit && proxy.mask == entry.layerMask) {
+                sweepAndPrune.Move(proxy.handle, entry.bounds);
+                continue;
+            }
+            // Moved to another layer, or its layer's interactions changed, since the last check
+            sweepAndPrune.Remove(proxy.handle);
+            proxy = {sweepAndPrune.Add(entry.collider, entry.bounds, entry.layerBit, entry.layerMask), entry.layerBit, entry.layerMask, syncStamp};
+        }
+        for (auto it = proxies.begin(); it != proxies.end();) {
+            if (it->second.stamp == syncStamp) {
+                ++it;
+                continue;
+            }
+            sweepAndPrune.Remove(it->second.handle);
+            it = proxies.erase(it);
+        }
+        sweepAndPrune.Update();
+    }
+    // Runs the exact tests on the pairs the sweep and prune found overlapping, which already have the lower layer first
+    void FindPersistent(size_t begin, size_t end, std::vector<FoundPair>& out) {
+        const std::vector<SweepAndPrune<Collider>::Pair>& pairs = sweepAndPrune.GetPairs();
+        for (size_t i = begin; i < end; ++i) {
+            Collider* col = sweepAndPrune.GetValue(pairs[i].first);
+            Collider* other = sweepAndPrune.GetValue(pairs[i].second);
+            float time;
+            if (CollidersTouch(col, other, time)) out.push_back({time, i, col, other});
+        }
+    }
+
+    // While checking, membership changes are queued. They are applied once checking ends.
+    void SetChecking(bool checking) {
+        this->checking = checking;
+        if (checking) return;
+        for (Collider* collider : pendingRemove) {
+            Remove(colliders, collider);
+            Remove(pendingAdd, collider);
+        }
+        for (Collider* collider : pendingAdd) {
+            colliders.push_back(collider);
+        }
+        pendingAdd.clear();
+        pendingRemove.clear();
+    }
+};
+
+#endif
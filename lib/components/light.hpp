@@ -34,8 +34,7 @@ public:
     }
     void Update(GLProgram* program) { }
     void PreDraw(GLProgram* program) {
-        Transform globalSpace = GetGameObject()->GetGlobalTransform();
-        data.position = globalSpace.position;
+        data.position = GetGameObject()->GetGlobalTransform().GetPosition();
     }
 };
 
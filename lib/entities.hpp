@@ -0,0 +1,407 @@
+#ifndef ENTITIES_HPP
+#define ENTITIES_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtx/rotate_vector.hpp>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+#include "gameObject.hpp"
+#include "jobs.hpp"
+
+using namespace glm;
+using namespace std;
+
+// ##################
+// # ENTITY STORAGE #
+// ##################
+// Entities are rows in an archetype: a table holding one contiguous column per component.
+// All entities with the same set of components share an archetype, so systems walk whole columns
+// instead of calling a virtual Update on every object.
+
+typedef uint32_t EntityComponentFlags;
+static const EntityComponentFlags ENTITY_POSITION = 1;          // position
+static const EntityComponentFlags ENTITY_ORIENTATION = 2;       // forward, up
+static const EntityComponentFlags ENTITY_SCALE = 4;             // scale, baseScale
+static const EntityComponentFlags ENTITY_VELOCITY = 8;          // velocity, baseVelocity
+static const EntityComponentFlags ENTITY_ANGULAR_VELOCITY = 16; // angularVelocity (euler angles per second, applied Z-Y-X)
+static const EntityComponentFlags ENTITY_LIFETIME = 32;         // lifetime, maxLifetime
+static const EntityComponentFlags ENTITY_COLOR = 64;            // color, startColor, endColor
+static const EntityComponentFlags ENTITY_BINDING = 128;         // binding, see EntityBinding
+// Position, orientation, scale and velocity that fade out over a lifetime, like the game's particles
+static const EntityComponentFlags ENTITY_PARTICLE = 127;
+
+struct EntityHandle {
+    uint32_t index = 0xFFFFFFFF;
+    uint32_t generation = 0;
+    bool operator==(const EntityHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool IsValid() const {
+        return index != 0xFFFFFFFF;
+    }
+};
+
+class EntityBinding;
+
+class Archetype {
+public:
+    const EntityComponentFlags components;
+    vector<EntityHandle> handles;
+
+    vector<vec3> positions;
+    vector<vec3> forwards;
+    vector<vec3> ups;
+    vector<vec3> scales;
+    vector<vec3> baseScales;
+    vector<vec3> velocities;
+    vector<vec3> baseVelocities;
+    vector<vec3> angularVelocities;
+    vector<float> lifetimes;
+    vector<float> maxLifetimes;
+    vector<vec4> colors;
+    vector<vec4> startColors;
+    vector<vec4> endColors;
+    vector<EntityBinding*> bindings;
+
+    Archetype(EntityComponentFlags components) : components(components) { }
+
+    bool Has(EntityComponentFlags required) const {
+        return (components & required) == required;
+    }
+    size_t Size() const {
+        return handles.size();
+    }
+
+    // Appends a row with default values in every column and returns its index
+    size_t AddRow(EntityHandle handle) {
+        handles.push_back(handle);
+        if (components & ENTITY_POSITION) positions.push_back(vec3(0));
+        if (components & ENTITY_ORIENTATION) {
+            forwards.push_back(vec3(0,0,-1));
+            ups.push_back(vec3(0,1,0));
+        }
+        if (components & ENTITY_SCALE) {
+            scales.push_back(vec3(1));
+            baseScales.push_back(vec3(1));
+        }
+        if (components & ENTITY_VELOCITY) {
+            velocities.push_back(vec3(0));
+            baseVelocities.push_back(vec3(0));
+        }
+        if (components & ENTITY_ANGULAR_VELOCITY) angularVelocities.push_back(vec3(0));
+        if (components & ENTITY_LIFETIME) {
+            lifetimes.push_back(1);
+            maxLifetimes.push_back(1);
+        }
+        if (components & ENTITY_COLOR) {
+            colors.push_back(vec4(1));
+            startColors.push_back(vec4(1));
+            endColors.push_back(vec4(1));
+        }
+        if (components & ENTITY_BINDING) bindings.push_back(nullptr);
+        return handles.size() - 1;
+    }
+
+    // Removes a row by moving the last row into its place
+    void RemoveRow(size_t row) {
+        SwapRemove(handles, row);
+        SwapRemove(positions, row);
+        SwapRemove(forwards, row);
+        SwapRemove(ups, row);
+        SwapRemove(scales, row);
+        SwapRemove(baseScales, row);
+        SwapRemove(velocities, row);
+        SwapRemove(baseVelocities, row);
+        SwapRemove(angularVelocities, row);
+        SwapRemove(lifetimes, row);
+        SwapRemove(maxLifetimes, row);
+        SwapRemove(colors, row);
+        SwapRemove(startColors, row);
+        SwapRemove(endColors, row);
+        SwapRemove(bindings, row);
+    }
+private:
+    template <typename T>
+    static void SwapRemove(vector<T>& column, size_t row) {
+        if (column.empty()) return;
+        column[row] = column.back();
+        column.pop_back();
+    }
+};
+
+// Where an entity currently lives
+struct EntityLocation {
+    Archetype* archetype = nullptr;
+    size_t row = 0;
+};
+
+// Owns every archetype and maps stable entity handles to their current rows.
+// Handles carry a generation, so handles to destroyed entities are detected instead of aliasing new ones.
+class EntityStore {
+private:
+    struct Slot {
+        Archetype* archetype = nullptr;
+        size_t row = 0;
+        uint32_t generation = 0;
+    };
+    vector<unique_ptr<Archetype>> archetypes;
+    vector<Slot> slots;
+    vector<uint32_t> freeSlots;
+    vector<EntityHandle> expired;
+    // The built-in systems as a graph, for running them across threads
+    JobGraph updateGraph;
+    float graphDeltaTime = 0;
+
+    void BuildUpdateGraph() {
+        // Curves write velocities and read lifetimes, so integration and aging wait for them.
+        // Rotation touches neither and runs alongside.
+        JobGraphNode curves = updateGraph.Add([this]() { ApplyLifetimeCurves(); });
+        updateGraph.Add([this]() { IntegrateVelocity(graphDeltaTime); }, {curves});
+        updateGraph.Add([this]() { IntegrateAngularVelocity(graphDeltaTime); });
+        updateGraph.Add([this]() { AgeLifetimes(graphDeltaTime); }, {curves});
+    }
+public:
+    Archetype* GetArchetype(EntityComponentFlags components) {
+        for (auto& archetype : archetypes) {
+            if (archetype->components == components) return archetype.get();
+        }
+        archetypes.push_back(unique_ptr<Archetype>(new Archetype(components)));
+        return archetypes.back().get();
+    }
+
+    EntityHandle Create(EntityComponentFlags components) {
+        uint32_t index;
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = slots.size();
+            slots.push_back(Slot());
+        }
+        EntityHandle handle;
+        handle.index = index;
+        handle.generation = slots[index].generation;
+        Slot& slot = slots[index];
+        slot.archetype = GetArchetype(components);
+        slot.row = slot.archetype->AddRow(handle);
+        return handle;
+    }
+    void Destroy(EntityHandle handle) {
+        if (!IsAlive(handle)) return;
+        Slot& slot = slots[handle.index];
+        Archetype* archetype = slot.archetype;
+        size_t row = slot.row;
+        archetype->RemoveRow(row);
+        // Point the entity that was moved into the freed row at its new place
+        if (row < archetype->Size()) {
+            slots[archetype->handles[row].index].row = row;
+        }
+        slot.archetype = nullptr;
+        slot.generation++;
+        freeSlots.push_back(handle.index);
+    }
+    bool IsAlive(EntityHandle handle) const {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation && slots[handle.index].archetype != nullptr;
+    }
+    EntityLocation Locate(EntityHandle handle) const {
+        EntityLocation result;
+        if (!IsAlive(handle)) return result;
+        result.archetype = slots[handle.index].archetype;
+        result.row = slots[handle.index].row;
+        return result;
+    }
+
+    // Runs a function on every archetype that has all the required components
+    template <typename Func>
+    void ForEach(EntityComponentFlags required, Func func) {
+        for (auto& archetype : archetypes) {
+            if (archetype->Has(required) && archetype->Size() > 0) func(*archetype);
+        }
+    }
+
+    size_t Count() const {
+        size_t total = 0;
+        for (auto& archetype : archetypes) total += archetype->Size();
+        return total;
+    }
+
+    // Entities whose lifetime ran out during the last AgeLifetimes. They are still alive until destroyed.
+    const vector<EntityHandle>& GetExpired() const {
+        return expired;
+    }
+
+    // ###########
+    // # SYSTEMS #
+    // ###########
+
+    // Fades velocity, scale and color over each entity's lifetime
+    // Velocity goes from baseVelocity down to `finalSpeedFactor` times it, scale from baseScale down to zero,
+    // and color from startColor to endColor.
+    void ApplyLifetimeCurves(float finalSpeedFactor = 0.3f) {
+        ForEach(ENTITY_LIFETIME, [finalSpeedFactor](Archetype& a) {
+            size_t count = a.Size();
+            for (size_t i = 0; i < count; ++i) {
+                float t = a.lifetimes[i] / a.maxLifetimes[i];
+                if (a.components & ENTITY_VELOCITY) a.velocities[i] = a.baseVelocities[i] * (finalSpeedFactor + (1 - finalSpeedFactor) * t);
+                if (a.components & ENTITY_SCALE) a.scales[i] = a.baseScales[i] * t;
+                if (a.components & ENTITY_COLOR) a.colors[i] = a.startColors[i] * t + a.endColors[i] * (1 - t);
+            }
+        });
+    }
+    void IntegrateVelocity(float deltaTime) {
+        ForEach(ENTITY_POSITION | ENTITY_VELOCITY, [deltaTime](Archetype& a) {
+            size_t count = a.Size();
+            vec3* positions = a.positions.data();
+            const vec3* velocities = a.velocities.data();
+            for (size_t i = 0; i < count; ++i) {
+                positions[i] += velocities[i] * deltaTime;
+            }
+        });
+    }
+    // Matches Transform::Rotate
+    void IntegrateAngularVelocity(float deltaTime) {
+        ForEach(ENTITY_ORIENTATION | ENTITY_ANGULAR_VELOCITY, [deltaTime](Archetype& a) {
+            size_t count = a.Size();
+            for (size_t i = 0; i < count; ++i) {
+                vec3 angles = a.angularVelocities[i] * deltaTime;
+                vec3 forward = a.forwards[i];
+                vec3 up = a.ups[i];
+                if (angles.z != 0) { forward = glm::rotateZ(forward, angles.z); up = glm::rotateZ(up, angles.z); }
+                if (angles.y != 0) { forward = glm::rotateY(forward, angles.y); up = glm::rotateY(up, angles.y); }
+                if (angles.x != 0) { forward = glm::rotateX(forward, angles.x); up = glm::rotateX(up, angles.x); }
+                a.forwards[i] = forward;
+                a.ups[i] = up;
+            }
+        });
+    }
+    // Counts lifetimes down and records the entities that ran out in GetExpired
+    void AgeLifetimes(float deltaTime) {
+        expired.clear();
+        ForEach(ENTITY_LIFETIME, [this, deltaTime](Archetype& a) {
+            size_t count = a.Size();
+            for (size_t i = 0; i < count; ++i) {
+                a.lifetimes[i] -= deltaTime;
+                if (a.lifetimes[i] < 0) expired.push_back(a.handles[i]);
+            }
+        });
+    }
+    void DestroyExpired() {
+        for (EntityHandle handle : expired) {
+            Destroy(handle);
+        }
+        expired.clear();
+    }
+
+    // Runs the built-in systems in order
+    void Update(float deltaTime) {
+        ApplyLifetimeCurves();
+        IntegrateVelocity(deltaTime);
+        IntegrateAngularVelocity(deltaTime);
+        AgeLifetimes(deltaTime);
+    }
+    // Same result, with independent systems running on different threads
+    void Update(float deltaTime, JobSystem& jobs) {
+        if (updateGraph.IsEmpty()) BuildUpdateGraph();
+        graphDeltaTime = deltaTime;
+        updateGraph.Run(jobs);
+    }
+};
+
+// ######################
+// # GAMEOBJECT ADAPTER #
+// ######################
+
+// Lets an existing GameObject keep its simulation state in an EntityStore while the rest of the engine
+// (rendering, colliders, lights) keeps reading its Transform. Each frame SyncBindings copies the columns into the
+// bound transforms, and bound objects whose lifetime runs out are disabled, which releases their row.
+// Game classes migrate by moving their Update logic into store columns and systems, one class at a time.
+class EntityBinding : public Component {
+private:
+    EntityStore* store = nullptr;
+    EntityHandle handle;
+protected:
+    void OnDisable(GLProgram*) {
+        Release();
+    }
+public:
+    // If set, receives the entity's color every sync, e.g. an Instance's color attribute
+    vec4* colorTarget = nullptr;
+
+    EntityBinding(EntityStore* store, vec4* colorTarget = nullptr) {
+        this->store = store;
+        this->colorTarget = colorTarget;
+    }
+    ~EntityBinding() {
+        Release();
+    }
+    void Destroy(GLProgram*) {
+        Release();
+    }
+
+    // Creates a fresh row for the owner, seeded from its current transform, and returns its location for further setup
+    EntityLocation Spawn(EntityComponentFlags components) {
+        Release();
+        handle = store->Create(components | ENTITY_BINDING);
+        EntityLocation location = store->Locate(handle);
+        Archetype& a = *location.archetype;
+        a.bindings[location.row] = this;
+        GameObject* owner = GetGameObject();
+        if (owner != nullptr) {
+            if (a.components & ENTITY_POSITION) a.positions[location.row] = owner->transform.GetPosition();
+            if (a.components & ENTITY_ORIENTATION) {
+                a.forwards[location.row] = owner->transform.GetForwardVector();
+                a.ups[location.row] = owner->transform.GetUpVector();
+            }
+            if (a.components & ENTITY_SCALE) {
+                a.scales[location.row] = owner->transform.GetScale();
+                a.baseScales[location.row] = owner->transform.GetScale();
+            }
+        }
+        return location;
+    }
+    void Release() {
+        if (store != nullptr && handle.IsValid()) store->Destroy(handle);
+        handle = EntityHandle();
+    }
+    EntityHandle GetHandle() const {
+        return handle;
+    }
+    EntityLocation Locate() const {
+        return store->Locate(handle);
+    }
+};
+
+// Copies every bound entity's columns into its GameObject, then disables the owners of expired entities
+void SyncBindings(EntityStore& store, GLProgram* context) {
+    store.ForEach(ENTITY_BINDING, [](Archetype& a) {
+        size_t count = a.Size();
+        for (size_t i = 0; i < count; ++i) {
+            EntityBinding* binding = a.bindings[i];
+            if (binding == nullptr) continue;
+            Transform& transform = binding->GetGameObject()->transform;
+            if (a.components & ENTITY_POSITION) transform.SetPosition(a.positions[i]);
+            if (a.components & ENTITY_ORIENTATION) {
+                transform.SetForwardVector(a.forwards[i]);
+                transform.SetUpVector(a.ups[i]);
+            }
+            if (a.components & ENTITY_SCALE) transform.SetScale(a.scales[i]);
+            if ((a.components & ENTITY_COLOR) && binding->colorTarget != nullptr) *binding->colorTarget = a.colors[i];
+        }
+    });
+    // Disabling an owner destroys its row, so collect the owners before touching any of them
+    vector<GameObject*> expiredOwners;
+    for (EntityHandle handle : store.GetExpired()) {
+        EntityLocation location = store.Locate(handle);
+        if (location.archetype == nullptr || !(location.archetype->components & ENTITY_BINDING)) continue;
+        EntityBinding* binding = location.archetype->bindings[location.row];
+        if (binding != nullptr) expiredOwners.push_back(binding->GetGameObject());
+    }
+    for (GameObject* owner : expiredOwners) {
+        owner->SetEnabled(false, context);
+    }
+    store.DestroyExpired();
+}
+
+#endif
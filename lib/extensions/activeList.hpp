@@ -0,0 +1,85 @@
+#ifndef ACTIVE_LIST_HPP
+#define ACTIVE_LIST_HPP
+
+#include <vector>
+
+// Position of an item inside an ActiveList, stored by the item so it can be removed in constant time
+struct ActiveSlot {
+    int index = -1;
+    bool IsActive() const {
+        return index >= 0;
+    }
+};
+
+// Dense, unordered list of the items that are currently active.
+// Items are appended when activated and swap-removed when deactivated, so iterating it only touches live items.
+// While locked (e.g. while it is being iterated), changes are queued and applied on Unlock.
+template <typename T>
+class ActiveList {
+private:
+    struct PendingChange {
+        T* item;
+        ActiveSlot* slot;
+        bool add;
+    };
+    std::vector<T*> items;
+    std::vector<ActiveSlot*> slots;
+    std::vector<PendingChange> pending;
+    bool locked = false;
+
+    void AddNow(T* item, ActiveSlot* slot) {
+        if (slot->IsActive()) return;
+        slot->index = items.size();
+        items.push_back(item);
+        slots.push_back(slot);
+    }
+    void RemoveNow(ActiveSlot* slot) {
+        if (!slot->IsActive()) return;
+        int index = slot->index;
+        items[index] = items.back();
+        slots[index] = slots.back();
+        slots[index]->index = index;
+        items.pop_back();
+        slots.pop_back();
+        slot->index = -1;
+    }
+public:
+    void Add(T* item, ActiveSlot* slot) {
+        if (locked) pending.push_back({item, slot, true});
+        else AddNow(item, slot);
+    }
+    void Remove(ActiveSlot* slot) {
+        if (locked) pending.push_back({nullptr, slot, false});
+        else RemoveNow(slot);
+    }
+
+    void Lock() {
+        locked = true;
+    }
+    void Unlock() {
+        locked = false;
+        for (const PendingChange& change : pending) {
+            if (change.add) AddNow(change.item, change.slot);
+            else RemoveNow(change.slot);
+        }
+        pending.clear();
+    }
+
+    const std::vector<T*>& Items() const {
+        return items;
+    }
+    size_t Size() const {
+        return items.size();
+    }
+    T* At(size_t index) const {
+        return items[index];
+    }
+    typename std::vector<T*>::const_iterator begin() const {
+        return items.begin();
+    }
+    typename std::vector<T*>::const_iterator end() const {
+        return items.end();
+    }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef ALLOCATIONS_HPP
+#define ALLOCATIONS_HPP
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+// Counts every heap allocation made through operator new, so hot paths can be checked for allocations.
+// This replaces the global operator new and delete, so include it from exactly one translation unit per program.
+
+std::atomic<size_t> g_allocationCount(0);
+
+size_t AllocationCount() {
+    return g_allocationCount.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) {
+    g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* result = std::malloc(size == 0 ? 1 : size);
+    if (result == nullptr) throw std::bad_alloc();
+    return result;
+}
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <vector>
 #include <cstdlib>
+#include <stdint.h>
 #include <time.h>
 
 #include "exceptions.hpp"
@@ -113,6 +114,56 @@ vec3 RandomPointAround(vec3 point, float minDistance, float maxDistance) {
     float distance = RandomValue(minDistance, maxDistance);
     return RandomPointAround(point, distance);
 }
+// Small xorshift generator for hot loops such as particle spawning.
+// Much cheaper than rand() and every user can keep its own state, but not suitable for anything security related.
+struct FastRandom {
+    uint32_t state;
+    FastRandom(uint32_t seed = 0x9E3779B9u) {
+        state = seed != 0 ? seed : 0x9E3779B9u;
+    }
+    uint32_t Next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    // Value in the range [0, 1)
+    float Value() {
+        return (Next() >> 8) * (1.0f / 16777216.0f);
+    }
+    // Value in the range [min, max)
+    float Value(float min, float max) {
+        return min + Value() * (max - min);
+    }
+    // Integer in the range [min, max)
+    int Range(int min, int max) {
+        return min + (int)(Next() % (uint32_t)(max - min));
+    }
+    // Same distributions as the RandomPointAround offsets
+    vec2 PointOnCircle(float distance) {
+        float angle = Value(0, PI * 2);
+        return vec2(distance * sin(angle), distance * cos(angle));
+    }
+    vec2 PointInRing(float minDistance, float maxDistance) {
+        return PointOnCircle(Value(minDistance, maxDistance));
+    }
+    vec3 PointOnSphere(float distance) {
+        float angle = Value(0, PI * 2);
+        float z = Value(-1, 1);
+        float angleMagnitude = sqrt(1 - z * z);
+        return vec3(angleMagnitude * cos(angle), angleMagnitude * sin(angle), z) * distance;
+    }
+    vec3 PointInShell(float minDistance, float maxDistance) {
+        return PointOnSphere(Value(minDistance, maxDistance));
+    }
+};
+
+// Shared generator seeded from the clock, for callers that do not need their own state
+FastRandom& GlobalFastRandom() {
+    static FastRandom random((uint32_t)time(NULL));
+    return random;
+}
+
 vec4 RandomPointAround(vec4 point, float distance) {
     throw NotImplementedException("4D uniform random point");
 }
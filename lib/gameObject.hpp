@@ -3,16 +3,21 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtx/rotate_vector.hpp>
+#include <atomic>
 #include <vector>
 #include <functional>
+#include <stdint.h>
 
 #include "shader.hpp"
 #include "geometry/mesh.hpp"
 #include "extensions/event.hpp"
+#include "extensions/activeList.hpp"
 
 using namespace glm;
 using namespace std;
 
+// Plain transform data with no owning members, so copies never allocate.
+// Changes are not broadcast: anything that follows a transform compares its version against the last one it saw.
 class Transform {
 protected:        
     // Where is our camera positioned
@@ -23,12 +28,31 @@ protected:
     // to 'rock' or 'rattle' the camera you might play
     // with modifying this value.
     glm::vec3 upVector;
+    glm::vec3 position;
+    glm::vec3 scale;
+    // Stamped from a global counter on every change, so equal versions always mean equal transforms
+    uint64_t version = 0;
+    // Model matrix built for `modelVersion`
+    mutable glm::mat4 modelMatrix;
+    mutable uint64_t modelVersion = 0;
     glm::vec3 CalcRightVector() const {
         return glm::normalize(glm::cross(forwardVector, upVector));
     }
+    void Changed() {
+        version = NextVersion();
+    }
 public:
-    Event<Transform*, const vec3&, const vec3&> OnMoved;
-    Event<Transform*, const vec3&, const vec3&> OnScaled;
+    // Versions only need to be unique. Threads reserve them in blocks, so parallel updates rarely touch the shared counter.
+    static uint64_t NextVersion() {
+        const uint64_t BLOCK_SIZE = 1024;
+        static std::atomic<uint64_t> counter{0};
+        static thread_local uint64_t next = 0, blockEnd = 0;
+        if (next == blockEnd) {
+            next = counter.fetch_add(BLOCK_SIZE, std::memory_order_relaxed) + 1;
+            blockEnd = next + BLOCK_SIZE;
+        }
+        return next++;
+    }
 
     Transform(vec3 position = {0,0,0}, vec3 forward = {0,0,-1}, vec3 up = {0,1,0}, vec3 scale={1,1,1}) {
         this->position = position;
@@ -36,19 +60,19 @@ public:
         SetForwardVector(forward);
         SetUpVector(up);
     }
-    glm::vec3 position;
-    glm::vec3 scale;
     void SetForwardVector(vec3 newVector, bool adjustUpVector = false) {
         forwardVector = glm::normalize(newVector);
         if (adjustUpVector) {
             upVector = glm::cross(CalcRightVector(), forwardVector);
         }
+        Changed();
     }
     void SetUpVector(vec3 newVector, bool adjustForwardVector = false) {
         upVector = glm::normalize(newVector);
         if (adjustForwardVector) {
             forwardVector = glm::cross(CalcRightVector(), upVector);
         }
+        Changed();
     }
     vec3 GetForwardVector() const {
         return forwardVector;
@@ -85,18 +109,22 @@ public:
     void RotateX(float angle) {
         forwardVector = glm::rotateX(forwardVector, angle);
         upVector = glm::rotateX(upVector, angle);
+        Changed();
     }
     void RotateY(float angle) {
         forwardVector = glm::rotateY(forwardVector, angle);
         upVector = glm::rotateY(upVector, angle);
+        Changed();
     }
     void RotateZ(float angle) {
         forwardVector = glm::rotateZ(forwardVector, angle);
         upVector = glm::rotateZ(upVector, angle);
+        Changed();
     }
     void SetRotation(const vec3& eulerAngles) {
         forwardVector = {0,0,-1};
         upVector = {0,1,0};
+        Changed();
         Rotate(eulerAngles);
     }
 
@@ -105,9 +133,8 @@ public:
         SetPosition(position + delta);
     }
     void SetPosition(const vec3& position) {
-        vec3 oldPos = this->position;
         this->position = position;
-        OnMoved.Invoke(this, oldPos, position);
+        Changed();
     }
     vec3 GetPosition() const {
         return position;
@@ -116,13 +143,15 @@ public:
         SetScale(vec3(scale,scale,scale));
     }
     void SetScale(const vec3& scale) {
-        vec3 oldScale = this->scale;
         this->scale = scale;
-        OnScaled.Invoke(this, oldScale, scale);
+        Changed();
     }
     vec3 GetScale() const {
         return scale;
     }
+    uint64_t GetVersion() const {
+        return version;
+    }
     void MoveForward(float distance) {
         Translate(forwardVector * distance);
     }
@@ -143,8 +172,16 @@ public:
         MoveUp(-distance);
     }
 
-    // Gets the model matrix by applying known transformations to an identity matrix.
-    mat4 GetModelMatrix() const {
+    // Gets the model matrix, rebuilding it only if the transform changed since it was last requested.
+    const mat4& GetModelMatrix() const {
+        if (modelVersion != version || version == 0) {
+            modelMatrix = BuildModelMatrix();
+            modelVersion = version;
+        }
+        return modelMatrix;
+    }
+    // Builds the model matrix by applying known transformations to an identity matrix.
+    mat4 BuildModelMatrix() const {
         mat4 translationMatrix = glm::translate(glm::mat4(), position);
         vec3 rightVector = CalcRightVector();
         // We need to correct the up vector to make sure we have an orthonormal basis
@@ -167,6 +204,7 @@ public:
         Transform result = Transform(*this);
         result.scale *= parent.scale;
         result.position += parent.position;
+        result.Changed();
         mat3 parentRotation = mat3(parent.GetModelMatrix());
         result.SetForwardVector(parentRotation * result.forwardVector);
         result.SetUpVector(parentRotation * result.upVector);
@@ -197,7 +235,8 @@ public:
     Event<Component*> OnEnabled;
     Event<Component*> OnDisabled;
 
-    ~Component() {
+    // Virtual so owners can delete components through Component*, which GameObject::Destroy does
+    virtual ~Component() {
         OnDestroyed.Invoke(this);
     }
 
@@ -231,13 +270,42 @@ private:
     GameObject* parent;
     vector<GameObject*> children;
     bool enabled;
+    // World space cache, rebuilt when this transform or the parent's world transform changes
+    Transform worldTransform;
+    uint64_t worldVersion = 0;
+    uint64_t cachedLocalVersion = 0;
+    uint64_t cachedParentVersion = 0;
+    void UpdateWorldTransform() {
+        uint64_t parentVersion = 0;
+        if (parent != nullptr) {
+            parent->UpdateWorldTransform();
+            parentVersion = parent->worldVersion;
+        }
+        if (worldVersion != 0 && cachedLocalVersion == transform.GetVersion() && cachedParentVersion == parentVersion) return;
+        worldTransform = parent == nullptr ? transform : transform.ToParentSpace(parent->worldTransform);
+        cachedLocalVersion = transform.GetVersion();
+        cachedParentVersion = parentVersion;
+        worldVersion = Transform::NextVersion();
+    }
 public:
     MeshHandle meshHandle;
     string objectName;
     Transform transform;
     Material* material;
+    // Materials for each slot of a multi-material mesh, indexed by its submeshes. Missing slots use `material`.
+    vector<Material*> materials;
     vector<Component*> components;
     bool isInstanced;
+    // Position in the program's list of enabled objects
+    ActiveSlot activeSlot;
+    // Slot in the GameObjectPool that owns this object, or -1
+    int poolIndex = -1;
+    // Objects with this set get ParallelUpdate calls from the program's worker threads
+    bool parallelUpdate = false;
+
+    Event<GameObject*> OnEnabled;
+    Event<GameObject*> OnDisabled;
+
     GameObject(const string& name, const Transform& transform, const MeshHandle& meshHandle = MeshHandle(), Material* material = nullptr, bool isInstanced = false) {
         enabled = true;
         this->objectName = name;
@@ -247,6 +315,11 @@ public:
         this->isInstanced = isInstanced;
         this->parent = nullptr;
     }
+    virtual ~GameObject() = default;
+    Material* GetMaterial(int slot) const {
+        if (slot >= 0 && (size_t)slot < materials.size() && materials[slot] != nullptr) return materials[slot];
+        return material;
+    }
     virtual void Destroy(GLProgram* context) {
         for (Component* c : components) {
             c->Destroy(context);
@@ -254,10 +327,14 @@ public:
         }
     }
     virtual void SetEnabled(bool enabled, GLProgram* context) {
+        bool changed = this->enabled != enabled;
         this->enabled = enabled;
         for (Component* c : components) {
             c->SetEnabled(enabled, context);
         }
+        if (!changed) return;
+        if (enabled) OnEnabled.Invoke(this);
+        else OnDisabled.Invoke(this);
     }
     bool IsEnabled() const {
         return enabled;
@@ -307,6 +384,7 @@ public:
         }
         parent = newParent;
         newParent->children.push_back(this);
+        worldVersion = 0;
     }
 
     virtual void Start(GLProgram* context) {
@@ -320,6 +398,9 @@ public:
             c->Update(context);
         }
     }
+    // Runs alongside other objects' ParallelUpdate calls, after every regular Update of the frame.
+    // It may only change this object's own transform and fields; enabling objects, events and GL calls belong in Update.
+    virtual void ParallelUpdate(GLProgram*) { }
     virtual void Draw(GLProgram* context) {
         for (Component* c : components) {
             if (!c->enabled) continue;
@@ -338,11 +419,14 @@ public:
         component->gameObject = this;
     }
 
-    Transform GetGlobalTransform() {
-        if (parent == nullptr)
-            return transform;
-        else
-            return transform.ToParentSpace(parent->GetGlobalTransform());
+    // World space transform and matrix. Both are cached, so unchanged objects and their children do not rebuild them.
+    const Transform& GetGlobalTransform() {
+        UpdateWorldTransform();
+        return worldTransform;
+    }
+    const mat4& GetWorldMatrix() {
+        UpdateWorldTransform();
+        return worldTransform.GetModelMatrix();
     }
 };
 
@@ -5,14 +5,34 @@
 
 #include "mesh.hpp"
 #include "../gameObject.hpp"
+#include "../extensions/activeList.hpp"
 
 using namespace glm;
  
 struct Instance {
     GameObject* object;
     std::vector<vec4> extraAttribs;
+    // Keeps the instance in its renderer's active list while its object is enabled
+    ActiveList<Instance>* activeList = nullptr;
+    ActiveSlot activeSlot;
+    ObjEventHandler<Instance, GameObject*> OnObjectEnabledHandler;
+    ObjEventHandler<Instance, GameObject*> OnObjectDisabledHandler;
+    static void OnObjectEnabledCallback(Instance* instance, GameObject*) {
+        instance->activeList->Add(instance, &instance->activeSlot);
+    }
+    static void OnObjectDisabledCallback(Instance* instance, GameObject*) {
+        instance->activeList->Remove(&instance->activeSlot);
+    }
     Instance(GameObject* object) {
         this->object = object;
+        OnObjectEnabledHandler = ObjEventHandler<Instance, GameObject*>(this, OnObjectEnabledCallback);
+        OnObjectDisabledHandler = ObjEventHandler<Instance, GameObject*>(this, OnObjectDisabledCallback);
+    }
+    ~Instance() {
+        if (activeList == nullptr) return;
+        activeList->Remove(&activeSlot);
+        object->OnEnabled.RemoveListener(&OnObjectEnabledHandler);
+        object->OnDisabled.RemoveListener(&OnObjectDisabledHandler);
     }
     Instance* AddAttribute(vec4 attrib) {
         extraAttribs.push_back(attrib);
@@ -23,7 +43,7 @@ struct Instance {
             std::cerr << "Instance of " << object->objectName << " with wrong attribute count detected during bulk rendering! Expected " << extraAttribCount << " but instance has " << extraAttribs.size() << " extra attributes." << std::endl;
         }
 
-        mat4 model = object->GetGlobalTransform().GetModelMatrix();
+        mat4 model = object->GetWorldMatrix();
         for (int i = 0; i < 4; ++i)
             target.push_back(model[i]);
         for (int i = 0; i < extraAttribCount; ++i)
@@ -39,6 +59,8 @@ public:
     MeshHandle* globalMesh;
     Material* globalMaterial;
     std::vector<Instance*> instances;
+    // Instances whose objects are enabled, the only ones visited when drawing
+    ActiveList<Instance> activeInstances;
 
     InstancedRenderer() {}
     InstancedRenderer(MeshHandle* mesh, Material* material, GLuint buffer, int extraAttribCount = 0) {
@@ -79,6 +101,10 @@ public:
     InstancedRenderer* AddInstance(Instance* instance) {
         instances.push_back(instance);
         instance->object->isInstanced = true;
+        instance->activeList = &activeInstances;
+        instance->object->OnEnabled.AddListener(&instance->OnObjectEnabledHandler);
+        instance->object->OnDisabled.AddListener(&instance->OnObjectDisabledHandler);
+        if (instance->object->IsEnabled()) activeInstances.Add(instance, &instance->activeSlot);
         return this;
     }
     InstancedRenderer* AddInstances(std::vector<Instance*> instances) {
@@ -89,18 +115,13 @@ public:
         return this;
     }
     bool AnyEnabled() {
-        for (Instance* instance: instances) {
-            if (instance->object->IsEnabled()) return true;
-        }
-        return false;
+        return activeInstances.Size() > 0;
     }
     void Draw(const mat4& vMatrix, const mat4& pMatrix, const mat4& vpMatrix, const vector<LightData*>& lights, float time = 0, bool warnMissingShaderUniforms = false, bool verbose = false) {
         std::vector<vec4> models;
         int enabledInstances = 0;
-        for (int i = 0; i < instances.size(); i++) {
-            if (!instances.at(i)->object->IsEnabled()) continue;
-
-            instances.at(i)->Dump(models, extraVectors);
+        for (Instance* instance : activeInstances) {
+            instance->Dump(models, extraVectors);
             enabledInstances++;
         }
         
@@ -129,13 +150,12 @@ public:
         glBindBuffer(GL_ARRAY_BUFFER, globalMesh->vbo);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, globalMesh->ebo);
         // TEMPORARY WHILE WE FIGURE OUT WHAT'S WRONG WITH INSTANCED RENDERING
-        for (Instance* i : instances) {
-            if (!i->object->IsEnabled()) continue;
+        for (Instance* i : activeInstances) {
             if (i->extraAttribs.size() > 0) {
                 globalShader->SetUniformVector("u_Color", i->extraAttribs.at(0));
                 if (verbose) std::cout << "Setting color attribute of " << i->object->objectName << std::endl;
             }
-            globalShader->SetUniformMatrix("u_ModelMatrix", i->object->GetGlobalTransform().GetModelMatrix(), warnMissingShaderUniforms);
+            globalShader->SetUniformMatrix("u_ModelMatrix", i->object->GetWorldMatrix(), warnMissingShaderUniforms);
             glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(globalMesh->elementCount), GL_UNSIGNED_INT, (void*)0);
         }
         // glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(globalMesh->elementCount), GL_UNSIGNED_INT, (void*)0, enabledInstances);
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/vec3.hpp>
 #include <SDL2/SDL.h>
@@ -23,11 +24,28 @@ struct RefTri {
     }
 };
 
+// A range of a mesh's element buffer that is drawn with a single material.
+// The material index refers to the material slots of whoever owns the mesh (e.g. ObjData::materials)
+struct Submesh {
+    int firstIndex;
+    int indexCount;
+    int materialIndex;
+    Submesh(int firstIndex = 0, int indexCount = 0, int materialIndex = 0) {
+        this->firstIndex = firstIndex;
+        this->indexCount = indexCount;
+        this->materialIndex = materialIndex;
+    }
+};
+
 // Mesh Interface
 class IMesh {
 public:
     virtual vector<GLfloat> GetArrayBuffer(MeshAttributeFlags attributes = MESH_BASIC_AND_COLOR_DATA) const = 0;
     virtual vector<GLuint> GetElementArrayBuffer() const = 0;
+    // Meshes with a single material may leave this empty, the whole element buffer is then drawn at once
+    virtual vector<Submesh> GetSubmeshes() const {
+        return vector<Submesh>();
+    }
 };
 
 // A RefMesh is made to work with element buffers
@@ -36,9 +54,12 @@ public:
 class RefMesh : public IMesh, public VertexDataProvider {
 protected:
     vector<RefTri> triangles;
+    vector<Submesh> submeshes;
 public:
     void AddTri(RefTri vertexIndices) {
+        if (submeshes.empty()) submeshes.push_back(Submesh(0, 0, 0));
         triangles.push_back(vertexIndices);
+        submeshes.back().indexCount += 3;
     }
     void AddTri(int v1, int v2, int v3) {
         AddTri(RefTri(v1, v2, v3));
@@ -55,6 +76,52 @@ public:
     vector<GLfloat> GetArrayBuffer(MeshAttributeFlags attributes = MESH_BASIC_AND_COLOR_DATA) const {
         return DumpData(attributes);
     }
+
+    // Triangles added from now on are drawn with the given material slot
+    void UseMaterial(int materialIndex) {
+        if (!submeshes.empty() && submeshes.back().indexCount == 0) {
+            submeshes.back().materialIndex = materialIndex;
+            return;
+        }
+        submeshes.push_back(Submesh(triangles.size() * 3, 0, materialIndex));
+    }
+    vector<Submesh> GetSubmeshes() const {
+        vector<Submesh> result;
+        for (const Submesh& s : submeshes) {
+            if (s.indexCount > 0) result.push_back(s);
+        }
+        return result;
+    }
+    // Renames every material slot through the given table, indexed by the old slot
+    void RemapMaterials(const vector<int>& newIndices) {
+        for (Submesh& s : submeshes) {
+            s.materialIndex = newIndices.at(s.materialIndex);
+        }
+    }
+    // Reorders the triangles so every material is drawn by one contiguous range, in ascending slot order
+    void GroupByMaterial() {
+        vector<Submesh> ranges = GetSubmeshes();
+        if (ranges.size() <= 1) {
+            submeshes = ranges;
+            return;
+        }
+        int materialCount = 0;
+        for (const Submesh& s : ranges) materialCount = std::max(materialCount, s.materialIndex + 1);
+        vector<RefTri> grouped;
+        grouped.reserve(triangles.size());
+        vector<Submesh> groupedRanges;
+        for (int material = 0; material < materialCount; ++material) {
+            Submesh range(grouped.size() * 3, 0, material);
+            for (const Submesh& s : ranges) {
+                if (s.materialIndex != material) continue;
+                grouped.insert(grouped.end(), triangles.begin() + s.firstIndex / 3, triangles.begin() + (s.firstIndex + s.indexCount) / 3);
+                range.indexCount += s.indexCount;
+            }
+            if (range.indexCount > 0) groupedRanges.push_back(range);
+        }
+        triangles = grouped;
+        submeshes = groupedRanges;
+    }
 };
 
 // A RawMesh is designed to work with a basic Array Buffer
@@ -89,6 +156,8 @@ struct MeshHandle {
     GLuint vbo;
     GLuint ebo;
     int elementCount;
+    // Material ranges of the element buffer, sorted by material. Empty for single-material meshes.
+    vector<Submesh> submeshes;
     MeshHandle(GLuint vao = 0, GLuint vbo = 0, GLuint ebo = 0, int elementCount = 0) {
         this->vao = vao;
         this->vbo = vbo;
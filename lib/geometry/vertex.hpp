@@ -205,6 +205,7 @@ public:
     int NormalCount() const {return normalProvider.size();}
     int ColorCount() const {return colorProvider.size();}
     int TangentCount() const {return tangentProvider.size();}
+    int DataCount() const {return fullDataProvider.size();}
 
     VertexData BuildData(const IndexTuple& indices) const {
         return VertexData::FromVectors(
@@ -20,13 +20,20 @@
 
 #include "shader.hpp"
 #include "gameObject.hpp"
+#include "entities.hpp"
+#include "particles.hpp"
+#include "jobs.hpp"
 #include "geometry/mesh.hpp"
 #include "geometry/vertex.hpp"
 #include "input.hpp"
 #include "extensions/math.hpp"
 #include "readers/ppmReader.hpp"
 #include "readers/mtlReader.hpp"
+#include "readers/packReader.hpp"
 #include "texture.hpp"
+#include "textureCache.hpp"
+#include "mipmaps.hpp"
+#include "assetLoader.hpp"
 #include "camera.hpp"
 #include "geometry/bulk.hpp"
 
@@ -37,6 +44,8 @@ using namespace glm;
 #define MAX(x,y) x > y ? x : y
 
 #define MAX_LIGHTS 50
+// Objects per job in the parallel update phase
+const size_t PARALLEL_UPDATE_GRAIN = 64;
 
 // vvvvvvvvvvvvvvvvvvv Error Handling Routines vvvvvvvvvvvvvvv
 static void GLClearAllErrors(){
@@ -150,11 +159,24 @@ private:
     vector<GLuint> vaos;
     vector<Shader*> builtShaders;
     vector<LightData*> lights;
+    // Lights that are switched on this frame, the only ones sent to shaders
+    vector<LightData*> activeLights;
     GLuint lightsUbo;
     vector<GameObject*> gameObjects;
+    // Enabled objects only. Update, PreDraw and Render walk this list instead of every instantiated object.
+    ActiveList<GameObject> activeObjects;
+    static void OnObjectEnabledCallback(GLProgram* program, GameObject* go) {
+        program->activeObjects.Add(go, &go->activeSlot);
+    }
+    static void OnObjectDisabledCallback(GLProgram* program, GameObject* go) {
+        program->activeObjects.Remove(&go->activeSlot);
+    }
+    ObjEventHandler<GLProgram, GameObject*> OnObjectEnabledHandler = ObjEventHandler<GLProgram, GameObject*>(this, OnObjectEnabledCallback);
+    ObjEventHandler<GLProgram, GameObject*> OnObjectDisabledHandler = ObjEventHandler<GLProgram, GameObject*>(this, OnObjectDisabledCallback);
     vector<Texture2D*> textures;
     vector<Material*> materials;
     vector<InstancedRenderer*> instancedRenderers;
+    vector<ParticleSystem*> particleSystems;
     Shader* defaultShader;
     int screenX;
     int screenY;
@@ -164,6 +186,21 @@ private:
     SDL_Window* window;
     GLenum regularDrawMode = GL_FILL;
 
+    TextureCache textureCache;
+    AssetLoader assetLoader;
+    const AssetPackReader* mountedPack = nullptr;
+
+    // Each material holds one cache reference per distinct texture file it uses
+    void ReleaseMaterialTextures(Material* mat) {
+        unordered_set<GLuint> released;
+        for (const string& name : mat->GetTextureProperties()) {
+            Texture2D tex = mat->GetTexture(name);
+            if (released.find(tex.GetHandle()) != released.end()) continue;
+            released.insert(tex.GetHandle());
+            textureCache.Release(tex);
+        }
+    }
+
     vector<GLuint> GetTextureHandles() {
         vector<GLuint> result; 
         for (Texture2D* tex : textures) {
@@ -179,10 +216,22 @@ public:
 
     float deltaTime = 0.00000001f;
     float time = 0.00000001f;
+    // Worker threads for per-frame work, created along with the program
+    JobSystem jobs;
+    // Column storage for entities updated by systems rather than per-object Update calls
+    EntityStore entities;
     vec2 mouse;
 
     bool wireframeRender = false;
     bool warnMissingShaderUniforms = false;
+
+    // When set, material textures are decoded in the background and uploaded over the following frames.
+    // Until then, they show a blank placeholder.
+    bool streamTextures = false;
+    // Time spent per frame uploading streamed textures
+    float textureUploadBudgetMs = 2.0f;
+    // When set, mipmapped textures are uploaded with a mip chain built on the CPU instead of calling glGenerateMipmap
+    bool precomputeMipmaps = true;
     
     vec4 backgroundColor = {0.3f, 0.0f, 0.75f, 1.0f};
 
@@ -199,14 +248,18 @@ public:
         lastFrameTime, initialTime = chrono::system_clock::now();
     }
     ~GLProgram() {
+        // Background loading, materials and cached textures go first, while the GL context is still alive
+        assetLoader.Shutdown();
+        for (Material* mat : materials) {
+            ReleaseMaterialTextures(mat);
+            delete mat;
+        }
+        textureCache.Clear();
         CleanUp(window, buffers, vaos, builtShaders, GetTextureHandles());
         for (GameObject* go : gameObjects) {
             go->Destroy(this);
             delete go;
         }
-        for (Material* mat : materials) {
-            delete mat;
-        }
     }
     vec2 GetScreenSize() const {
         return vec2(screenX, screenY);
@@ -220,6 +273,13 @@ public:
         builtShaders.push_back(shader);
         return shader;
     }
+    // Update-only pipeline for transform feedback, see CreateTransformFeedbackProgram
+    Shader* BuildFeedbackPipeline(const std::string& vertPath, const std::vector<const char*>& varyings) {
+        string vertSource = LoadShaderAsString(vertPath);
+        Shader* shader = new Shader(CreateTransformFeedbackProgram(vertSource, varyings));
+        builtShaders.push_back(shader);
+        return shader;
+    }
     void SetDefaultShader(Shader* shader) {
         defaultShader = shader;
     }
@@ -289,11 +349,32 @@ public:
         SDL_SetRelativeMouseMode(SDL_TRUE);
 
         // Update all components
-        for (GameObject* go : GetGameObjects()) {
+        // Objects enabled during the loop join the list once it is unlocked, and start updating next frame
+        activeObjects.Lock();
+        for (GameObject* go : activeObjects) {
             if (!go->IsEnabled()) continue;
             // std::cout << "Updating " << go->objectName << "." << std::endl;
             go->Update(this);
         }
+        // Then the objects that opted in update across the workers
+        const vector<GameObject*>& active = activeObjects.Items();
+        jobs.ParallelFor(active.size(), PARALLEL_UPDATE_GRAIN, [this, &active](size_t start, size_t end) {
+            for (size_t i = start; i < end; ++i) {
+                GameObject* go = active[i];
+                if (go->parallelUpdate && go->IsEnabled()) go->ParallelUpdate(this);
+            }
+        });
+        activeObjects.Unlock();
+
+        // Run the entity systems, then copy the results into any GameObjects bound to them.
+        // An empty store has nothing to simulate, so the workers are not even woken up.
+        if (entities.Count() != 0) {
+            entities.Update(deltaTime, jobs);
+            SyncBindings(entities, this);
+        }
+        for (ParticleSystem* particles : particleSystems) {
+            particles->Update(deltaTime);
+        }
     }
 
     // Simulates camera motion based on default inputs
@@ -334,6 +415,21 @@ public:
 
     // Loads mesh data into the program and provides a handle that references the mesh
     MeshHandle LoadMesh(const IMesh* mesh, MeshAttributeFlags attribFlags = MESH_BASIC_AND_COLOR_DATA) {
+        vector<GLfloat> vertices = (*mesh).GetArrayBuffer(attribFlags);
+        //cout << VectorToStr(vertices) << endl;
+        vector<GLuint> elements = (*mesh).GetElementArrayBuffer();
+        MeshHandle result = LoadMeshData(vertices.data(), vertices.size(), elements.data(), elements.size(), attribFlags);
+        result.submeshes = mesh->GetSubmeshes();
+        return result;
+    }
+    // Loads a mesh baked into an asset pack, uploading straight from the mapped file
+    MeshHandle LoadMesh(const PackedMesh* mesh) {
+        MeshHandle result = LoadMeshData(mesh->vertices, mesh->vertexCount * mesh->floatsPerVertex, mesh->indices, mesh->indexCount, mesh->attributes);
+        result.submeshes = mesh->submeshes;
+        return result;
+    }
+    // Loads interleaved vertex data laid out according to the attribute flags, along with its element indices
+    MeshHandle LoadMeshData(const GLfloat* vertices, size_t vertexFloatCount, const GLuint* elements, size_t elementCount, MeshAttributeFlags attribFlags = MESH_BASIC_AND_COLOR_DATA) {
         GLuint vao;
         GLuint vbo;
         GLuint ebo;
@@ -350,24 +446,20 @@ public:
         glGenBuffers(1, &vbo);
         RegisterBuffer(vbo);
         
-        vector<GLfloat> vertices = (*mesh).GetArrayBuffer(attribFlags);
-        //cout << VectorToStr(vertices) << endl;
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
 		glBufferData(GL_ARRAY_BUFFER, // Kind of buffer we are working with 
                                       // (e.g. GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER)
-            vertices.size() * sizeof(GLfloat), 	// Size of data in bytes
-            vertices.data(),          // Raw array of data
+            vertexFloatCount * sizeof(GLfloat), 	// Size of data in bytes
+            vertices,                 // Raw array of data
             GL_STATIC_DRAW);          // How we intend to use the data
 
         glGenBuffers(1, &ebo);
         RegisterBuffer(ebo);
 
-        vector<GLuint> elements = (*mesh).GetElementArrayBuffer();
-
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-            elements.size() * sizeof(GLuint),
-            elements.data(),
+            elementCount * sizeof(GLuint),
+            elements,
             GL_STATIC_DRAW
         );
 
@@ -419,45 +511,82 @@ public:
             glDisableVertexAttribArray(i);
         }
 
-        return MeshHandle(vao, vbo, ebo, elements.size());
+        return MeshHandle(vao, vbo, ebo, elementCount);
     }
 
-    Texture2D LoadTexture(const Image* image, GLenum wrapMode=GL_REPEAT, GLenum minFilter=GL_LINEAR_MIPMAP_LINEAR, GLenum magFilter=GL_LINEAR, bool invertY = true, bool invertX = false) {
+    // Uploads an image as a new texture.
+    // If the image must be flipped, a flipped copy is made first. Callers that own the image can
+    // flip it in place with Image::Flip and pass invertY = false to upload straight from its buffer.
+    // Pass srgb = false for data textures (e.g. normal maps) so their mip levels are filtered linearly.
+    Texture2D LoadTexture(const Image* image, GLenum wrapMode=GL_REPEAT, GLenum minFilter=GL_LINEAR_MIPMAP_LINEAR, GLenum magFilter=GL_LINEAR, bool invertY = true, bool invertX = false, bool srgb = true) {
+        const Image* source = image;
+        Image flipped;
+        if (invertY || invertX) {
+            flipped = *image;
+            flipped.Flip(invertY, invertX);
+            source = &flipped;
+        }
         GLuint handle;
         glGenTextures(1, &handle);
-        glBindTexture(GL_TEXTURE_2D, handle);
-        // Set wrapping and filtering
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-        // Push the image pixel data to the GPU
-        vector<unsigned char> rawData;
-        image->Dump(rawData, invertY, invertX);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image->width, image->height, 0, GL_RGB, GL_UNSIGNED_BYTE, rawData.data());
-        glGenerateMipmap(GL_TEXTURE_2D);
-        // Unbind the texture
-        glBindTexture(GL_TEXTURE_2D, 0);
-        return Texture2D(handle, image->width, image->height);
+        if (precomputeMipmaps && UsesMipmaps(minFilter)) {
+            vector<Image> levels = BuildMipChain(*source, srgb);
+            vector<ImageView> views = ViewLevels(levels);
+            return UploadTextureLevels(handle, views.data(), views.size(), wrapMode, minFilter, magFilter);
+        }
+        return UploadTexture(handle, *source, source->data.data(), wrapMode, minFilter, magFilter);
+    }
+
+    // Reserves a texture handle holding a blank placeholder and streams the file's contents into it in the background.
+    // The texture is filled during a later PreDraw, see textureUploadBudgetMs.
+    Texture2D LoadTextureStreamed(const string& file, const SamplerState& sampler,
+        std::function<bool(GLuint)> isWanted = nullptr, std::function<void(const Texture2D&)> onUploaded = nullptr) {
+        Image placeholder = Image::Solid(Pixel(255,255,255));
+        GLuint handle;
+        glGenTextures(1, &handle);
+        Texture2D result = UploadTexture(handle, placeholder, placeholder.data.data(), sampler.wrapMode, sampler.minFilter, sampler.magFilter);
+        assetLoader.StreamTexture(file, handle, sampler, isWanted, onUploaded, precomputeMipmaps);
+        return result;
     }
 
     // This will load a material from its description using relevant files
-    // The program will delete the pointer on completion
+    // Texture files are shared through the program's texture cache, so each one is only decoded once.
+    // Textures found in the mounted asset pack are uploaded from it, along with their precomputed mip chain.
+    // The program will delete the pointer on completion, or earlier through DestroyMaterial.
     Material* LoadRawMtl(const RawMtl& mtlData, Shader* shader, const Texture2D& blankTexture, const Texture2D& defaultNormalMap, bool invertY = true, bool invertX = false,
         GLenum wrapMode=GL_REPEAT, GLenum minFilter=GL_LINEAR_MIPMAP_LINEAR, GLenum magFilter=GL_LINEAR) {
+        SamplerState sampler(wrapMode, minFilter, magFilter, invertY, invertX);
         unordered_map<string, Texture2D> texturesByFile;
         texturesByFile[""] = blankTexture;
         auto files = mtlData.GetFileNames();
         for (string s : files) {
             // If there is no file to read, do nothing
             if (s == "") continue;
-            // If we have already read the file, do nothing
+            // If this material already references the file, do nothing
             if (texturesByFile.find(s) != texturesByFile.end()) continue;
             // If we find a PPM file, read it and dump its data into a Texture
             if (EndsWith(s,".ppm")) {
-                Image img = PpmReader::ReadPpm(s);
-                //cout << img.ToString() << endl;
-                texturesByFile[s] = LoadTexture(&img, wrapMode, minFilter, magFilter, invertY, invertX);
+                // Normal maps hold directions rather than colors
+                SamplerState fileSampler = sampler;
+                fileSampler.srgb = s != mtlData.normalMapFile;
+                texturesByFile[s] = textureCache.Acquire(s, fileSampler, [&](uint64_t generation) {
+                    PackedTexture packed;
+                    if (mountedPack != nullptr && mountedPack->GetTexture(s, packed) && packed.invertY == invertY && packed.invertX == invertX) {
+                        GLuint handle;
+                        glGenTextures(1, &handle);
+                        return UploadTextureLevels(handle, packed.levels.data(), UsesMipmaps(minFilter) ? packed.levels.size() : 1, wrapMode, minFilter, magFilter);
+                    }
+                    if (streamTextures) {
+                        return LoadTextureStreamed(s, fileSampler,
+                            [this, generation](GLuint handle) { return textureCache.IsCurrent(Texture2D(handle), generation); },
+                            [this](const Texture2D& uploaded) { textureCache.Refresh(uploaded); }
+                        );
+                    }
+                    Image img = PpmReader::ReadPpm(s);
+                    //cout << img.ToString() << endl;
+                    // We own the decoded image, so flip it in place and upload without another copy
+                    img.Flip(invertY, invertX);
+                    return LoadTexture(&img, wrapMode, minFilter, magFilter, false, false, fileSampler.srgb);
+                });
             } else {
                 std::cerr << "Unable to read texture file " << s << ", no decoder for its format is implemented." << endl;
             }
@@ -479,6 +608,33 @@ public:
         return result;
     }
 
+    // Loads one material per slot of a multi-material mesh, see GameObject::materials
+    vector<Material*> LoadRawMtls(const vector<RawMtl>& mtlData, Shader* shader, const Texture2D& blankTexture, const Texture2D& defaultNormalMap) {
+        vector<Material*> result;
+        for (const RawMtl& mtl : mtlData) {
+            result.push_back(LoadRawMtl(mtl, shader, blankTexture, defaultNormalMap));
+        }
+        return result;
+    }
+
+    // Deletes a material owned by the program, releasing its references to cached textures.
+    // Textures no longer used by any material are removed from the GPU.
+    void DestroyMaterial(Material* mat) {
+        if (!Remove(materials, mat)) return;
+        ReleaseMaterialTextures(mat);
+        delete mat;
+    }
+    // Serves textures from an asset pack before falling back to their files. The pack must stay open while mounted.
+    void MountPack(const AssetPackReader* pack) {
+        mountedPack = pack;
+    }
+    TextureCache& GetTextureCache() {
+        return textureCache;
+    }
+    AssetLoader& GetAssetLoader() {
+        return assetLoader;
+    }
+
     // This will add the material to the program's context, allowing it to handle its lifetime without the user's input
     void RegisterExternalMaterial(Material* mat) {
         materials.push_back(mat);
@@ -498,12 +654,21 @@ public:
         glViewport(0, 0, screenX, screenY);
         glClearColor(backgroundColor.r, backgroundColor.g, backgroundColor.b, backgroundColor.a);
 
-        for (GameObject* go : GetGameObjects()) {
+        // Finish any streamed texture uploads that fit in this frame's budget
+        assetLoader.ProcessUploads(textureUploadBudgetMs);
+
+        activeObjects.Lock();
+        for (GameObject* go : activeObjects) {
             if (!go->IsEnabled()) continue;
             go->PreDraw(this);
         }
+        activeObjects.Unlock();
 
-        LoadLightData(lights);
+        activeLights.clear();
+        for (LightData* light : lights) {
+            if (light->active) activeLights.push_back(light);
+        }
+        LoadLightData(activeLights);
 
         //Clear color buffer and Depth Buffer
         glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
@@ -513,18 +678,34 @@ public:
     void Instantiate(GameObject* gameObject) {
         std::cout << "Instantiating " << gameObject->objectName << "." << std::endl;
         gameObjects.push_back(gameObject);
+        gameObject->OnEnabled.AddListener(&OnObjectEnabledHandler);
+        gameObject->OnDisabled.AddListener(&OnObjectDisabledHandler);
+        if (gameObject->IsEnabled()) activeObjects.Add(gameObject, &gameObject->activeSlot);
     }
-    vector<GameObject*> GetGameObjects() const {
+    // Every instantiated object, enabled or not
+    const vector<GameObject*>& GetGameObjects() const {
         return gameObjects;
     }
+    const ActiveList<GameObject>& GetActiveObjects() const {
+        return activeObjects;
+    }
 
     // Registering bulk objects to automatically render them
     void Instantiate(InstancedRenderer* renderer) {
         instancedRenderers.push_back(renderer);
     }
+    // Registering a particle system updates and draws it every frame
+    void Instantiate(ParticleSystem* particles) {
+        particles->jobs = &jobs;
+        particleSystems.push_back(particles);
+    }
 
     void AddLight(LightData* lightData) {
         //cout << "Light added!" << endl;
+        // Pooled objects may start their lights more than once
+        for (LightData* light : lights) {
+            if (light == lightData) return;
+        }
         lights.push_back(lightData);
     }
     void RemoveLight(LightData* lightData) {
@@ -566,10 +747,10 @@ public:
         delete[] rawData;
     }
 
-    // Draw one specific gameObject, for optimization reasons, we precompute view, projection, and vpMatrices.
-    void Draw(GameObject& gameObject, const mat4& vMatrix, const mat4& pMatrix, const mat4& vpMatrix) {
-        // Use the gameObject's specific shader, or the default if it's not set (set to 0).
-        Shader* goShader = gameObject.material->shader->GetHandle() == 0 ? defaultShader : gameObject.material->shader;
+    // Binds a material's shader and sets the uniforms shared by every material of a gameObject
+    Shader* UseShader(Material* material, GameObject& gameObject, const mat4& vMatrix, const mat4& pMatrix, const mat4& vpMatrix) {
+        // Use the material's specific shader, or the default if it's not set (set to 0).
+        Shader* goShader = material->shader->GetHandle() == 0 ? defaultShader : material->shader;
         goShader->Use();
 
         //std::cout << "Using shader " << goShader->GetHandle() << ".";
@@ -583,21 +764,40 @@ public:
         // Update the Time Uniform
         goShader->SetUniformValue("u_Time", time, warnMissingShaderUniforms);
         //cout << "Drawing gameObject " << gameObject.objectName << ", with " << gameObject.meshHandle.elementCount << " elements" << endl;
-        goShader->SetUniformMatrix("u_ModelMatrix", gameObject.transform.GetModelMatrix(), warnMissingShaderUniforms);
-
-        //cout << "Setting material properties for: " << gameObject.objectName << endl;
-        gameObject.material->SetMaterialProperties(warnMissingShaderUniforms);
+        goShader->SetUniformMatrix("u_ModelMatrix", gameObject.GetWorldMatrix(), warnMissingShaderUniforms);
 
         //goShader->SetLightUniforms(lightsUbo, MAX_LIGHTS);
-        goShader->SetLightUniformsRaw(lights);
-        
-        //std::cout << "Set all uniforms for rendering object " << gameObject.objectName << ".";
-
-        glBindVertexArray(gameObject.meshHandle.vao);
-        glBindBuffer(GL_ARRAY_BUFFER, gameObject.meshHandle.vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gameObject.meshHandle.ebo);
+        goShader->SetLightUniformsRaw(activeLights);
+        return goShader;
+    }
 
-        glDrawElements(GL_TRIANGLES, gameObject.meshHandle.elementCount, GL_UNSIGNED_INT, (void*)0);
+    // Draw one specific gameObject, for optimization reasons, we precompute view, projection, and vpMatrices.
+    // Multi-material meshes bind their buffers once and draw one element range per material.
+    void Draw(GameObject& gameObject, const mat4& vMatrix, const mat4& pMatrix, const mat4& vpMatrix) {
+        const MeshHandle& mesh = gameObject.meshHandle;
+        glBindVertexArray(mesh.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+
+        if (mesh.submeshes.size() <= 1) {
+            UseShader(gameObject.material, gameObject, vMatrix, pMatrix, vpMatrix);
+            //cout << "Setting material properties for: " << gameObject.objectName << endl;
+            gameObject.material->SetMaterialProperties(warnMissingShaderUniforms);
+            //std::cout << "Set all uniforms for rendering object " << gameObject.objectName << ".";
+            glDrawElements(GL_TRIANGLES, mesh.elementCount, GL_UNSIGNED_INT, (void*)0);
+        } else {
+            // Submeshes are grouped by material when loaded, so the shader only changes between materials that use different ones
+            Shader* boundShader = nullptr;
+            for (const Submesh& submesh : mesh.submeshes) {
+                Material* mat = gameObject.GetMaterial(submesh.materialIndex);
+                if (mat->shader != boundShader) {
+                    UseShader(mat, gameObject, vMatrix, pMatrix, vpMatrix);
+                    boundShader = mat->shader;
+                }
+                mat->SetMaterialProperties(warnMissingShaderUniforms);
+                glDrawElements(GL_TRIANGLES, submesh.indexCount, GL_UNSIGNED_INT, (void*)(submesh.firstIndex * sizeof(GLuint)));
+            }
+        }
         
         gameObject.Draw(this);
     }
@@ -610,21 +810,26 @@ public:
         mat4 vMatrix = camera.GetViewMatrix();
         mat4 pMatrix = camera.GetProjectionMatrix(GetScreenSize());
         mat4 vpMatrix = camera.GetVPMatrix(GetScreenSize());
-        for (int i = 0; i < gameObjects.size(); i++) {
-            if (verbose) cout << "Drawing " << gameObjects.at(i)->objectName << "...";
-            auto go = gameObjects.at(i);
+        activeObjects.Lock();
+        for (GameObject* go : activeObjects) {
             // Ensure object is enabled
             if (!go->IsEnabled()) continue;
             if (go->isInstanced && drawInstancedWithRenderers) continue;
-            Draw(*(gameObjects.at(i)), vMatrix, pMatrix, vpMatrix);
+            if (verbose) cout << "Drawing " << go->objectName << "...";
+            Draw(*go, vMatrix, pMatrix, vpMatrix);
             if (verbose) cout << "Drawn." << endl;
         }
+        activeObjects.Unlock();
         if (drawInstancedWithRenderers) {
             for (int i = 0; i < instancedRenderers.size(); i++) {
-                instancedRenderers.at(i)->Draw(vMatrix, pMatrix, vpMatrix, lights, time, warnMissingShaderUniforms, verbose);
+                instancedRenderers.at(i)->Draw(vMatrix, pMatrix, vpMatrix, activeLights, time, warnMissingShaderUniforms, verbose);
                 //std::cout << "Stepped outside of instanced rendering" << std::endl;
             }
         }
+        for (ParticleSystem* particles : particleSystems) {
+            if (verbose) cout << "Drawing " << particles->Count() << " particles." << endl;
+            particles->Draw(vMatrix, pMatrix, vpMatrix, time, warnMissingShaderUniforms);
+        }
         if (verbose) cout << "Completed Draw" << endl;
         glUseProgram(0);
         if (swapWindow) {
@@ -0,0 +1,230 @@
+#ifndef GPU_PARTICLES_HPP
+#define GPU_PARTICLES_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+
+#include "particles.hpp"
+#include "shader.hpp"
+#include "geometry/mesh.hpp"
+
+using namespace glm;
+
+// #######################
+// # GPU PARTICLE SYSTEM #
+// #######################
+// Particles that live entirely in GPU memory. Every particle is one record of PARTICLE_COLUMN_COUNT floats,
+// laid out in column order (position, velocity, angles, angular velocity, scale, life, 1 / max life, start and end colors).
+// Emitting only writes new records into a ring buffer; a transform feedback pass advances every record from one
+// buffer into the other, and the draw reads the updated buffer directly as per-instance data.
+// Without transform feedback (e.g. no GL context), it falls back to the CPU ParticleSystem.
+
+// Vertex shader outputs captured by the update pass, in record order. See vert_particles_update.glsl
+const std::vector<const char*> PARTICLE_FEEDBACK_VARYINGS = {
+    "o_Position", "o_Velocity", "o_Angles", "o_AngularVelocity", "o_Lifetime", "o_StartColor", "o_EndColor"
+};
+
+class GpuParticleSystem : public ParticleSystem {
+private:
+    bool gpu = false;
+    Material* gpuMaterial = nullptr;
+    Shader* updateShader = nullptr;
+    // Ping-pong state: the update pass reads stateBuffers[current] and writes the other one
+    GLuint stateBuffers[2] = {0, 0};
+    GLuint updateVaos[2] = {0, 0};
+    int current = 0;
+
+    // Records emitted since the last update, uploaded starting at slot pendingStart
+    std::vector<float> pendingRecords;
+    size_t pendingStart = 0;
+    // Next slot to be written. Once the ring is full, new particles replace the oldest ones.
+    size_t head = 0;
+    // Slots that have ever held a particle, the only ones updated and drawn
+    size_t usedSlots = 0;
+    // Time at which the particle in each slot expires, so the CPU can tell when there is nothing left to simulate
+    std::vector<float> expiry;
+    float simulationTime = 0;
+    float aliveUntil = 0;
+
+    static const GLsizei RECORD_SIZE = PARTICLE_COLUMN_COUNT * sizeof(GLfloat);
+
+    static void StateAttribute(GLuint location, GLint size, ParticleColumn column) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, RECORD_SIZE, (void*)(column * sizeof(GLfloat)));
+    }
+
+    void InitializeBuffers() {
+        std::vector<float> zeroes(capacity * PARTICLE_COLUMN_COUNT, 0.0f);
+        glGenBuffers(2, stateBuffers);
+        glGenVertexArrays(2, updateVaos);
+        for (int i = 0; i < 2; ++i) {
+            glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[i]);
+            // Zeroed records have no life left, so they are drawn with a scale of 0
+            glBufferData(GL_ARRAY_BUFFER, zeroes.size() * sizeof(GLfloat), zeroes.data(), GL_DYNAMIC_COPY);
+            glBindVertexArray(updateVaos[i]);
+            StateAttribute(0, 3, PARTICLE_PX);
+            StateAttribute(1, 3, PARTICLE_VX);
+            StateAttribute(2, 3, PARTICLE_AX);
+            StateAttribute(3, 3, PARTICLE_WX);
+            StateAttribute(4, 3, PARTICLE_SCALE);
+            StateAttribute(5, 4, PARTICLE_START_R);
+            StateAttribute(6, 4, PARTICLE_END_R);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindVertexArray(mesh->vao);
+        for (int i = 0; i < 5; ++i) {
+            glVertexAttribDivisor(PARTICLE_INSTANCE_LAYOUT_START + i, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    // Copies the pending records into the current state buffer, wrapping around its end
+    void UploadPending() {
+        size_t recordCount = pendingRecords.size() / PARTICLE_COLUMN_COUNT;
+        if (recordCount == 0) return;
+        glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[current]);
+        size_t slot = pendingStart;
+        size_t uploaded = 0;
+        while (uploaded < recordCount) {
+            size_t run = std::min(recordCount - uploaded, capacity - slot);
+            glBufferSubData(GL_ARRAY_BUFFER, slot * RECORD_SIZE, run * RECORD_SIZE, pendingRecords.data() + uploaded * PARTICLE_COLUMN_COUNT);
+            uploaded += run;
+            slot = (slot + run) % capacity;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        pendingRecords.clear();
+    }
+public:
+    // material draws the fallback, with the same layout as ParticleSystem (e.g. vert_unlit_instanced_colored.glsl).
+    // gpuMaterial draws the state records (vert_particles_gpu.glsl), updateShader advances them (vert_particles_update.glsl).
+    GpuParticleSystem(size_t capacity, MeshHandle* mesh, Material* material, Material* gpuMaterial, Shader* updateShader) {
+        this->mesh = mesh;
+        this->material = material;
+        this->gpuMaterial = gpuMaterial;
+        this->updateShader = updateShader;
+        gpu = IsSupported(updateShader);
+        if (gpu) {
+            this->capacity = capacity;
+            expiry.resize(capacity, 0.0f);
+            InitializeBuffers();
+        } else {
+            Allocate(capacity);
+            // Headless runs have no context to render with
+            if (mesh != nullptr && glGenBuffers != nullptr) InitializeRendering();
+        }
+    }
+    // A system without rendering, always simulated on the CPU
+    GpuParticleSystem(size_t capacity) : ParticleSystem(capacity) {}
+    ~GpuParticleSystem() {
+        if (!gpu) return;
+        glDeleteBuffers(2, stateBuffers);
+        glDeleteVertexArrays(2, updateVaos);
+    }
+
+    // Transform feedback needs a GL 3.0+ context and an update shader that linked
+    static bool IsSupported(Shader* updateShader) {
+        return glBeginTransformFeedback != nullptr && updateShader != nullptr && updateShader->GetHandle() != 0;
+    }
+    bool IsGpu() const {
+        return gpu;
+    }
+
+    bool Emit(const ParticleParams& params) override {
+        if (!gpu) return ParticleSystem::Emit(params);
+        if (pendingRecords.empty()) pendingStart = head;
+        float record[PARTICLE_COLUMN_COUNT] = {
+            params.position.x, params.position.y, params.position.z,
+            params.velocity.x, params.velocity.y, params.velocity.z,
+            params.angles.x, params.angles.y, params.angles.z,
+            params.angularVelocity.x, params.angularVelocity.y, params.angularVelocity.z,
+            params.scale, params.lifetime, 1 / params.lifetime,
+            params.startColor.r, params.startColor.g, params.startColor.b, params.startColor.a,
+            params.endColor.r, params.endColor.g, params.endColor.b, params.endColor.a
+        };
+        pendingRecords.insert(pendingRecords.end(), record, record + PARTICLE_COLUMN_COUNT);
+
+        // Taking over a live particle counts as dropping it
+        if (expiry[head] > simulationTime) dropped++;
+        expiry[head] = simulationTime + params.lifetime;
+        aliveUntil = std::max(aliveUntil, expiry[head]);
+        head = (head + 1) % capacity;
+        usedSlots = std::max(usedSlots, head == 0 ? capacity : head);
+        return true;
+    }
+    void Clear() override {
+        if (!gpu) {
+            ParticleSystem::Clear();
+            return;
+        }
+        pendingRecords.clear();
+        std::fill(expiry.begin(), expiry.end(), 0.0f);
+        std::vector<float> zeroes(capacity * PARTICLE_COLUMN_COUNT, 0.0f);
+        glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[current]);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, zeroes.size() * sizeof(GLfloat), zeroes.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        aliveUntil = simulationTime;
+    }
+
+    void Update(float deltaTime) override {
+        if (!gpu) {
+            ParticleSystem::Update(deltaTime);
+            return;
+        }
+        UploadPending();
+        bool anyAlive = aliveUntil > simulationTime;
+        simulationTime += deltaTime;
+        if (!anyAlive) return;
+
+        updateShader->Use();
+        updateShader->SetUniformValue("u_DeltaTime", deltaTime);
+        updateShader->SetUniformValue("u_FinalSpeedFactor", finalSpeedFactor);
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(updateVaos[current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, stateBuffers[1 - current]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, usedSlots);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        current = 1 - current;
+    }
+
+    // On the GPU this counts the particles that have not expired yet, from their emission records
+    size_t Count() const override {
+        if (!gpu) return ParticleSystem::Count();
+        size_t alive = 0;
+        for (size_t i = 0; i < usedSlots; ++i) {
+            if (expiry[i] > simulationTime) alive++;
+        }
+        return alive;
+    }
+
+    void Draw(const mat4& vMatrix, const mat4& pMatrix, const mat4& vpMatrix, float time = 0, bool warnMissingShaderUniforms = false) override {
+        if (!gpu) {
+            ParticleSystem::Draw(vMatrix, pMatrix, vpMatrix, time, warnMissingShaderUniforms);
+            return;
+        }
+        if (usedSlots == 0 || aliveUntil <= simulationTime || gpuMaterial == nullptr) return;
+        SetDrawUniforms(gpuMaterial, vMatrix, pMatrix, vpMatrix, time, warnMissingShaderUniforms);
+
+        // The state buffers swap every frame, so the instance attributes are pointed at the latest one
+        glBindVertexArray(mesh->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[current]);
+        StateAttribute(PARTICLE_INSTANCE_LAYOUT_START + 0, 3, PARTICLE_PX);
+        StateAttribute(PARTICLE_INSTANCE_LAYOUT_START + 1, 3, PARTICLE_AX);
+        StateAttribute(PARTICLE_INSTANCE_LAYOUT_START + 2, 3, PARTICLE_SCALE);
+        StateAttribute(PARTICLE_INSTANCE_LAYOUT_START + 3, 4, PARTICLE_START_R);
+        StateAttribute(PARTICLE_INSTANCE_LAYOUT_START + 4, 4, PARTICLE_END_R);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(mesh->elementCount), GL_UNSIGNED_INT, (void*)0, usedSlots);
+        glBindVertexArray(0);
+    }
+};
+
+#endif
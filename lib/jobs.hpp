@@ -0,0 +1,365 @@
+#ifndef JOBS_HPP
+#define JOBS_HPP
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <condition_variable>
+
+// ##############
+// # JOB SYSTEM #
+// ##############
+// A pool of worker threads for short, frame-bound work (as opposed to the AssetLoader, which runs long file jobs).
+// Every worker owns a deque: it pushes and pops its own jobs at the bottom without locks, and idle workers steal
+// from the top of the others'. The thread that creates the system owns a deque too and helps while it waits.
+// Jobs are plain structs owned by whoever submits them, so splitting work does not allocate.
+
+struct Job;
+
+// Counts the jobs of a batch that have not finished yet
+struct JobCounter {
+    std::atomic<int> pending{0};
+    bool IsDone() const {
+        return pending.load(std::memory_order_acquire) <= 0;
+    }
+};
+
+struct Job {
+    void (*run)(Job*) = nullptr;
+    void* context = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    JobCounter* counter = nullptr;
+};
+
+// Chase-Lev deque with a fixed capacity. Push and Pop may only be called by the owning thread, Steal by any thread.
+class JobDeque {
+private:
+    static const int64_t CAPACITY = 4096;
+    static const int64_t MASK = CAPACITY - 1;
+    std::atomic<int64_t> top{0};
+    std::atomic<int64_t> bottom{0};
+    std::atomic<Job*> buffer[CAPACITY];
+public:
+    // Returns false if the deque is full
+    bool Push(Job* job) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY) return false;
+        buffer[b & MASK].store(job, std::memory_order_relaxed);
+        // Publishes the job to thieves, which read bottom with acquire
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+    // Takes the newest job, or nullptr if there is none
+    Job* Pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Job* job = buffer[b & MASK].load(std::memory_order_relaxed);
+        if (t == b) {
+            // Last job, race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+    // Takes the oldest job, or nullptr if there is none or another thread got it first
+    Job* Steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        Job* job = buffer[t & MASK].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+        return job;
+    }
+};
+
+class JobSystem {
+private:
+    // Deque 0 belongs to the thread that created the system, deque i + 1 to workers[i]
+    std::vector<std::unique_ptr<JobDeque>> deques;
+    std::vector<std::thread> workers;
+    // Jobs submitted from threads without a deque
+    std::deque<Job*> injected;
+    std::mutex injectedMutex;
+    std::atomic<int> injectedCount{0};
+
+    // Jobs waiting in any queue, so idle workers know when to sleep
+    std::atomic<int> queued{0};
+    std::atomic<int> sleeping{0};
+    std::mutex sleepMutex;
+    std::condition_variable workAvailable;
+    std::atomic<bool> stopping{false};
+
+    static const int SPINS_BEFORE_SLEEP = 64;
+
+    struct ThreadIdentity {
+        JobSystem* system = nullptr;
+        int index = -1;
+    };
+    static ThreadIdentity& CurrentThread() {
+        static thread_local ThreadIdentity identity;
+        return identity;
+    }
+    // Index of the calling thread's deque, or -1 if it does not have one
+    int ThreadIndex() {
+        ThreadIdentity& identity = CurrentThread();
+        return identity.system == this ? identity.index : -1;
+    }
+
+    Job* FindJob(int index) {
+        Job* job = nullptr;
+        if (index >= 0) job = deques[index]->Pop();
+        if (job == nullptr && injectedCount.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> lock(injectedMutex);
+            if (!injected.empty()) {
+                job = injected.front();
+                injected.pop_front();
+                injectedCount.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        if (job == nullptr) {
+            // Start stealing from the next deque, so thieves spread out over the victims
+            size_t count = deques.size();
+            size_t start = index >= 0 ? index + 1 : 0;
+            for (size_t i = 0; i < count && job == nullptr; ++i) {
+                size_t victim = (start + i) % count;
+                if ((int)victim == index) continue;
+                job = deques[victim]->Steal();
+            }
+        }
+        if (job != nullptr) queued.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    }
+    static void Execute(Job* job) {
+        JobCounter* counter = job->counter;
+        job->run(job);
+        // The job may be gone once its counter drops
+        if (counter != nullptr) counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    void WorkerLoop(int index) {
+        CurrentThread().system = this;
+        CurrentThread().index = index;
+        int idle = 0;
+        while (!stopping.load(std::memory_order_acquire)) {
+            Job* job = FindJob(index);
+            if (job != nullptr) {
+                Execute(job);
+                idle = 0;
+                continue;
+            }
+            if (++idle < SPINS_BEFORE_SLEEP) {
+                std::this_thread::yield();
+                continue;
+            }
+            idle = 0;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            workAvailable.wait(lock, [this]() {
+                return queued.load(std::memory_order_seq_cst) > 0 || stopping.load(std::memory_order_seq_cst);
+            });
+            sleeping.fetch_sub(1, std::memory_order_seq_cst);
+        }
+    }
+
+    template <typename Func>
+    static void RunRange(Job* job) {
+        (*(const Func*)job->context)(job->begin, job->end);
+    }
+public:
+    // Upper bound on the chunks of a single ParallelFor, which keeps its jobs on the stack
+    static constexpr size_t MAX_PARALLEL_CHUNKS = 256;
+
+    JobSystem(int workerCount = -1) {
+        if (workerCount < 0) {
+            workerCount = (int)std::thread::hardware_concurrency() - 1;
+        }
+        if (workerCount < 0) workerCount = 0;
+        for (int i = 0; i <= workerCount; ++i) {
+            deques.push_back(std::unique_ptr<JobDeque>(new JobDeque()));
+        }
+        CurrentThread().system = this;
+        CurrentThread().index = 0;
+        for (int i = 1; i <= workerCount; ++i) {
+            workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+        }
+    }
+    ~JobSystem() {
+        Shutdown();
+    }
+
+    // Stops the workers. Jobs still queued are not run.
+    void Shutdown() {
+        if (stopping.exchange(true)) return;
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        workAvailable.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+        if (CurrentThread().system == this) CurrentThread().system = nullptr;
+    }
+
+    // Threads that run jobs, including the one that created the system
+    size_t ThreadCount() const {
+        return workers.size() + 1;
+    }
+
+    // Queues a job. The caller keeps it alive until its counter reaches zero.
+    void Submit(Job* job) {
+        int index = ThreadIndex();
+        bool pushed = false;
+        if (index >= 0) {
+            pushed = deques[index]->Push(job);
+        } else {
+            std::lock_guard<std::mutex> lock(injectedMutex);
+            injected.push_back(job);
+            injectedCount.fetch_add(1, std::memory_order_release);
+            pushed = true;
+        }
+        if (!pushed) {
+            // Our deque is full, the job is better off running right now
+            Execute(job);
+            return;
+        }
+        queued.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            workAvailable.notify_one();
+        }
+    }
+
+    // Runs queued jobs on the calling thread until every job of the counter is done
+    void Wait(JobCounter& counter) {
+        int index = ThreadIndex();
+        while (!counter.IsDone()) {
+            Job* job = FindJob(index);
+            if (job != nullptr) Execute(job);
+            else std::this_thread::yield();
+        }
+    }
+
+    // Calls func(begin, end) over [0, count) split into chunks of at least `grain` items, and returns once all are done.
+    // The calling thread runs the first chunk itself.
+    template <typename Func>
+    void ParallelFor(size_t count, size_t grain, const Func& func) {
+        if (count == 0) return;
+        if (grain == 0) grain = 1;
+        size_t chunks = (count + grain - 1) / grain;
+        if (chunks > MAX_PARALLEL_CHUNKS) {
+            grain = (count + MAX_PARALLEL_CHUNKS - 1) / MAX_PARALLEL_CHUNKS;
+            chunks = (count + grain - 1) / grain;
+        }
+        if (chunks == 1 || workers.empty()) {
+            func(0, count);
+            return;
+        }
+        Job jobs[MAX_PARALLEL_CHUNKS];
+        JobCounter counter;
+        counter.pending.store(chunks - 1, std::memory_order_relaxed);
+        for (size_t i = 1; i < chunks; ++i) {
+            jobs[i].run = RunRange<Func>;
+            jobs[i].context = (void*)&func;
+            jobs[i].begin = i * grain;
+            jobs[i].end = std::min(count, (i + 1) * grain);
+            jobs[i].counter = &counter;
+            Submit(&jobs[i]);
+        }
+        func(0, grain);
+        Wait(counter);
+    }
+};
+
+// ##############
+// # JOB GRAPHS #
+// ##############
+// A fixed set of tasks with ordering constraints, built once and run every frame.
+// A task is queued as soon as all of its dependencies are done, so independent tasks run at the same time.
+
+typedef size_t JobGraphNode;
+
+class JobGraph {
+private:
+    struct Node {
+        std::function<void()> func;
+        std::vector<Node*> successors;
+        int dependencyCount = 0;
+        std::atomic<int> remaining{0};
+        JobGraph* graph = nullptr;
+        Job job;
+    };
+    std::vector<std::unique_ptr<Node>> nodes;
+    JobCounter counter;
+    JobSystem* system = nullptr;
+
+    static void RunNode(Job* job) {
+        Node* node = (Node*)job->context;
+        node->func();
+        for (Node* next : node->successors) {
+            if (next->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                node->graph->system->Submit(&next->job);
+            }
+        }
+    }
+public:
+    JobGraph() {}
+    JobGraph(const JobGraph&) = delete;
+    JobGraph& operator=(const JobGraph&) = delete;
+
+    // Adds a task that runs after the given ones. Dependencies must already be in the graph, so it can never have cycles.
+    JobGraphNode Add(std::function<void()> func, std::initializer_list<JobGraphNode> dependencies = {}) {
+        Node* node = new Node();
+        node->func = std::move(func);
+        node->graph = this;
+        node->job.run = RunNode;
+        node->job.context = node;
+        node->job.counter = &counter;
+        for (JobGraphNode dependency : dependencies) {
+            if (dependency >= nodes.size()) throw std::out_of_range("Job graph dependencies must be added before their dependents.");
+            nodes[dependency]->successors.push_back(node);
+            node->dependencyCount++;
+        }
+        nodes.push_back(std::unique_ptr<Node>(node));
+        return nodes.size() - 1;
+    }
+    size_t Size() const {
+        return nodes.size();
+    }
+    bool IsEmpty() const {
+        return nodes.empty();
+    }
+
+    // Runs every task once, in dependency order, and returns when all are done
+    void Run(JobSystem& jobs) {
+        if (nodes.empty()) return;
+        system = &jobs;
+        counter.pending.store(nodes.size(), std::memory_order_relaxed);
+        for (auto& node : nodes) {
+            node->remaining.store(node->dependencyCount, std::memory_order_relaxed);
+        }
+        for (auto& node : nodes) {
+            if (node->dependencyCount == 0) jobs.Submit(&node->job);
+        }
+        jobs.Wait(counter);
+    }
+};
+
+#endif
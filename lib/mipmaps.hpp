@@ -0,0 +1,175 @@
+#ifndef MIPMAPS_HPP
+#define MIPMAPS_HPP
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIPMAPS_SSE2
+#endif
+
+#include "texture.hpp"
+
+// ############################
+// # CPU MIP CHAIN GENERATION #
+// ############################
+// Mip levels are built on the CPU so textures can be uploaded level by level, without asking the driver
+// to generate them (glGenerateMipmap is slow on software GL stacks).
+// Colors are averaged in linear space, so downsampled sRGB textures keep their brightness.
+// Alpha (the last channel of 2 and 4 channel images) is always treated as linear.
+
+// Intermediate level: every pixel is 4 linear floats, so each one fits a single SIMD register
+struct LinearImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> data;
+
+    LinearImage(int width = 0, int height = 0) {
+        this->width = width;
+        this->height = height;
+        data.resize((size_t)width * height * 4);
+    }
+    float* Pixel(int x, int y) {return data.data() + ((size_t)y * width + x) * 4;}
+    const float* Pixel(int x, int y) const {return data.data() + ((size_t)y * width + x) * 4;}
+};
+
+// Lookup tables for the sRGB transfer function. Encoding goes through a 14-bit table so dark values keep their precision.
+const int SRGB_ENCODE_BITS = 14;
+const int SRGB_ENCODE_SIZE = 1 << SRGB_ENCODE_BITS;
+
+const float* SrgbDecodeTable() {
+    static std::vector<float> table = []() {
+        std::vector<float> result(256);
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return result;
+    }();
+    return table.data();
+}
+const uint8_t* SrgbEncodeTable() {
+    static std::vector<uint8_t> table = []() {
+        std::vector<uint8_t> result(SRGB_ENCODE_SIZE);
+        for (int i = 0; i < SRGB_ENCODE_SIZE; ++i) {
+            float l = (float)i / (SRGB_ENCODE_SIZE - 1);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1 / 2.4f) - 0.055f;
+            result[i] = (uint8_t)std::min(255.0f, std::max(0.0f, c * 255 + 0.5f));
+        }
+        return result;
+    }();
+    return table.data();
+}
+
+inline bool HasAlpha(int channels) {
+    return channels == 2 || channels == 4;
+}
+
+LinearImage ToLinear(const Image& image, bool srgb = true) {
+    LinearImage result(image.width, image.height);
+    const float* decode = SrgbDecodeTable();
+    int channels = image.channels;
+    int colorChannels = HasAlpha(channels) ? channels - 1 : channels;
+    for (int y = 0; y < image.height; ++y) {
+        const uint8_t* row = image.Row(y);
+        for (int x = 0; x < image.width; ++x) {
+            const uint8_t* p = row + x * channels;
+            float* target = result.Pixel(x, y);
+            for (int c = 0; c < colorChannels; ++c) {
+                target[c] = srgb ? decode[p[c]] : p[c] / 255.0f;
+            }
+            target[3] = HasAlpha(channels) ? p[channels - 1] / 255.0f : 1;
+        }
+    }
+    return result;
+}
+
+Image FromLinear(const LinearImage& image, int channels, bool srgb = true) {
+    Image result(image.width, image.height, channels);
+    const uint8_t* encode = SrgbEncodeTable();
+    int colorChannels = HasAlpha(channels) ? channels - 1 : channels;
+    for (int y = 0; y < image.height; ++y) {
+        uint8_t* row = result.Row(y);
+        for (int x = 0; x < image.width; ++x) {
+            const float* p = image.Pixel(x, y);
+            uint8_t* target = row + x * channels;
+#ifdef MIPMAPS_SSE2
+            // Scale every lane to its table index (colors) or byte value (alpha) in one go
+            __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), _mm_setzero_ps()), _mm_set1_ps(1));
+            __m128 scale = srgb ? _mm_setr_ps(SRGB_ENCODE_SIZE - 1, SRGB_ENCODE_SIZE - 1, SRGB_ENCODE_SIZE - 1, 255)
+                                : _mm_set1_ps(255);
+            alignas(16) int32_t indices[4];
+            _mm_store_si128((__m128i*)indices, _mm_cvtps_epi32(_mm_mul_ps(value, scale)));
+            for (int c = 0; c < colorChannels; ++c) {
+                target[c] = srgb ? encode[indices[c]] : (uint8_t)indices[c];
+            }
+            if (HasAlpha(channels)) target[channels - 1] = (uint8_t)indices[3];
+#else
+            for (int c = 0; c < colorChannels; ++c) {
+                float v = std::min(1.0f, std::max(0.0f, p[c]));
+                target[c] = srgb ? encode[(int)(v * (SRGB_ENCODE_SIZE - 1) + 0.5f)] : (uint8_t)(v * 255 + 0.5f);
+            }
+            if (HasAlpha(channels)) target[channels - 1] = (uint8_t)(std::min(1.0f, std::max(0.0f, p[3])) * 255 + 0.5f);
+#endif
+        }
+    }
+    return result;
+}
+
+// Halves an image in each dimension by averaging 2x2 blocks of pixels.
+// Odd sizes drop their last row/column, which never reaches the next level. Dimensions of 1 stay 1, so every level is at least 1x1.
+LinearImage Downsample(const LinearImage& source) {
+    int width = source.width > 1 ? source.width / 2 : 1;
+    int height = source.height > 1 ? source.height / 2 : 1;
+    LinearImage result(width, height);
+    for (int y = 0; y < height; ++y) {
+        int y0 = std::min(2 * y, source.height - 1);
+        int y1 = std::min(2 * y + 1, source.height - 1);
+        for (int x = 0; x < width; ++x) {
+            int x0 = std::min(2 * x, source.width - 1);
+            int x1 = std::min(2 * x + 1, source.width - 1);
+            float* target = result.Pixel(x, y);
+#ifdef MIPMAPS_SSE2
+            __m128 sum = _mm_add_ps(
+                _mm_add_ps(_mm_loadu_ps(source.Pixel(x0, y0)), _mm_loadu_ps(source.Pixel(x1, y0))),
+                _mm_add_ps(_mm_loadu_ps(source.Pixel(x0, y1)), _mm_loadu_ps(source.Pixel(x1, y1)))
+            );
+            _mm_storeu_ps(target, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for (int c = 0; c < 4; ++c) {
+                target[c] = (source.Pixel(x0, y0)[c] + source.Pixel(x1, y0)[c] + source.Pixel(x0, y1)[c] + source.Pixel(x1, y1)[c]) * 0.25f;
+            }
+#endif
+        }
+    }
+    return result;
+}
+
+// Builds every mip level of an image, starting with a copy of the image itself and ending at 1x1.
+// Levels are chained in linear float space, so rounding errors do not accumulate down the chain.
+// Pass srgb = false for data textures such as normal maps.
+std::vector<Image> BuildMipChain(const Image& base, bool srgb = true) {
+    std::vector<Image> levels;
+    int count = MipLevelCount(base.width, base.height);
+    levels.reserve(count);
+    levels.push_back(base);
+    LinearImage current = ToLinear(base, srgb);
+    for (int i = 1; i < count; ++i) {
+        current = Downsample(current);
+        levels.push_back(FromLinear(current, base.channels, srgb));
+    }
+    return levels;
+}
+
+std::vector<ImageView> ViewLevels(const std::vector<Image>& levels) {
+    std::vector<ImageView> result;
+    for (const Image& level : levels) {
+        result.push_back(level.View());
+    }
+    return result;
+}
+
+#endif
@@ -0,0 +1,391 @@
+#ifndef PARTICLES_HPP
+#define PARTICLES_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cmath>
+#include <vector>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PARTICLES_SSE2
+#endif
+
+#include "jobs.hpp"
+#include "shader.hpp"
+#include "geometry/mesh.hpp"
+
+using namespace glm;
+
+// ###################
+// # PARTICLE SYSTEM #
+// ###################
+// Short lived particles that fade out over their lifetime: they slow down to `finalSpeedFactor` times their initial speed,
+// shrink to nothing and blend from their start color to their end color.
+// Every attribute lives in its own column, so the update and instance kernels process four particles per SSE instruction.
+
+// Everything needed to spawn one particle
+struct ParticleParams {
+    vec3 position = vec3(0);
+    vec3 velocity = vec3(0);
+    // Euler angles (X, Y, Z) of the initial orientation, and how fast they change in radians per second
+    vec3 angles = vec3(0);
+    vec3 angularVelocity = vec3(0);
+    float scale = 1;
+    float lifetime = 1;
+    vec4 startColor = vec4(1);
+    vec4 endColor = vec4(1);
+};
+
+// Columns of the particle buffers
+typedef int ParticleColumn;
+const ParticleColumn PARTICLE_PX = 0, PARTICLE_PY = 1, PARTICLE_PZ = 2;
+const ParticleColumn PARTICLE_VX = 3, PARTICLE_VY = 4, PARTICLE_VZ = 5;
+const ParticleColumn PARTICLE_AX = 6, PARTICLE_AY = 7, PARTICLE_AZ = 8;
+const ParticleColumn PARTICLE_WX = 9, PARTICLE_WY = 10, PARTICLE_WZ = 11;
+const ParticleColumn PARTICLE_SCALE = 12;
+const ParticleColumn PARTICLE_LIFE = 13;
+const ParticleColumn PARTICLE_INV_MAX_LIFE = 14;
+const ParticleColumn PARTICLE_START_R = 15, PARTICLE_START_G = 16, PARTICLE_START_B = 17, PARTICLE_START_A = 18;
+const ParticleColumn PARTICLE_END_R = 19, PARTICLE_END_G = 20, PARTICLE_END_B = 21, PARTICLE_END_A = 22;
+const int PARTICLE_COLUMN_COUNT = 23;
+
+// Per instance data: a model matrix followed by a color, as read by the instanced shaders
+const int PARTICLE_INSTANCE_FLOATS = 20;
+const int PARTICLE_INSTANCE_LAYOUT_START = 5;
+// Particles per job when a system is split across threads
+const size_t PARTICLE_JOB_GRAIN = 8192;
+
+// Sine approximation good to about 0.001, plenty for tumbling particles and much cheaper than std::sin
+inline float FastSin(float x) {
+    const float TWO_PI = 6.28318530718f;
+    x -= TWO_PI * std::nearbyint(x / TWO_PI);
+    float y = 1.27323954474f * x - 0.405284734569f * x * std::fabs(x);
+    return 0.225f * (y * std::fabs(y) - y) + y;
+}
+inline float FastCos(float x) {
+    return FastSin(x + 1.57079632679f);
+}
+
+#ifdef PARTICLES_SSE2
+inline __m128 FastSin4(__m128 x) {
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    // Wrap into [-pi, pi]
+    __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.159154943092f))));
+    x = _mm_sub_ps(x, _mm_mul_ps(turns, _mm_set1_ps(6.28318530718f)));
+    __m128 absX = _mm_andnot_ps(signMask, x);
+    __m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.27323954474f), x), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(-0.405284734569f), x), absX));
+    __m128 absY = _mm_andnot_ps(signMask, y);
+    return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.225f), _mm_sub_ps(_mm_mul_ps(y, absY), y)), y);
+}
+inline __m128 FastCos4(__m128 x) {
+    return FastSin4(_mm_add_ps(x, _mm_set1_ps(1.57079632679f)));
+}
+#endif
+
+class ParticleSystem {
+private:
+    std::vector<float> columns[PARTICLE_COLUMN_COUNT];
+    size_t count = 0;
+    GLuint instanceBuffer = 0;
+
+    float* Column(ParticleColumn column) {
+        return columns[column].data();
+    }
+    // Moves the last particle into the given slot
+    void RemoveAt(size_t index) {
+        count--;
+        for (int c = 0; c < PARTICLE_COLUMN_COUNT; ++c) {
+            columns[c][index] = columns[c][count];
+        }
+    }
+
+    void UpdateRange(size_t start, size_t end, float deltaTime) {
+        float* px = Column(PARTICLE_PX); float* py = Column(PARTICLE_PY); float* pz = Column(PARTICLE_PZ);
+        float* vx = Column(PARTICLE_VX); float* vy = Column(PARTICLE_VY); float* vz = Column(PARTICLE_VZ);
+        float* ax = Column(PARTICLE_AX); float* ay = Column(PARTICLE_AY); float* az = Column(PARTICLE_AZ);
+        float* wx = Column(PARTICLE_WX); float* wy = Column(PARTICLE_WY); float* wz = Column(PARTICLE_WZ);
+        float* life = Column(PARTICLE_LIFE);
+        float* invMaxLife = Column(PARTICLE_INV_MAX_LIFE);
+        for (size_t i = start; i < end; ++i) {
+            float t = life[i] * invMaxLife[i];
+            float step = (finalSpeedFactor + (1 - finalSpeedFactor) * t) * deltaTime;
+            px[i] += vx[i] * step; py[i] += vy[i] * step; pz[i] += vz[i] * step;
+            ax[i] += wx[i] * deltaTime; ay[i] += wy[i] * deltaTime; az[i] += wz[i] * deltaTime;
+            life[i] -= deltaTime;
+        }
+    }
+    void WriteRange(size_t start, size_t end, float* out) {
+        for (size_t i = start; i < end; ++i) {
+            float t = columns[PARTICLE_LIFE][i] * columns[PARTICLE_INV_MAX_LIFE][i];
+            float s = columns[PARTICLE_SCALE][i] * t;
+            float sx = FastSin(columns[PARTICLE_AX][i]), cx = FastCos(columns[PARTICLE_AX][i]);
+            float sy = FastSin(columns[PARTICLE_AY][i]), cy = FastCos(columns[PARTICLE_AY][i]);
+            float sz = FastSin(columns[PARTICLE_AZ][i]), cz = FastCos(columns[PARTICLE_AZ][i]);
+            float* m = out + i * PARTICLE_INSTANCE_FLOATS;
+            // Rotation Z * Y * X, scaled, stored by columns
+            m[0] = cy * cz * s;                     m[1] = cy * sz * s;                     m[2] = -sy * s;       m[3] = 0;
+            m[4] = (sx * sy * cz - cx * sz) * s;    m[5] = (sx * sy * sz + cx * cz) * s;    m[6] = sx * cy * s;   m[7] = 0;
+            m[8] = (cx * sy * cz + sx * sz) * s;    m[9] = (cx * sy * sz - sx * cz) * s;    m[10] = cx * cy * s;  m[11] = 0;
+            m[12] = columns[PARTICLE_PX][i];        m[13] = columns[PARTICLE_PY][i];        m[14] = columns[PARTICLE_PZ][i]; m[15] = 1;
+            for (int c = 0; c < 4; ++c) {
+                m[16 + c] = columns[PARTICLE_START_R + c][i] * t + columns[PARTICLE_END_R + c][i] * (1 - t);
+            }
+        }
+    }
+#ifdef PARTICLES_SSE2
+    // Processes groups of four particles from start, returns where the scalar tail should start
+    size_t UpdateSimd(size_t start, size_t end, float deltaTime) {
+        end = start + ((end - start) & ~(size_t)3);
+        __m128 dt = _mm_set1_ps(deltaTime);
+        __m128 finalFactor = _mm_set1_ps(finalSpeedFactor);
+        __m128 fadingFactor = _mm_set1_ps(1 - finalSpeedFactor);
+        float* p[3] = {Column(PARTICLE_PX), Column(PARTICLE_PY), Column(PARTICLE_PZ)};
+        float* v[3] = {Column(PARTICLE_VX), Column(PARTICLE_VY), Column(PARTICLE_VZ)};
+        float* a[3] = {Column(PARTICLE_AX), Column(PARTICLE_AY), Column(PARTICLE_AZ)};
+        float* w[3] = {Column(PARTICLE_WX), Column(PARTICLE_WY), Column(PARTICLE_WZ)};
+        float* life = Column(PARTICLE_LIFE);
+        float* invMaxLife = Column(PARTICLE_INV_MAX_LIFE);
+        for (size_t i = start; i < end; i += 4) {
+            __m128 l = _mm_loadu_ps(life + i);
+            __m128 t = _mm_mul_ps(l, _mm_loadu_ps(invMaxLife + i));
+            __m128 step = _mm_mul_ps(_mm_add_ps(finalFactor, _mm_mul_ps(fadingFactor, t)), dt);
+            for (int k = 0; k < 3; ++k) {
+                _mm_storeu_ps(p[k] + i, _mm_add_ps(_mm_loadu_ps(p[k] + i), _mm_mul_ps(_mm_loadu_ps(v[k] + i), step)));
+                _mm_storeu_ps(a[k] + i, _mm_add_ps(_mm_loadu_ps(a[k] + i), _mm_mul_ps(_mm_loadu_ps(w[k] + i), dt)));
+            }
+            _mm_storeu_ps(life + i, _mm_sub_ps(l, dt));
+        }
+        return end;
+    }
+    size_t WriteSimd(size_t start, size_t end, float* out) {
+        end = start + ((end - start) & ~(size_t)3);
+        __m128 zero = _mm_setzero_ps();
+        __m128 one = _mm_set1_ps(1);
+        for (size_t i = start; i < end; i += 4) {
+            __m128 t = _mm_mul_ps(_mm_loadu_ps(Column(PARTICLE_LIFE) + i), _mm_loadu_ps(Column(PARTICLE_INV_MAX_LIFE) + i));
+            __m128 s = _mm_mul_ps(_mm_loadu_ps(Column(PARTICLE_SCALE) + i), t);
+            __m128 anglesX = _mm_loadu_ps(Column(PARTICLE_AX) + i);
+            __m128 anglesY = _mm_loadu_ps(Column(PARTICLE_AY) + i);
+            __m128 anglesZ = _mm_loadu_ps(Column(PARTICLE_AZ) + i);
+            __m128 sx = FastSin4(anglesX), cx = FastCos4(anglesX);
+            __m128 sy = FastSin4(anglesY), cy = FastCos4(anglesY);
+            __m128 sz = FastSin4(anglesZ), cz = FastCos4(anglesZ);
+            __m128 sxsy = _mm_mul_ps(sx, sy);
+            __m128 cxsy = _mm_mul_ps(cx, sy);
+
+            // Each register holds one matrix entry for four particles
+            __m128 m[5][4];
+            m[0][0] = _mm_mul_ps(_mm_mul_ps(cy, cz), s);
+            m[0][1] = _mm_mul_ps(_mm_mul_ps(cy, sz), s);
+            m[0][2] = _mm_mul_ps(_mm_sub_ps(zero, sy), s);
+            m[0][3] = zero;
+            m[1][0] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(sxsy, cz), _mm_mul_ps(cx, sz)), s);
+            m[1][1] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(sxsy, sz), _mm_mul_ps(cx, cz)), s);
+            m[1][2] = _mm_mul_ps(_mm_mul_ps(sx, cy), s);
+            m[1][3] = zero;
+            m[2][0] = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(cxsy, cz), _mm_mul_ps(sx, sz)), s);
+            m[2][1] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(cxsy, sz), _mm_mul_ps(sx, cz)), s);
+            m[2][2] = _mm_mul_ps(_mm_mul_ps(cx, cy), s);
+            m[2][3] = zero;
+            m[3][0] = _mm_loadu_ps(Column(PARTICLE_PX) + i);
+            m[3][1] = _mm_loadu_ps(Column(PARTICLE_PY) + i);
+            m[3][2] = _mm_loadu_ps(Column(PARTICLE_PZ) + i);
+            m[3][3] = one;
+            __m128 fade = _mm_sub_ps(one, t);
+            for (int c = 0; c < 4; ++c) {
+                m[4][c] = _mm_add_ps(
+                    _mm_mul_ps(_mm_loadu_ps(Column(PARTICLE_START_R + c) + i), t),
+                    _mm_mul_ps(_mm_loadu_ps(Column(PARTICLE_END_R + c) + i), fade)
+                );
+            }
+            // Transpose so every register holds one column (or the color) of a single particle
+            float* base = out + i * PARTICLE_INSTANCE_FLOATS;
+            for (int column = 0; column < 5; ++column) {
+                _MM_TRANSPOSE4_PS(m[column][0], m[column][1], m[column][2], m[column][3]);
+                for (int particle = 0; particle < 4; ++particle) {
+                    _mm_storeu_ps(base + particle * PARTICLE_INSTANCE_FLOATS + column * 4, m[column][particle]);
+                }
+            }
+        }
+        return end;
+    }
+#endif
+    void UpdateChunk(size_t start, size_t end, float deltaTime) {
+#ifdef PARTICLES_SSE2
+        if (useSimd) start = UpdateSimd(start, end, deltaTime);
+#endif
+        UpdateRange(start, end, deltaTime);
+    }
+    void WriteChunk(size_t start, size_t end, float* out) {
+#ifdef PARTICLES_SSE2
+        if (useSimd) start = WriteSimd(start, end, out);
+#endif
+        WriteRange(start, end, out);
+    }
+protected:
+    size_t capacity = 0;
+    size_t dropped = 0;
+    MeshHandle* mesh = nullptr;
+    Material* material = nullptr;
+
+    // Sets the common uniforms and material properties of an instanced draw
+    static void SetDrawUniforms(Material* material, const mat4& vMatrix, const mat4& pMatrix, const mat4& vpMatrix, float time, bool warnMissingShaderUniforms) {
+        Shader* shader = material->shader;
+        shader->Use();
+        shader->SetUniformMatrix("u_ViewMatrix", vMatrix, warnMissingShaderUniforms);
+        shader->SetUniformMatrix("u_ProjectionMatrix", pMatrix, warnMissingShaderUniforms);
+        shader->SetUniformMatrix("u_ViewProjectionMatrix", vpMatrix, warnMissingShaderUniforms);
+        shader->SetUniformValue("u_Time", time, warnMissingShaderUniforms);
+        material->SetMaterialProperties(warnMissingShaderUniforms);
+    }
+
+    // Backends that keep particles elsewhere skip the column storage
+    ParticleSystem() {}
+    void Allocate(size_t capacity) {
+        this->capacity = capacity;
+        for (int c = 0; c < PARTICLE_COLUMN_COUNT; ++c) {
+            // Padded to a multiple of 4 so the kernels never need to special case the buffer end
+            columns[c].resize(capacity + 4);
+        }
+    }
+public:
+    // Fraction of its initial speed a particle keeps at the end of its life
+    float finalSpeedFactor = 0.3f;
+    // Turns the SSE kernels off, for comparisons
+    bool useSimd = true;
+    // Splits large systems across threads when set. GLProgram::Instantiate points it at the program's jobs.
+    JobSystem* jobs = nullptr;
+
+    ParticleSystem(size_t capacity) {
+        Allocate(capacity);
+    }
+    // Particles drawn with an instanced shader, see vert_unlit_instanced_colored.glsl
+    ParticleSystem(size_t capacity, MeshHandle* mesh, Material* material) : ParticleSystem(capacity) {
+        this->mesh = mesh;
+        this->material = material;
+        InitializeRendering();
+    }
+    virtual ~ParticleSystem() {
+        if (instanceBuffer != 0) glDeleteBuffers(1, &instanceBuffer);
+    }
+
+    // Returns false if the system is full and the particle was dropped
+    virtual bool Emit(const ParticleParams& params) {
+        if (count >= capacity) {
+            dropped++;
+            return false;
+        }
+        size_t i = count++;
+        columns[PARTICLE_PX][i] = params.position.x; columns[PARTICLE_PY][i] = params.position.y; columns[PARTICLE_PZ][i] = params.position.z;
+        columns[PARTICLE_VX][i] = params.velocity.x; columns[PARTICLE_VY][i] = params.velocity.y; columns[PARTICLE_VZ][i] = params.velocity.z;
+        columns[PARTICLE_AX][i] = params.angles.x; columns[PARTICLE_AY][i] = params.angles.y; columns[PARTICLE_AZ][i] = params.angles.z;
+        columns[PARTICLE_WX][i] = params.angularVelocity.x; columns[PARTICLE_WY][i] = params.angularVelocity.y; columns[PARTICLE_WZ][i] = params.angularVelocity.z;
+        columns[PARTICLE_SCALE][i] = params.scale;
+        columns[PARTICLE_LIFE][i] = params.lifetime;
+        columns[PARTICLE_INV_MAX_LIFE][i] = 1 / params.lifetime;
+        for (int c = 0; c < 4; ++c) {
+            columns[PARTICLE_START_R + c][i] = params.startColor[c];
+            columns[PARTICLE_END_R + c][i] = params.endColor[c];
+        }
+        return true;
+    }
+    virtual void Clear() {
+        count = 0;
+    }
+
+    // Advances every particle, then removes the ones whose lifetime ran out
+    virtual void Update(float deltaTime) {
+        if (jobs != nullptr) {
+            jobs->ParallelFor(count, PARTICLE_JOB_GRAIN, [this, deltaTime](size_t start, size_t end) {
+                UpdateChunk(start, end, deltaTime);
+            });
+        } else {
+            UpdateChunk(0, count, deltaTime);
+        }
+        RemoveExpired();
+    }
+    void RemoveExpired() {
+        const float* life = Column(PARTICLE_LIFE);
+        size_t i = 0;
+#ifdef PARTICLES_SSE2
+        // Skip four live particles at a time
+        if (useSimd) {
+            __m128 zero = _mm_setzero_ps();
+            while (i + 4 <= count && _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(life + i), zero)) == 0) {
+                i += 4;
+            }
+        }
+#endif
+        while (i < count) {
+            if (life[i] < 0) RemoveAt(i);
+            else ++i;
+        }
+    }
+
+    // Writes PARTICLE_INSTANCE_FLOATS floats per particle: its model matrix by columns, then its color
+    void WriteInstances(float* out) {
+        if (jobs != nullptr) {
+            jobs->ParallelFor(count, PARTICLE_JOB_GRAIN, [this, out](size_t start, size_t end) {
+                WriteChunk(start, end, out);
+            });
+        } else {
+            WriteChunk(0, count, out);
+        }
+    }
+
+    virtual size_t Count() const {
+        return count;
+    }
+    size_t Capacity() const {
+        return capacity;
+    }
+    // Particles that could not be emitted because the system was full
+    size_t DroppedCount() const {
+        return dropped;
+    }
+
+    // #############
+    // # RENDERING #
+    // #############
+
+    // Points the mesh's instance attributes at this system's instance buffer
+    void InitializeRendering() {
+        glGenBuffers(1, &instanceBuffer);
+        glBindVertexArray(mesh->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int i = 0; i < PARTICLE_INSTANCE_FLOATS / 4; i++) {
+            glEnableVertexAttribArray(i + PARTICLE_INSTANCE_LAYOUT_START);
+            glVertexAttribPointer(i + PARTICLE_INSTANCE_LAYOUT_START, 4, GL_FLOAT, GL_FALSE, PARTICLE_INSTANCE_FLOATS * sizeof(GLfloat), (void*)(i * 4 * sizeof(GLfloat)));
+            glVertexAttribDivisor(i + PARTICLE_INSTANCE_LAYOUT_START, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // Writes the instance data straight into a freshly orphaned buffer and draws every particle in one call
+    virtual void Draw(const mat4& vMatrix, const mat4& pMatrix, const mat4& vpMatrix, float time = 0, bool warnMissingShaderUniforms = false) {
+        if (count == 0 || mesh == nullptr || material == nullptr) return;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        GLsizeiptr size = count * PARTICLE_INSTANCE_FLOATS * sizeof(GLfloat);
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        float* target = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (target == nullptr) {
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return;
+        }
+        WriteInstances(target);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        SetDrawUniforms(material, vMatrix, pMatrix, vpMatrix, time, warnMissingShaderUniforms);
+
+        glBindVertexArray(mesh->vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(mesh->elementCount), GL_UNSIGNED_INT, (void*)0, count);
+        glBindVertexArray(0);
+    }
+};
+
+#endif
@@ -3,6 +3,9 @@
 
 #include <string>
 #include <functional>
+#include <deque>
+#include <vector>
+#include <stdint.h>
 
 #include "glHelper.hpp"
 #include "gameObject.hpp"
@@ -16,48 +19,226 @@ T* InternalStandardGameObjectFactory(std::string name, int index, MeshHandle* me
 template <typename T>
 std::function<T*(std::string, int, MeshHandle*, Material*)> StandardGameObjectFactory(InternalStandardGameObjectFactory<T>);
 
+// What a pool with a fixed capacity does when every object is in use
+typedef int PoolOverflowPolicy;
+// Allocate a new object anyway, the capacity is only a hint
+const PoolOverflowPolicy POOL_GROW = 0;
+// Take back the object that was fetched the longest time ago
+const PoolOverflowPolicy POOL_RECYCLE_OLDEST = 1;
+// Return nullptr
+const PoolOverflowPolicy POOL_REFUSE = 2;
+
+struct PoolStats {
+    // Objects created by the pool, including prewarmed ones
+    size_t allocations = 0;
+    // Fetches that found no free object
+    size_t misses = 0;
+    // Fetches served by recycling an object that was still in use
+    size_t recycled = 0;
+    // Fetches that returned nullptr
+    size_t refused = 0;
+    // Most objects in use at the same time
+    size_t highWaterMark = 0;
+};
+
+// Keeps a set of GameObjects around to be reused instead of reallocated.
+// Disabled objects are threaded onto a free list as soon as they are disabled, so fetching one is O(1).
 template <typename T>
 class GameObjectPool {
 private:
+    struct Slot {
+        T* object;
+        // Next slot in the free list, or -1
+        int nextFree = -1;
+        bool inFreeList = false;
+        // When the object was last fetched, to find the oldest object in use
+        uint64_t fetchStamp = 0;
+    };
     std::vector<T*> pooledObjects;
+    std::vector<Slot> slots;
+    int freeHead = -1;
+    size_t freeCount = 0;
+    // Slots in the order they were fetched. Entries whose stamp is out of date are skipped.
+    std::deque<std::pair<int, uint64_t>> fetchOrder;
+    uint64_t nextFetchStamp = 1;
+    PoolStats stats;
     GLProgram* program;
-    size_t activeIndex = 0;
     std::function<T*(std::string, int, MeshHandle*, Material*)> factory;
+
+    ObjEventHandler<GameObjectPool<T>, GameObject*> OnObjectDisabledHandler;
+    static void OnObjectDisabledCallback(GameObjectPool<T>* pool, GameObject* go) {
+        int index = go->poolIndex;
+        if (index < 0 || index >= (int)pool->slots.size() || pool->slots[index].object != go) return;
+        pool->PushFree(index);
+    }
+
+    void PushFree(int index) {
+        Slot& slot = slots[index];
+        if (slot.inFreeList) return;
+        slot.inFreeList = true;
+        slot.nextFree = freeHead;
+        freeHead = index;
+        freeCount++;
+    }
+    // Pops free slots until one whose object is still disabled comes up. Returns -1 if there are none.
+    int PopFree() {
+        while (freeHead >= 0) {
+            int index = freeHead;
+            Slot& slot = slots[index];
+            freeHead = slot.nextFree;
+            slot.inFreeList = false;
+            freeCount--;
+            // The object was enabled from outside the pool after it was freed
+            if (slot.object->IsEnabled()) continue;
+            return index;
+        }
+        return -1;
+    }
+    int PopOldest() {
+        size_t kept = 0;
+        while (fetchOrder.size() > kept) {
+            std::pair<int, uint64_t> entry = fetchOrder.front();
+            fetchOrder.pop_front();
+            Slot& slot = slots[entry.first];
+            // Freed or fetched again since this entry was queued
+            if (slot.fetchStamp != entry.second || slot.inFreeList) continue;
+            if (slot.object->IsEnabled()) return entry.first;
+            // Fetched without being enabled yet. It cannot be taken back, so keep it queued.
+            fetchOrder.push_back(entry);
+            kept++;
+        }
+        return -1;
+    }
+    void MarkFetched(int index) {
+        slots[index].fetchStamp = nextFetchStamp++;
+        if (overflowPolicy == POOL_RECYCLE_OLDEST) {
+            fetchOrder.push_back({index, slots[index].fetchStamp});
+            // Drop entries for objects that were freed since, so the queue stays proportional to the pool
+            if (fetchOrder.size() > 2 * slots.size()) {
+                std::deque<std::pair<int, uint64_t>> live;
+                for (auto entry : fetchOrder) {
+                    Slot& slot = slots[entry.first];
+                    if (slot.fetchStamp == entry.second && !slot.inFreeList) live.push_back(entry);
+                }
+                fetchOrder = std::move(live);
+            }
+        }
+        size_t inUse = slots.size() - freeCount;
+        if (inUse > stats.highWaterMark) stats.highWaterMark = inUse;
+    }
+    // Finds an object for a fetch, following the overflow policy, and returns it without enabling it.
+    // Objects that had to be created are already enabled. Returns nullptr if the fetch was refused.
+    T* Acquire() {
+        int index = PopFree();
+        if (index < 0) {
+            stats.misses++;
+            if (capacity > 0 && slots.size() >= capacity) {
+                if (overflowPolicy == POOL_RECYCLE_OLDEST) {
+                    index = PopOldest();
+                    if (index >= 0) {
+                        stats.recycled++;
+                        slots[index].object->SetEnabled(false, program);
+                        // Disabling it pushed it onto the free list, take it right back
+                        PopFree();
+                    }
+                } else if (overflowPolicy == POOL_REFUSE) {
+                    stats.refused++;
+                    return nullptr;
+                }
+            }
+            if (index < 0) return New();
+        }
+        MarkFetched(index);
+        return slots[index].object;
+    }
 public:
     std::string name;
     MeshHandle* mesh;
     Material* material;
+    // Maximum number of objects, 0 for no limit. Only enforced by FetchUnused.
+    size_t capacity = 0;
+    PoolOverflowPolicy overflowPolicy = POOL_GROW;
+
     GameObjectPool(std::string name, MeshHandle* mesh, Material* material, std::function<T*(std::string, int, MeshHandle*, Material*)> factory, GLProgram* program) {
         this->name = name;
         this->mesh = mesh;
         this->material = material;
         this->factory = factory;
         this->program = program;
+        OnObjectDisabledHandler = ObjEventHandler<GameObjectPool<T>, GameObject*>(this, OnObjectDisabledCallback);
     }
-    std::vector<T*> GetObjects() {
+    const std::vector<T*>& GetObjects() const {
         return pooledObjects;
     }
+    const PoolStats& GetStats() const {
+        return stats;
+    }
+    size_t Size() const {
+        return slots.size();
+    }
+    size_t FreeCount() const {
+        return freeCount;
+    }
+
+    // Sets a fixed capacity and what to do once every object is in use
+    GameObjectPool<T>* SetCapacity(size_t capacity, PoolOverflowPolicy overflowPolicy) {
+        this->capacity = capacity;
+        this->overflowPolicy = overflowPolicy;
+        return this;
+    }
+    // Creates objects ahead of time, so the first frames that need them do not allocate
+    GameObjectPool<T>* Prewarm(size_t count) {
+        size_t highWaterMark = stats.highWaterMark;
+        while (slots.size() < count) {
+            T* obj = New();
+            obj->SetEnabled(false, program);
+        }
+        stats.highWaterMark = highWaterMark;
+        return this;
+    }
+
+    // Returns a disabled object, enabling it unless told otherwise. With autoEnable off, the caller must enable it.
+    // May return nullptr if the pool is full and its policy is POOL_REFUSE.
     T* FetchUnused(bool autoEnable = true) {
-        //std::cout << "Fetching object from pool " << name << ", with " << pooledObjects.size() << " objects." << std::endl; 
-        for (int i = activeIndex; i < activeIndex + pooledObjects.size(); ++i) {
-            int idx = activeIndex % pooledObjects.size();
-            T* obj = pooledObjects.at(idx);
-            if (obj->IsEnabled()) continue;
-            activeIndex = (idx + 1) % pooledObjects.size();
-            if (autoEnable) obj->SetEnabled(true, program);
-            return obj;
+        T* obj = Acquire();
+        if (obj == nullptr) return nullptr;
+        if (autoEnable) {
+            obj->SetEnabled(true, program);
+        } else if (obj->IsEnabled()) {
+            // New objects start enabled. Disabling one frees it, so take it straight back off the free list.
+            obj->SetEnabled(false, program);
+            PopFree();
         }
-        activeIndex = 0;
-        return New();
+        return obj;
     }
+    // Always creates a new object, enabled
     T* New() {
         T* obj = factory(name, pooledObjects.size(), mesh, material);
         pooledObjects.push_back(obj);
+        Slot slot;
+        slot.object = obj;
+        slots.push_back(slot);
+        obj->poolIndex = slots.size() - 1;
+        obj->OnDisabled.AddListener(&OnObjectDisabledHandler);
+        stats.allocations++;
         program->Instantiate(obj);
+        MarkFetched(slots.size() - 1);
+        if (!obj->IsEnabled()) PushFree(slots.size() - 1);
         return obj;
     }
 };
 
+template <typename T>
+void PrintPoolStats(const GameObjectPool<T>* pool) {
+    const PoolStats& stats = pool->GetStats();
+    std::cout << "Pool " << pool->name << ": " << pool->Size() << " objects, "
+        << stats.allocations << " allocations, "
+        << stats.misses << " misses, "
+        << stats.recycled << " recycled, "
+        << stats.refused << " refused, "
+        << "high water mark " << stats.highWaterMark << std::endl;
+}
+
 class BasicGameObjectPool : GameObjectPool<GameObject> {
 public:
     BasicGameObjectPool(std::string name, MeshHandle* mesh, Material* material, GLProgram* program) 
@@ -24,12 +24,42 @@ using namespace glm;
 struct ObjData {
     string name;
     shared_ptr<RefMesh> mesh;
+    // The first material used by the object, for single-material users
     RawMtl materialData;
+    // Every material used by the object, indexed by the mesh's submeshes
+    vector<RawMtl> materials;
     ObjData(string name = "Unknown", const RawMtl& materialData = RawMtl()) {
         //cout << "(Constructor) Creating Object Data for object " << name << endl;
         this->name = name;
         this->mesh = make_shared<RefMesh>();
         this->materialData = materialData;
+        this->materials.push_back(materialData);
+    }
+
+    // Returns the material slot for a material, adding it if the object does not use it yet
+    int MaterialSlot(const RawMtl& material) {
+        for (size_t i = 0; i < materials.size(); ++i) {
+            if (materials[i].mtlName == material.mtlName && materials[i].fileName == material.fileName) return (int)i;
+        }
+        materials.push_back(material);
+        return materials.size() - 1;
+    }
+
+    // Drops material slots no face uses and groups the mesh's triangles by material
+    void FinishMaterials() {
+        vector<Submesh> submeshes = mesh->GetSubmeshes();
+        if (submeshes.empty()) return;
+        vector<int> remap(materials.size(), -1);
+        vector<RawMtl> used;
+        for (const Submesh& s : submeshes) {
+            if (remap[s.materialIndex] >= 0) continue;
+            remap[s.materialIndex] = used.size();
+            used.push_back(materials[s.materialIndex]);
+        }
+        mesh->RemapMaterials(remap);
+        mesh->GroupByMaterial();
+        materials = used;
+        materialData = materials.at(0);
     }
     ~ObjData() {
         //cout << "(Destructor) Deleting Object Data for object " << name << endl;
@@ -79,6 +109,8 @@ public:
 
         ObjData* currentObject = nullptr;
         RawMtl currentMatData;
+        // Every material from every mtllib seen so far, looked up by usemtl
+        vector<RawMtl> library;
         string line;
 
         // The offsets removed from each index
@@ -97,6 +129,7 @@ public:
             if (directive == "o") {
                 // Handle new object registration
                 if (currentObject != nullptr) {
+                    currentObject->FinishMaterials();
                     result.push_back(*currentObject);
                     vOffset  += currentObject->mesh->PositionCount();
                     vtOffset += currentObject->mesh->UvCount();
@@ -110,8 +143,24 @@ public:
             else if (directive == "mtllib") {
                 line.erase(0, 7);
                 auto readMaterials = MtlReader::ReadMtl(GetPathRelativeToFile(filename, line), verbose);
-                if (readMaterials.size() > 0)
+                if (readMaterials.size() > 0 && library.empty())
                     currentMatData = readMaterials.at(0);
+                library.insert(library.end(), readMaterials.begin(), readMaterials.end());
+            }
+            else if (directive == "usemtl") {
+                line.erase(0, 7);
+                bool found = false;
+                for (const RawMtl& mtl : library) {
+                    if (mtl.mtlName != line) continue;
+                    currentMatData = mtl;
+                    found = true;
+                    break;
+                }
+                // Unknown names keep the previous material, like the first material of the library before usemtl was supported
+                if (!found) cerr << "Material " << line << " used by " << filename << " was not found in its material libraries." << endl;
+                if (currentObject != nullptr) {
+                    currentObject->mesh->UseMaterial(currentObject->MaterialSlot(currentMatData));
+                }
             }
             else if (directive == "v") {
                 // Take the floats from the vertex position and register them
@@ -163,9 +212,11 @@ public:
         }
         infile.close();
 
-        if (currentObject != nullptr)
+        if (currentObject != nullptr) {
+            currentObject->FinishMaterials();
             result.push_back(*currentObject);
-            delete currentObject;
+        }
+        delete currentObject;
 
         //cout << "finished reading file " << filename << endl;
         return result;
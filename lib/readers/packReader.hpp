@@ -0,0 +1,452 @@
+#ifndef PACK_READER_HPP
+#define PACK_READER_HPP
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <unordered_map>
+
+#ifdef _WIN32
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "../geometry/mesh.hpp"
+#include "../collision/meshBvh.hpp"
+#include "../texture.hpp"
+#include "mtlReader.hpp"
+
+using namespace std;
+
+// ############################
+// # ASSET PACK BINARY LAYOUT #
+// ############################
+// [PackHeader][entry payloads, each aligned to PACK_ALIGNMENT][PackEntry table][string table]
+// Entries are looked up by name, which is the path the asset was packed from (e.g. "./media/objects/alien.obj#0").
+// Collision BVHs are named after the mesh they were built from (e.g. "./media/objects/rocket.obj#0#bvh").
+// All offsets inside a payload are relative to the start of that payload.
+
+const char PACK_MAGIC[4] = {'S','I','P','K'};
+const uint32_t PACK_VERSION = 2;
+const size_t PACK_ALIGNMENT = 16;
+const int PACK_MAX_MIP_LEVELS = 16;
+
+enum PackEntryType : uint32_t {
+    PACK_ENTRY_MESH = 1,
+    PACK_ENTRY_MATERIAL = 2,
+    PACK_ENTRY_TEXTURE = 3,
+    PACK_ENTRY_DATA = 4, // Raw file contents, for small data files that have no binary form
+    PACK_ENTRY_MESH_BVH = 5
+};
+
+struct PackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t entriesOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+struct PackEntry {
+    uint32_t type;
+    uint32_t name; // Offset into the string table
+    uint64_t offset;
+    uint64_t size;
+};
+
+// Mirrors RawMtl, with every string stored as an offset into the string table
+struct PackMaterial {
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float emissive[3];
+    float glossiness;
+    float dissolve;
+    float refractiveIndex;
+    int32_t illumMode;
+    uint32_t name;
+    uint32_t fileName;
+    uint32_t ambientMap;
+    uint32_t diffuseMap;
+    uint32_t specularMap;
+    uint32_t glossinessMap;
+    uint32_t dissolveMap;
+    uint32_t emissiveMap;
+    uint32_t normalMap;
+};
+
+struct PackSubmesh {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    uint32_t materialIndex;
+};
+
+// Followed by the interleaved vertex floats, the indices, the submesh ranges and the materials, at the given offsets
+struct PackMesh {
+    uint32_t objectName;
+    uint32_t attributeFlags;
+    uint32_t vertexCount;
+    uint32_t floatsPerVertex;
+    uint32_t indexCount;
+    uint32_t verticesOffset;
+    uint32_t indicesOffset;
+    uint32_t submeshCount;
+    uint32_t submeshesOffset;
+    uint32_t materialCount;
+    uint32_t materialsOffset;
+    uint32_t reserved;
+};
+
+// Followed by the BVH nodes and the triangles in leaf order, at the given offsets
+struct PackMeshBvh {
+    uint32_t nodeCount;
+    uint32_t triangleCount;
+    uint32_t nodesOffset;
+    uint32_t trianglesOffset;
+};
+
+// Followed by each mip level, tightly packed, at the given offsets
+struct PackTexture {
+    int32_t width;
+    int32_t height;
+    int32_t channels;
+    int32_t levelCount;
+    uint8_t invertY;
+    uint8_t invertX;
+    uint8_t reserved[6];
+    uint64_t levelOffsets[PACK_MAX_MIP_LEVELS];
+};
+
+// A mesh stored in a mapped pack. The vertex and index arrays point straight into the mapping.
+// Going through the IMesh interface copies the data, use GLProgram::LoadMesh(const PackedMesh*) to upload it directly.
+class PackedMesh : public IMesh {
+public:
+    const GLfloat* vertices = nullptr;
+    const GLuint* indices = nullptr;
+    size_t vertexCount = 0;
+    size_t floatsPerVertex = 0;
+    size_t indexCount = 0;
+    MeshAttributeFlags attributes = MESH_BASIC_AND_COLOR_DATA;
+    vector<Submesh> submeshes;
+
+    vector<GLfloat> GetArrayBuffer(MeshAttributeFlags attributes = MESH_BASIC_AND_COLOR_DATA) const {
+        if (attributes != this->attributes) {
+            cerr << "Packed mesh was baked with attribute flags " << (int)this->attributes << " but flags " << (int)attributes << " were requested." << endl;
+        }
+        return vector<GLfloat>(vertices, vertices + vertexCount * floatsPerVertex);
+    }
+    vector<GLuint> GetElementArrayBuffer() const {
+        return vector<GLuint>(indices, indices + indexCount);
+    }
+    vector<Submesh> GetSubmeshes() const {
+        return submeshes;
+    }
+};
+
+// The packed counterpart to ObjData
+struct PackedObj {
+    string name;
+    PackedMesh mesh;
+    RawMtl materialData;
+    vector<RawMtl> materials;
+};
+
+// A packed texture with its full mip chain, every level pointing into the mapping
+struct PackedTexture {
+    vector<ImageView> levels;
+    bool invertY;
+    bool invertX;
+};
+
+// Maps an asset pack produced by the asset packer into memory and serves views into it.
+// Views stay valid as long as the reader is open.
+class AssetPackReader {
+private:
+    const uint8_t* base = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    vector<uint8_t> fileContents;
+#endif
+    const char* strings = nullptr;
+    uint64_t stringsSize = 0;
+    unordered_map<string, const PackEntry*> entriesByName;
+
+    // Whether length bytes starting at offset fit within a block of the given size, without overflowing
+    static bool Fits(uint64_t offset, uint64_t length, uint64_t size) {
+        return offset <= size && length <= size - offset;
+    }
+    // Whether an array of count elements at offset fits within the payload and is aligned for its elements
+    template <typename T>
+    static bool FitsArray(uint64_t offset, uint64_t count, const PackEntry& entry) {
+        return offset % alignof(T) == 0 && Fits(offset, count * sizeof(T), entry.size);
+    }
+    // The string table ends with the terminator of its last string, so any offset inside it reads a terminated string
+    bool IsString(uint32_t offset) const {
+        return offset < stringsSize;
+    }
+    bool MaterialIsValid(const PackMaterial& material) const {
+        for (uint32_t name : {material.name, material.fileName, material.ambientMap, material.diffuseMap, material.specularMap,
+                              material.glossinessMap, material.dissolveMap, material.emissiveMap, material.normalMap}) {
+            if (!IsString(name)) return false;
+        }
+        return true;
+    }
+    // Checks every offset and count of an entry against its payload, so the getters never read past it.
+    // Collision BVHs are checked by GetMeshBvh, which can fall back to rebuilding them.
+    bool EntryIsValid(const PackEntry& entry) const {
+        if (!IsString(entry.name) || entry.offset % PACK_ALIGNMENT != 0 || !Fits(entry.offset, entry.size, size)) return false;
+        const uint8_t* payload = base + entry.offset;
+        if (entry.type == PACK_ENTRY_MESH) {
+            if (entry.size < sizeof(PackMesh)) return false;
+            const PackMesh* mesh = (const PackMesh*)payload;
+            if (!IsString(mesh->objectName)
+                || !FitsArray<GLfloat>(mesh->verticesOffset, (uint64_t)mesh->vertexCount * mesh->floatsPerVertex, entry)
+                || !FitsArray<GLuint>(mesh->indicesOffset, mesh->indexCount, entry)
+                || !FitsArray<PackSubmesh>(mesh->submeshesOffset, mesh->submeshCount, entry)
+                || !FitsArray<PackMaterial>(mesh->materialsOffset, mesh->materialCount, entry)) return false;
+            const GLuint* indices = (const GLuint*)(payload + mesh->indicesOffset);
+            for (uint32_t i = 0; i < mesh->indexCount; ++i) {
+                if (indices[i] >= mesh->vertexCount) return false;
+            }
+            const PackSubmesh* submeshes = (const PackSubmesh*)(payload + mesh->submeshesOffset);
+            for (uint32_t i = 0; i < mesh->submeshCount; ++i) {
+                if ((uint64_t)submeshes[i].firstIndex + submeshes[i].indexCount > mesh->indexCount) return false;
+            }
+            const PackMaterial* materials = (const PackMaterial*)(payload + mesh->materialsOffset);
+            for (uint32_t i = 0; i < mesh->materialCount; ++i) {
+                if (!MaterialIsValid(materials[i])) return false;
+            }
+        } else if (entry.type == PACK_ENTRY_MATERIAL) {
+            if (entry.size < sizeof(PackMaterial) || !MaterialIsValid(*(const PackMaterial*)payload)) return false;
+        } else if (entry.type == PACK_ENTRY_TEXTURE) {
+            if (entry.size < sizeof(PackTexture)) return false;
+            const PackTexture* texture = (const PackTexture*)payload;
+            if (texture->width <= 0 || texture->height <= 0 || texture->channels < 1 || texture->channels > 4
+                || texture->levelCount < 1 || texture->levelCount > PACK_MAX_MIP_LEVELS) return false;
+            uint64_t width = texture->width;
+            uint64_t height = texture->height;
+            for (int i = 0; i < texture->levelCount; ++i) {
+                if (!Fits(texture->levelOffsets[i], width * height * texture->channels, entry.size)) return false;
+                width = width > 1 ? width / 2 : 1;
+                height = height > 1 ? height / 2 : 1;
+            }
+        }
+        return true;
+    }
+
+    const PackEntry* Find(const string& name, PackEntryType type) const {
+        auto it = entriesByName.find(name);
+        if (it == entriesByName.end() || it->second->type != type) return nullptr;
+        return it->second;
+    }
+    const uint8_t* Payload(const PackEntry* entry) const {
+        return base + entry->offset;
+    }
+    string String(uint32_t offset) const {
+        return string(strings + offset);
+    }
+    RawMtl ToRawMtl(const PackMaterial& packed) const {
+        RawMtl result(String(packed.name), String(packed.fileName));
+        result.ambient = vec3(packed.ambient[0], packed.ambient[1], packed.ambient[2]);
+        result.diffuse = vec3(packed.diffuse[0], packed.diffuse[1], packed.diffuse[2]);
+        result.specular = vec3(packed.specular[0], packed.specular[1], packed.specular[2]);
+        result.emissive = vec3(packed.emissive[0], packed.emissive[1], packed.emissive[2]);
+        result.glossiness = packed.glossiness;
+        result.dissolve = packed.dissolve;
+        result.refractiveIndex = packed.refractiveIndex;
+        result.illumMode = packed.illumMode;
+        result.ambientMapFile = String(packed.ambientMap);
+        result.diffuseMapFile = String(packed.diffuseMap);
+        result.specularMapFile = String(packed.specularMap);
+        result.glossinessMapFile = String(packed.glossinessMap);
+        result.dissolveMapFile = String(packed.dissolveMap);
+        result.emissiveMapFile = String(packed.emissiveMap);
+        result.normalMapFile = String(packed.normalMap);
+        return result;
+    }
+public:
+    ~AssetPackReader() {
+        Close();
+    }
+
+    // Maps the pack file. Returns false if it does not exist or is not a valid pack, including when any of its entries
+    // points outside of the file.
+    bool Open(const string& filename) {
+        Close();
+#ifdef _WIN32
+        ifstream in(filename, ios::binary | ios::ate);
+        if (!in.is_open()) return false;
+        fileContents.resize(in.tellg());
+        in.seekg(0);
+        in.read((char*)fileContents.data(), fileContents.size());
+        base = fileContents.data();
+        size = fileContents.size();
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(PackHeader)) {
+            close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) return false;
+        base = (const uint8_t*)mapping;
+        size = info.st_size;
+#endif
+        const PackHeader* header = (const PackHeader*)base;
+        bool valid = size >= sizeof(PackHeader) && memcmp(header->magic, PACK_MAGIC, 4) == 0 && header->version == PACK_VERSION
+            && header->entriesOffset % alignof(PackEntry) == 0 && Fits(header->entriesOffset, (uint64_t)header->entryCount * sizeof(PackEntry), size)
+            && Fits(header->stringsOffset, header->stringsSize, size) && (header->stringsSize == 0 || base[header->stringsOffset + header->stringsSize - 1] == '\0');
+        if (valid) {
+            strings = (const char*)(base + header->stringsOffset);
+            stringsSize = header->stringsSize;
+            const PackEntry* entries = (const PackEntry*)(base + header->entriesOffset);
+            for (uint32_t i = 0; i < header->entryCount && valid; ++i) {
+                valid = EntryIsValid(entries[i]);
+                if (valid) entriesByName[String(entries[i].name)] = &entries[i];
+            }
+        }
+        if (!valid) {
+            cerr << "Asset pack " << filename << " is corrupt or was built by an incompatible packer." << endl;
+            Close();
+            return false;
+        }
+        return true;
+    }
+    void Close() {
+#ifdef _WIN32
+        fileContents.clear();
+#else
+        if (base != nullptr) munmap((void*)base, size);
+#endif
+        base = nullptr;
+        size = 0;
+        strings = nullptr;
+        stringsSize = 0;
+        entriesByName.clear();
+    }
+    bool IsOpen() const {
+        return base != nullptr;
+    }
+
+    bool HasObj(const string& filename) const {
+        return Find(filename + "#0", PACK_ENTRY_MESH) != nullptr;
+    }
+    bool HasMtl(const string& filename) const {
+        return Find(filename + "#0", PACK_ENTRY_MATERIAL) != nullptr;
+    }
+    bool HasTexture(const string& filename) const {
+        return Find(filename, PACK_ENTRY_TEXTURE) != nullptr;
+    }
+    bool HasData(const string& filename) const {
+        return Find(filename, PACK_ENTRY_DATA) != nullptr;
+    }
+    bool HasMeshBvh(const string& filename, int index = 0) const {
+        return Find(filename + "#" + to_string(index) + "#bvh", PACK_ENTRY_MESH_BVH) != nullptr;
+    }
+
+    // Every object packed from the given OBJ file, in file order
+    vector<PackedObj> GetObjs(const string& filename) const {
+        vector<PackedObj> result;
+        const PackEntry* entry;
+        for (int i = 0; (entry = Find(filename + "#" + to_string(i), PACK_ENTRY_MESH)) != nullptr; ++i) {
+            const uint8_t* payload = Payload(entry);
+            const PackMesh* packed = (const PackMesh*)payload;
+            PackedObj obj;
+            obj.name = String(packed->objectName);
+            obj.mesh.vertices = (const GLfloat*)(payload + packed->verticesOffset);
+            obj.mesh.indices = (const GLuint*)(payload + packed->indicesOffset);
+            obj.mesh.vertexCount = packed->vertexCount;
+            obj.mesh.floatsPerVertex = packed->floatsPerVertex;
+            obj.mesh.indexCount = packed->indexCount;
+            obj.mesh.attributes = (MeshAttributeFlags)packed->attributeFlags;
+            const PackSubmesh* submeshes = (const PackSubmesh*)(payload + packed->submeshesOffset);
+            for (uint32_t s = 0; s < packed->submeshCount; ++s) {
+                obj.mesh.submeshes.push_back(Submesh(submeshes[s].firstIndex, submeshes[s].indexCount, submeshes[s].materialIndex));
+            }
+            const PackMaterial* materials = (const PackMaterial*)(payload + packed->materialsOffset);
+            for (uint32_t m = 0; m < packed->materialCount; ++m) {
+                obj.materials.push_back(ToRawMtl(materials[m]));
+            }
+            if (!obj.materials.empty()) obj.materialData = obj.materials[0];
+            result.push_back(obj);
+        }
+        return result;
+    }
+
+    // Every material packed from the given MTL file, in file order
+    vector<RawMtl> GetMtls(const string& filename) const {
+        vector<RawMtl> result;
+        const PackEntry* entry;
+        for (int i = 0; (entry = Find(filename + "#" + to_string(i), PACK_ENTRY_MATERIAL)) != nullptr; ++i) {
+            result.push_back(ToRawMtl(*(const PackMaterial*)Payload(entry)));
+        }
+        return result;
+    }
+
+    bool GetTexture(const string& filename, PackedTexture& result) const {
+        const PackEntry* entry = Find(filename, PACK_ENTRY_TEXTURE);
+        if (entry == nullptr) return false;
+        const uint8_t* payload = Payload(entry);
+        const PackTexture* packed = (const PackTexture*)payload;
+        result.levels.clear();
+        result.invertY = packed->invertY != 0;
+        result.invertX = packed->invertX != 0;
+        int width = packed->width;
+        int height = packed->height;
+        for (int i = 0; i < packed->levelCount; ++i) {
+            ImageView level;
+            level.width = width;
+            level.height = height;
+            level.channels = packed->channels;
+            level.stride = (size_t)width * packed->channels;
+            level.data = payload + packed->levelOffsets[i];
+            result.levels.push_back(level);
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+        return true;
+    }
+
+    // Copies the collision BVH built from an object of the given OBJ file.
+    // Returns false, leaving result untouched, when it is missing or does not hold a valid hierarchy.
+    bool GetMeshBvh(const string& filename, MeshBvh& result, int index = 0) const {
+        const PackEntry* entry = Find(filename + "#" + to_string(index) + "#bvh", PACK_ENTRY_MESH_BVH);
+        if (entry == nullptr) return false;
+        const uint8_t* payload = Payload(entry);
+        const PackMeshBvh* packed = (const PackMeshBvh*)payload;
+        if (entry->size < sizeof(PackMeshBvh)
+            || packed->nodesOffset % alignof(MeshBvhNode) != 0 || packed->trianglesOffset % alignof(MeshBvhTriangle) != 0
+            || packed->nodesOffset + (uint64_t)packed->nodeCount * sizeof(MeshBvhNode) > entry->size
+            || packed->trianglesOffset + (uint64_t)packed->triangleCount * sizeof(MeshBvhTriangle) > entry->size) {
+            cerr << "Packed collision BVH of " << filename << " is corrupt, it will be rebuilt from the mesh." << endl;
+            return false;
+        }
+        try {
+            result.Assign((const MeshBvhNode*)(payload + packed->nodesOffset), packed->nodeCount, (const MeshBvhTriangle*)(payload + packed->trianglesOffset), packed->triangleCount);
+        } catch (const std::invalid_argument&) {
+            cerr << "Packed collision BVH of " << filename << " is corrupt, it will be rebuilt from the mesh." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // The raw contents of a packed data file, as a string so it can back a stringstream
+    string GetData(const string& filename) const {
+        const PackEntry* entry = Find(filename, PACK_ENTRY_DATA);
+        if (entry == nullptr) return "";
+        return string((const char*)Payload(entry), entry->size);
+    }
+};
+
+#endif
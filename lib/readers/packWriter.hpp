@@ -0,0 +1,323 @@
+#ifndef PACK_WRITER_HPP
+#define PACK_WRITER_HPP
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "packReader.hpp"
+#include "objReader.hpp"
+#include "mtlReader.hpp"
+#include "ppmReader.hpp"
+#include "../mipmaps.hpp"
+
+using namespace std;
+
+// Builds an asset pack offline, so the game can map its assets instead of parsing text files at startup.
+// Meshes are baked into their final interleaved vertex layout, textures are pre-flipped with their full mip chain,
+// and every texture referenced by a packed material is added automatically. Meshes used for collisions can also get their BVH baked.
+class AssetPackWriter {
+private:
+    struct PendingEntry {
+        PackEntryType type;
+        string name;
+        vector<uint8_t> payload;
+    };
+    vector<PendingEntry> entries;
+    unordered_set<string> names;
+    unordered_set<string> missingTextures;
+    string strings;
+    unordered_map<string, uint32_t> stringOffsets;
+    bool invertY;
+    bool invertX;
+
+    uint32_t AddString(const string& value) {
+        auto it = stringOffsets.find(value);
+        if (it != stringOffsets.end()) return it->second;
+        uint32_t offset = strings.size();
+        strings.append(value);
+        strings.push_back('\0');
+        stringOffsets[value] = offset;
+        return offset;
+    }
+    bool AddEntry(PackEntryType type, const string& name, vector<uint8_t>&& payload) {
+        if (names.find(name) != names.end()) return false;
+        names.insert(name);
+        PendingEntry entry;
+        entry.type = type;
+        entry.name = name;
+        entry.payload = std::move(payload);
+        entries.push_back(std::move(entry));
+        return true;
+    }
+    static size_t Align(size_t offset) {
+        return (offset + PACK_ALIGNMENT - 1) & ~(PACK_ALIGNMENT - 1);
+    }
+    static void Append(vector<uint8_t>& buffer, const void* data, size_t size) {
+        size_t start = buffer.size();
+        buffer.resize(start + size);
+        if (size > 0) memcpy(buffer.data() + start, data, size);
+    }
+    static void Pad(vector<uint8_t>& buffer) {
+        buffer.resize(Align(buffer.size()));
+    }
+
+    PackMaterial PackRawMtl(const RawMtl& mtl) {
+        PackMaterial result;
+        memset(&result, 0, sizeof(result));
+        for (int i = 0; i < 3; ++i) {
+            result.ambient[i] = mtl.ambient[i];
+            result.diffuse[i] = mtl.diffuse[i];
+            result.specular[i] = mtl.specular[i];
+            result.emissive[i] = mtl.emissive[i];
+        }
+        result.glossiness = mtl.glossiness;
+        result.dissolve = mtl.dissolve;
+        result.refractiveIndex = mtl.refractiveIndex;
+        result.illumMode = mtl.illumMode;
+        result.name = AddString(mtl.mtlName);
+        result.fileName = AddString(mtl.fileName);
+        result.ambientMap = AddString(mtl.ambientMapFile);
+        result.diffuseMap = AddString(mtl.diffuseMapFile);
+        result.specularMap = AddString(mtl.specularMapFile);
+        result.glossinessMap = AddString(mtl.glossinessMapFile);
+        result.dissolveMap = AddString(mtl.dissolveMapFile);
+        result.emissiveMap = AddString(mtl.emissiveMapFile);
+        result.normalMap = AddString(mtl.normalMapFile);
+        for (const string& file : mtl.GetFileNames()) {
+            if (file != "" && EndsWith(file, ".ppm")) AddTexture(file, file != mtl.normalMapFile);
+        }
+        return result;
+    }
+
+    // Renumbers vertices in the order the index buffer first uses them, so the GPU reads the vertex buffer front to back
+    static void ReorderVertices(vector<GLfloat>& vertices, vector<GLuint>& indices, size_t floatsPerVertex) {
+        size_t vertexCount = vertices.size() / floatsPerVertex;
+        const GLuint UNASSIGNED = 0xFFFFFFFF;
+        vector<GLuint> remap(vertexCount, UNASSIGNED);
+        vector<GLfloat> reordered;
+        reordered.reserve(vertices.size());
+        GLuint next = 0;
+        for (GLuint& index : indices) {
+            if (remap[index] == UNASSIGNED) {
+                remap[index] = next++;
+                reordered.insert(reordered.end(), vertices.begin() + index * floatsPerVertex, vertices.begin() + (index + 1) * floatsPerVertex);
+            }
+            index = remap[index];
+        }
+        vertices = std::move(reordered);
+    }
+public:
+    // Textures are stored flipped the way the game samples them, which matches LoadRawMtl's defaults
+    AssetPackWriter(bool invertY = true, bool invertX = false) {
+        this->invertY = invertY;
+        this->invertX = invertX;
+        AddString("");
+    }
+
+    // Packs every object in an OBJ file under "<filename>#<index>", along with its material and textures
+    int AddObj(const string& filename) {
+        if (HasEntry(filename + "#0")) return 0;
+        vector<ObjData> objects = ObjReader::ReadObj(filename);
+        const MeshAttributeFlags attributes = MESH_BASIC_AND_COLOR_DATA;
+        int index = 0;
+        for (const ObjData& obj : objects) {
+            vector<GLfloat> vertices = obj.mesh->GetArrayBuffer(attributes);
+            vector<GLuint> indices = obj.mesh->GetElementArrayBuffer();
+            if (obj.mesh->DataCount() == 0) continue;
+            size_t floatsPerVertex = vertices.size() / obj.mesh->DataCount();
+            ReorderVertices(vertices, indices, floatsPerVertex);
+
+            PackMesh info;
+            memset(&info, 0, sizeof(info));
+            info.objectName = AddString(obj.name);
+            info.attributeFlags = attributes;
+            info.vertexCount = vertices.size() / floatsPerVertex;
+            info.floatsPerVertex = floatsPerVertex;
+            info.indexCount = indices.size();
+            vector<PackSubmesh> submeshes;
+            for (const Submesh& s : obj.mesh->GetSubmeshes()) {
+                submeshes.push_back({(uint32_t)s.firstIndex, (uint32_t)s.indexCount, (uint32_t)s.materialIndex});
+            }
+            vector<PackMaterial> materials;
+            for (const RawMtl& mtl : obj.materials) {
+                materials.push_back(PackRawMtl(mtl));
+            }
+            info.submeshCount = submeshes.size();
+            info.materialCount = materials.size();
+
+            vector<uint8_t> payload;
+            Append(payload, &info, sizeof(info));
+            Pad(payload);
+            info.verticesOffset = payload.size();
+            Append(payload, vertices.data(), vertices.size() * sizeof(GLfloat));
+            Pad(payload);
+            info.indicesOffset = payload.size();
+            Append(payload, indices.data(), indices.size() * sizeof(GLuint));
+            Pad(payload);
+            info.submeshesOffset = payload.size();
+            Append(payload, submeshes.data(), submeshes.size() * sizeof(PackSubmesh));
+            Pad(payload);
+            info.materialsOffset = payload.size();
+            Append(payload, materials.data(), materials.size() * sizeof(PackMaterial));
+            memcpy(payload.data(), &info, sizeof(info));
+
+            AddEntry(PACK_ENTRY_MESH, filename + "#" + to_string(index++), std::move(payload));
+        }
+        return index;
+    }
+
+    // Builds and packs the collision BVH of every object in an OBJ file under "<filename>#<index>#bvh"
+    int AddMeshBvh(const string& filename) {
+        if (HasEntry(filename + "#0#bvh")) return 0;
+        vector<ObjData> objects = ObjReader::ReadObj(filename);
+        int index = 0;
+        for (const ObjData& obj : objects) {
+            if (obj.mesh->DataCount() == 0) continue;
+            MeshBvh bvh;
+            bvh.Build(*obj.mesh);
+
+            PackMeshBvh info;
+            memset(&info, 0, sizeof(info));
+            info.nodeCount = bvh.GetNodes().size();
+            info.triangleCount = bvh.GetTriangles().size();
+
+            vector<uint8_t> payload;
+            Append(payload, &info, sizeof(info));
+            Pad(payload);
+            info.nodesOffset = payload.size();
+            Append(payload, bvh.GetNodes().data(), bvh.GetNodes().size() * sizeof(MeshBvhNode));
+            Pad(payload);
+            info.trianglesOffset = payload.size();
+            Append(payload, bvh.GetTriangles().data(), bvh.GetTriangles().size() * sizeof(MeshBvhTriangle));
+            memcpy(payload.data(), &info, sizeof(info));
+
+            AddEntry(PACK_ENTRY_MESH_BVH, filename + "#" + to_string(index++) + "#bvh", std::move(payload));
+        }
+        return index;
+    }
+
+    // Packs every material in an MTL file under "<filename>#<index>", along with its textures
+    int AddMtl(const string& filename) {
+        if (HasEntry(filename + "#0")) return 0;
+        vector<RawMtl> materials = MtlReader::ReadMtl(filename);
+        int index = 0;
+        for (const RawMtl& mtl : materials) {
+            PackMaterial packed = PackRawMtl(mtl);
+            vector<uint8_t> payload;
+            Append(payload, &packed, sizeof(packed));
+            AddEntry(PACK_ENTRY_MATERIAL, filename + "#" + to_string(index++), std::move(payload));
+        }
+        return index;
+    }
+
+    // Packs a PPM texture and its mip chain. Returns false if the file could not be decoded.
+    // Pass srgb = false for data textures such as normal maps.
+    bool AddTexture(const string& filename, bool srgb = true) {
+        if (HasEntry(filename)) return true;
+        if (missingTextures.find(filename) != missingTextures.end()) return false;
+        Image image;
+        try {
+            image = PpmReader::ReadPpm(filename);
+        } catch (...) {
+            missingTextures.insert(filename);
+            cerr << "Unable to pack texture " << filename << ", it will be loaded from disk if it appears later." << endl;
+            return false;
+        }
+        image.Flip(invertY, invertX);
+        vector<Image> levels = BuildMipChain(image, srgb);
+        if (levels.size() > PACK_MAX_MIP_LEVELS) levels.resize(PACK_MAX_MIP_LEVELS);
+
+        PackTexture info;
+        memset(&info, 0, sizeof(info));
+        info.width = image.width;
+        info.height = image.height;
+        info.channels = image.channels;
+        info.levelCount = levels.size();
+        info.invertY = invertY;
+        info.invertX = invertX;
+
+        vector<uint8_t> payload;
+        Append(payload, &info, sizeof(info));
+        for (size_t i = 0; i < levels.size(); ++i) {
+            Pad(payload);
+            info.levelOffsets[i] = payload.size();
+            for (int y = 0; y < levels[i].height; ++y) {
+                Append(payload, levels[i].Row(y), levels[i].RowSize());
+            }
+        }
+        memcpy(payload.data(), &info, sizeof(info));
+        return AddEntry(PACK_ENTRY_TEXTURE, filename, std::move(payload));
+    }
+
+    // Packs the contents of any file as is
+    bool AddData(const string& filename) {
+        if (HasEntry(filename)) return true;
+        ifstream in(filename, ios::binary);
+        if (!in.is_open()) {
+            cerr << "Unable to pack data file " << filename << endl;
+            return false;
+        }
+        vector<uint8_t> payload((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        return AddEntry(PACK_ENTRY_DATA, filename, std::move(payload));
+    }
+
+    // Picks the right Add method from the file extension
+    bool Add(const string& filename) {
+        if (EndsWith(filename, ".obj")) return AddObj(filename) > 0;
+        if (EndsWith(filename, ".mtl")) return AddMtl(filename) > 0;
+        if (EndsWith(filename, ".ppm")) return AddTexture(filename);
+        return AddData(filename);
+    }
+
+    bool HasEntry(const string& name) const {
+        return names.find(name) != names.end();
+    }
+    size_t EntryCount() const {
+        return entries.size();
+    }
+
+    bool Write(const string& filename) {
+        vector<uint8_t> buffer;
+        PackHeader header;
+        memset(&header, 0, sizeof(header));
+        Append(buffer, &header, sizeof(header));
+
+        vector<PackEntry> table;
+        for (const PendingEntry& entry : entries) {
+            Pad(buffer);
+            PackEntry packed;
+            packed.type = entry.type;
+            packed.name = AddString(entry.name);
+            packed.offset = buffer.size();
+            packed.size = entry.payload.size();
+            table.push_back(packed);
+            Append(buffer, entry.payload.data(), entry.payload.size());
+        }
+        Pad(buffer);
+        memcpy(header.magic, PACK_MAGIC, 4);
+        header.version = PACK_VERSION;
+        header.entryCount = table.size();
+        header.entriesOffset = buffer.size();
+        Append(buffer, table.data(), table.size() * sizeof(PackEntry));
+        header.stringsOffset = buffer.size();
+        header.stringsSize = strings.size();
+        Append(buffer, strings.data(), strings.size());
+        memcpy(buffer.data(), &header, sizeof(header));
+
+        ofstream out(filename, ios::binary);
+        if (!out.is_open()) {
+            cerr << "Unable to open " << filename << " for writing." << endl;
+            return false;
+        }
+        out.write((const char*)buffer.data(), buffer.size());
+        return out.good();
+    }
+};
+
+#endif
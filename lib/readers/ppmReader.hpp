@@ -30,77 +30,90 @@ vector<int> ReadInts(istream& stream) {
     return result;
 }
 
+// Parses the next non-negative integer from a PPM text body, skipping whitespace and comments.
+// Returns false once the end of the text is reached.
+bool NextPpmInt(const char*& cursor, const char* end, int& value) {
+    while (cursor < end) {
+        char c = *cursor;
+        if (c == '#') {
+            while (cursor < end && *cursor != '\n') ++cursor;
+        } else if (c >= '0' && c <= '9') {
+            break;
+        } else {
+            ++cursor;
+        }
+    }
+    if (cursor >= end) return false;
+    value = 0;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+        value = value * 10 + (*cursor - '0');
+        ++cursor;
+    }
+    return true;
+}
+
 class PpmReader {
 public:
     static Image ReadPpm(const string& filename, bool verbose = false) {
-        ifstream in;
-        in.open(filename);
+        ifstream in(filename, ios::binary);
+        stringstream contents;
+        contents << in.rdbuf();
+        in.close();
+        string text = contents.str();
         Image result;
 
-        string line;
         // Process the magic number
-        while (NextNonComment(in, line)) {
-            if (line == "P3") break;
+        istringstream header(text);
+        string line;
+        while (NextNonComment(header, line)) {
+            if (line.compare(0, 2, "P3") == 0) break;
             cerr << "Received incompatible magic number code: " << line << ". Aborting..." << endl;
             throw 1;
         }
 
         if(verbose) cout << "PPM > Detected P3 signature" << endl;
 
-        auto values = ReadInts(in);
-        in.close();
-
-        if(verbose) cout << "PPM > Finished reading all numbers" << endl;
-        //for (int n : values) {
-        //    cout << n << " ";
-        //}
-        //cout << endl;
+        const char* cursor = text.data() + text.find("P3") + 2;
+        const char* end = text.data() + text.size();
 
-        if (values.size() < 3) {
+        int width, height, range;
+        if (!NextPpmInt(cursor, end, width) || !NextPpmInt(cursor, end, height) || !NextPpmInt(cursor, end, range)) {
             cerr << "Unable to process PPM files without at least width, height, and range provided. Aborting..." << endl;
             throw 1;
         }
-
-        int i = 0;
-        // Process dimensions
-        result.width = values.at(i++);
-        result.height = values.at(i++);
         // Process range
-        int range = values.at(i++);
         if (range > 255) {
             cerr << "Unable to process PPM files with a range higher than 255, received range " << range << ". Aborting..." << endl;
             throw 1;
         }
 
-        if(verbose) cout << "PPM > Parsed width, height, and range, (" << result.width << "x" << result.height << ") r=" << range << endl;
+        if(verbose) cout << "PPM > Parsed width, height, and range, (" << width << "x" << height << ") r=" << range << endl;
 
         // We will use this factor to normalize our pixel data to the 0-256 (incl. excl.) range.
         float normFactor = 256/(range+1);
 
-        // Process RGB value sequence
+        // Process RGB value sequence straight into the image buffer
+        result.Allocate(width, height, 3);
+        size_t expected = result.ByteSize();
+        size_t written = 0;
         int value;
-        vector<uint8_t> rawBytes;
-        while (i < values.size()) {
-            value = values.at(i++);
-            if (value < 0 || value > range) {
+        while (NextPpmInt(cursor, end, value)) {
+            if (value > range) {
                 cerr << "WARN: Ignoring value outside of specified range while reading RGB values: " << value << endl;
                 continue;
             }
-            rawBytes.push_back((int)(value * normFactor));
+            if (written < expected) result.data[written] = (uint8_t)(value * normFactor);
+            ++written;
         }
 
-        if (rawBytes.size() != 3 * result.height * result.width) {
-            cerr << "WARN: PPM dimensions (" << result.width << "x" << result.height 
-            << ") and the number of pixel bytes (" << rawBytes.size() 
-            << ") do not match, expected to receive " << 3 * result.height * result.width << " values" << endl;
+        if (written != expected) {
+            cerr << "WARN: PPM dimensions (" << width << "x" << height 
+            << ") and the number of pixel bytes (" << written 
+            << ") do not match, expected to receive " << expected << " values" << endl;
         }
 
-        for (i = 0; i < rawBytes.size() - 2; i += 3) {
-            result.pixels.push_back(Pixel(rawBytes.at(i),rawBytes.at(i+1),rawBytes.at(i+2)));
-        }
+        if(verbose) cout << "PPM > Finished reading all numbers" << endl;
         return result;
-
-        //cout << "Finished processing file " << fileName << ", parsed " << m_pixelData.size() << " rgb bytes worth of data." << endl;
     }
     
     static void SavePPM(const Image& img, const string& outputFileName) {
@@ -111,8 +124,11 @@ public:
         file << img.width << " " << img.height << endl;
         file << 255 << endl;
 
-        for (Pixel p : img.pixels) {
-            file << p.r << " " << p.g << " " << p.b << endl;
+        for (int y = 0; y < img.height; ++y) {
+            for (int x = 0; x < img.width; ++x) {
+                Pixel p = img.GetPixel(x, y);
+                file << (int)p.r << " " << (int)p.g << " " << (int)p.b << endl;
+            }
         }
         file.close();
     }
@@ -6,6 +6,7 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <vector>
 #include <fstream>
 #include <iostream>
 #include <unordered_set>
@@ -138,6 +139,37 @@ GLuint CreateShaderProgram(const std::string& vertexShaderSource, const std::str
     return programObject;
 }
 
+/**
+* Creates a program that only runs a vertex shader and captures the given outputs with transform feedback, interleaved in order.
+*
+* @param vertexShaderSource Vertex source code as a string
+* @param varyings Names of the captured vertex shader outputs
+* @return id of the program Object, or 0 if it failed to link
+*/
+GLuint CreateTransformFeedbackProgram(const std::string& vertexShaderSource, const std::vector<const char*>& varyings){
+    GLuint programObject = glCreateProgram();
+    GLuint myVertexShader = CompileShader(GL_VERTEX_SHADER, vertexShaderSource);
+    glAttachShader(programObject,myVertexShader);
+    // Outputs have to be declared before linking
+    glTransformFeedbackVaryings(programObject, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(programObject);
+    glDetachShader(programObject,myVertexShader);
+    glDeleteShader(myVertexShader);
+
+    int result;
+    glGetProgramiv(programObject, GL_LINK_STATUS, &result);
+    if(result == GL_FALSE){
+        int length;
+        glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> errorMessages(length + 1);
+        glGetProgramInfoLog(programObject, length, &length, errorMessages.data());
+        std::cout << "ERROR: transform feedback program failed to link!\n" << errorMessages.data() << "\n";
+        glDeleteProgram(programObject);
+        return 0;
+    }
+    return programObject;
+}
+
 /**
 * Create the graphics pipeline
 *
@@ -305,6 +337,7 @@ public:
 	Material(Shader* shader) {
 		this->shader = shader;
 	}
+	virtual ~Material() {}
 
 	void SetValue(const string& name, float value) {
 		valueProperties[name] = value;
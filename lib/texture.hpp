@@ -2,7 +2,11 @@
 #define TEXTURE_HPP
 
 #include <SDL2/SDL.h>
+#include <glad/glad.h>
 #include <vector>
+#include <string>
+#include <cstring>
+#include <stdint.h>
 
 struct Pixel {
     uint8_t r,g,b;
@@ -19,37 +23,111 @@ struct Pixel {
     }
 };
 
+// A read-only window over pixel data owned elsewhere, such as an Image or a mapped asset pack
+struct ImageView {
+    int width = 0;
+    int height = 0;
+    int channels = 3;
+    size_t stride = 0;
+    const uint8_t* data = nullptr;
+};
+
+// An Image holds its pixels as one contiguous block of bytes, row after row.
+// Each row spans `stride` bytes, of which the first `width * channels` are pixel data.
 struct Image {
-    int width;
-    int height;
-    std::vector<Pixel> pixels;
-    void Dump(std::vector<unsigned char>& buffer, bool invertY = true, bool invertX = false) const {
-        if (!invertY && !invertX) {
-            for (Pixel p : pixels) {
-                buffer.push_back(p.r);
-                buffer.push_back(p.g);
-                buffer.push_back(p.b);
+    int width = 0;
+    int height = 0;
+    int channels = 3;
+    size_t stride = 0;
+    std::vector<uint8_t> data;
+
+    Image(int width = 0, int height = 0, int channels = 3) {
+        Allocate(width, height, channels);
+    }
+    void Allocate(int width, int height, int channels = 3) {
+        this->width = width;
+        this->height = height;
+        this->channels = channels;
+        this->stride = (size_t)width * channels;
+        data.resize(stride * height);
+    }
+
+    uint8_t* Row(int y) {return data.data() + y * stride;}
+    const uint8_t* Row(int y) const {return data.data() + y * stride;}
+    size_t RowSize() const {return (size_t)width * channels;}
+    size_t ByteSize() const {return stride * height;}
+    ImageView View() const {
+        ImageView view;
+        view.width = width;
+        view.height = height;
+        view.channels = channels;
+        view.stride = stride;
+        view.data = data.data();
+        return view;
+    }
+
+    Pixel GetPixel(int x, int y) const {
+        const uint8_t* p = Row(y) + x * channels;
+        return Pixel(p[0], p[channels > 1 ? 1 : 0], p[channels > 2 ? 2 : 0]);
+    }
+    void SetPixel(int x, int y, const Pixel& color) {
+        uint8_t* p = Row(y) + x * channels;
+        p[0] = color.r;
+        if (channels > 1) p[1] = color.g;
+        if (channels > 2) p[2] = color.b;
+        if (channels > 3) p[3] = 255;
+    }
+
+    // Swaps rows in place, top to bottom, one memcpy per row.
+    void FlipVertical() {
+        size_t rowSize = RowSize();
+        std::vector<uint8_t> scratch(rowSize);
+        for (int top = 0, bottom = height - 1; top < bottom; ++top, --bottom) {
+            std::memcpy(scratch.data(), Row(top), rowSize);
+            std::memcpy(Row(top), Row(bottom), rowSize);
+            std::memcpy(Row(bottom), scratch.data(), rowSize);
+        }
+    }
+    void FlipHorizontal() {
+        for (int y = 0; y < height; ++y) {
+            uint8_t* row = Row(y);
+            for (int left = 0, right = width - 1; left < right; ++left, --right) {
+                for (int c = 0; c < channels; ++c) {
+                    std::swap(row[left * channels + c], row[right * channels + c]);
+                }
             }
-        } else {
-            for (int y = height - 1; y >= 0; --y) {
-                int start = invertX ? ((y+1) * width - 1) : (( y ) * width);
-                int limit = invertX ? (( y ) * width - 1) : ((y+1) * width);
-                int step  = invertX ? -1 : 1;
-                for (int idx = start; idx != limit; idx += step) {
-                    buffer.push_back(pixels.at(idx).r);
-                    buffer.push_back(pixels.at(idx).g);
-                    buffer.push_back(pixels.at(idx).b);
+        }
+    }
+    void Flip(bool invertY, bool invertX = false) {
+        if (invertY) FlipVertical();
+        if (invertX) FlipHorizontal();
+    }
+
+    // Copies the tightly packed pixel data into a buffer, optionally flipped.
+    void Dump(std::vector<unsigned char>& buffer, bool invertY = true, bool invertX = false) const {
+        size_t rowSize = RowSize();
+        size_t start = buffer.size();
+        buffer.resize(start + rowSize * height);
+        for (int y = 0; y < height; ++y) {
+            int sourceY = invertY ? (height - 1 - y) : y;
+            std::memcpy(buffer.data() + start + y * rowSize, Row(sourceY), rowSize);
+        }
+        if (!invertX) return;
+        for (int y = 0; y < height; ++y) {
+            unsigned char* row = buffer.data() + start + y * rowSize;
+            for (int left = 0, right = width - 1; left < right; ++left, --right) {
+                for (int c = 0; c < channels; ++c) {
+                    std::swap(row[left * channels + c], row[right * channels + c]);
                 }
             }
         }
     }
     static Image Solid(const Pixel& color, int width = 1, int height = 1) {
-        Image result;
-        result.height = height;
-        result.width = width;
-        for (int i = 0; i < width * height; ++i) {
-            result.pixels.push_back(color);
-            std::cout << "Added color " << Pixel::ToString(color) << " to image" << std::endl; 
+        Image result(width, height, 3);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                result.SetPixel(x, y, color);
+            }
         }
         return result;
     }
@@ -57,7 +135,7 @@ struct Image {
         std::string result = "";
         for (int i = 0; i < img.height; ++i) {
             for (int j = 0; j < img.width; ++j) {
-                result += img.pixels[i * img.width + j].ToString() + " ";
+                result += img.GetPixel(j, i).ToString() + " ";
             }
             result += "\n";
         }
@@ -73,6 +151,8 @@ protected:
     GLuint handle;
     int width;
     int height;
+    int channels = 3;
+    int levels = 1;
 public:
     Texture2D(GLuint handle = 0, int width = 0, int height = 0, GLenum warpMode = GL_REPEAT, GLenum minFilter = GL_LINEAR_MIPMAP_NEAREST, GLenum magFilter = GL_LINEAR) {
         this->handle = handle;
@@ -88,6 +168,113 @@ public:
     GLuint GetHandle() const {return handle;}
     int GetWidth() const {return width;}
     int GetHeight() const {return height;}
+    int GetChannels() const {return channels;}
+    int GetLevels() const {return levels;}
+    Texture2D* SetStorageInfo(int channels, int levels) {
+        this->channels = channels;
+        this->levels = levels;
+        return this;
+    }
+    // Approximate GPU memory used by the texture, including its mip chain
+    size_t GetByteSize() const {
+        size_t total = 0;
+        int w = width, h = height;
+        for (int i = 0; i < levels; ++i) {
+            total += (size_t)w * h * channels;
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+        return total;
+    }
 };
 
+// Number of mip levels needed to reduce a texture of the given size down to 1x1
+int MipLevelCount(int width, int height) {
+    int levels = 1;
+    int size = width > height ? width : height;
+    while (size > 1) {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+bool UsesMipmaps(GLenum minFilter) {
+    return minFilter != GL_LINEAR && minFilter != GL_NEAREST;
+}
+
+GLenum ImageFormat(int channels) {
+    switch (channels) {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 4: return GL_RGBA;
+        default: return GL_RGB;
+    }
+}
+
+// Specifies the storage and contents of an existing texture handle from an image's layout.
+// `pixels` is normally the image's own buffer, but may be an offset into a bound GL_PIXEL_UNPACK_BUFFER.
+Texture2D UploadTexture(GLuint handle, const Image& image, const void* pixels, GLenum wrapMode=GL_REPEAT, GLenum minFilter=GL_LINEAR_MIPMAP_LINEAR, GLenum magFilter=GL_LINEAR) {
+    int levels = UsesMipmaps(minFilter) ? MipLevelCount(image.width, image.height) : 1;
+    GLenum format = ImageFormat(image.channels);
+
+    glBindTexture(GL_TEXTURE_2D, handle);
+    // Set wrapping and filtering
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+    // Pin the level range so the texture is mip-complete with exactly the levels we provide.
+    // (glTexStorage2D would do this for us, but it is not part of the GL 3.3 loader we ship)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    // Rows are tightly packed bytes, so they may not be 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.stride / image.channels);
+    // Push the image pixel data to the GPU
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    if (levels > 1) glGenerateMipmap(GL_TEXTURE_2D);
+    // Restore the default unpack state
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    // Unbind the texture
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Texture2D result(handle, image.width, image.height, wrapMode, minFilter, magFilter);
+    result.SetStorageInfo(image.channels, levels);
+    return result;
+}
+
+// Specifies a texture from a precomputed mip chain, one level per view, largest first.
+// Mipmapped filtering is only used if the chain reaches 1x1, otherwise the base level is filtered linearly.
+Texture2D UploadTextureLevels(GLuint handle, const ImageView* levels, int levelCount, GLenum wrapMode=GL_REPEAT, GLenum minFilter=GL_LINEAR_MIPMAP_LINEAR, GLenum magFilter=GL_LINEAR) {
+    const ImageView& base = levels[0];
+    if (levelCount < MipLevelCount(base.width, base.height) && minFilter != GL_NEAREST) {
+        levelCount = 1;
+        minFilter = GL_LINEAR;
+    }
+    GLenum format = ImageFormat(base.channels);
+
+    glBindTexture(GL_TEXTURE_2D, handle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < levelCount; ++i) {
+        const ImageView& level = levels[i];
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, level.stride / level.channels);
+        glTexImage2D(GL_TEXTURE_2D, i, format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, level.data);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Texture2D result(handle, base.width, base.height, wrapMode, minFilter, magFilter);
+    result.SetStorageInfo(base.channels, levelCount);
+    return result;
+}
+
 #endif
@@ -0,0 +1,159 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <glad/glad.h>
+
+#include <string>
+#include <stdint.h>
+#include <iostream>
+#include <functional>
+#include <filesystem>
+#include <unordered_map>
+
+#include "texture.hpp"
+
+// Sampling and orientation options that are baked into an uploaded texture.
+// Two requests for the same file only share a texture if these match.
+struct SamplerState {
+    GLenum wrapMode;
+    GLenum minFilter;
+    GLenum magFilter;
+    bool invertY;
+    bool invertX;
+    // Whether the texture holds sRGB colors, which decides how its mip levels are filtered
+    bool srgb;
+    SamplerState(GLenum wrapMode = GL_REPEAT, GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR, GLenum magFilter = GL_LINEAR, bool invertY = true, bool invertX = false, bool srgb = true) {
+        this->wrapMode = wrapMode;
+        this->minFilter = minFilter;
+        this->magFilter = magFilter;
+        this->invertY = invertY;
+        this->invertX = invertX;
+        this->srgb = srgb;
+    }
+    std::string ToKey() const {
+        return std::to_string(wrapMode) + ":" + std::to_string(minFilter) + ":" + std::to_string(magFilter) + ":" + (invertY ? "y" : "") + (invertX ? "x" : "") + (srgb ? "s" : "");
+    }
+};
+
+// A program-wide store of textures loaded from files.
+// Each file is decoded and uploaded once per sampler state, and shared by every material that uses it.
+// Users hold references through Acquire/Release, and the GL texture is deleted once the last reference is released.
+class TextureCache {
+private:
+    struct Entry {
+        Texture2D texture;
+        int refCount = 0;
+        // Tells entries apart even when GL hands a deleted texture's name to a new one
+        uint64_t generation = 0;
+    };
+    std::unordered_map<std::string, Entry> entries;
+    uint64_t nextGeneration = 1;
+    std::unordered_map<GLuint, std::string> keysByHandle;
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t residentBytes = 0;
+
+    static std::string BuildKey(const std::string& file, const SamplerState& sampler) {
+        return CanonicalPath(file) + "|" + sampler.ToKey();
+    }
+public:
+    ~TextureCache() {
+        Clear();
+    }
+
+    // Resolves relative segments and links so different spellings of a path share a key
+    static std::string CanonicalPath(const std::string& file) {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(file, error);
+        if (error) return file;
+        return canonical.string();
+    }
+
+    // Returns the cached texture for the file, or runs `load` to create it on a miss.
+    // `load` is given the generation of the new entry, to check later through IsCurrent.
+    // Every successful call adds a reference that must be returned through Release.
+    Texture2D Acquire(const std::string& file, const SamplerState& sampler, const std::function<Texture2D(uint64_t)>& load) {
+        std::string key = BuildKey(file, sampler);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            hits++;
+            it->second.refCount++;
+            return it->second.texture;
+        }
+        misses++;
+        Entry entry;
+        entry.generation = nextGeneration++;
+        entry.texture = load(entry.generation);
+        entry.refCount = 1;
+        if (entry.texture.GetHandle() == 0) return entry.texture;
+        residentBytes += entry.texture.GetByteSize();
+        keysByHandle[entry.texture.GetHandle()] = key;
+        entries[key] = entry;
+        return entry.texture;
+    }
+
+    // Drops one reference to the texture. Textures that were not created by the cache are ignored.
+    // Returns true if the texture was deleted as a result.
+    bool Release(const Texture2D& texture) {
+        auto handleIt = keysByHandle.find(texture.GetHandle());
+        if (handleIt == keysByHandle.end()) return false;
+        auto it = entries.find(handleIt->second);
+        if (--it->second.refCount > 0) return false;
+        GLuint handle = it->second.texture.GetHandle();
+        residentBytes -= it->second.texture.GetByteSize();
+        glDeleteTextures(1, &handle);
+        keysByHandle.erase(handleIt);
+        entries.erase(it);
+        return true;
+    }
+
+    // Updates the stored description of a texture whose contents were replaced after it was acquired,
+    // for example once a streamed texture finishes uploading.
+    void Refresh(const Texture2D& texture) {
+        auto handleIt = keysByHandle.find(texture.GetHandle());
+        if (handleIt == keysByHandle.end()) return;
+        Entry& entry = entries[handleIt->second];
+        residentBytes -= entry.texture.GetByteSize();
+        entry.texture = texture;
+        residentBytes += entry.texture.GetByteSize();
+    }
+
+    bool Owns(const Texture2D& texture) const {
+        return keysByHandle.find(texture.GetHandle()) != keysByHandle.end();
+    }
+    // Whether the texture is still the one the entry of the given generation was created with,
+    // rather than a later texture that was given the same GL name after it was released
+    bool IsCurrent(const Texture2D& texture, uint64_t generation) const {
+        auto handleIt = keysByHandle.find(texture.GetHandle());
+        return handleIt != keysByHandle.end() && entries.at(handleIt->second).generation == generation;
+    }
+
+    // Deletes every resident texture regardless of outstanding references
+    void Clear() {
+        for (auto& pair : entries) {
+            GLuint handle = pair.second.texture.GetHandle();
+            glDeleteTextures(1, &handle);
+        }
+        entries.clear();
+        keysByHandle.clear();
+        residentBytes = 0;
+    }
+
+    size_t GetHits() const {return hits;}
+    size_t GetMisses() const {return misses;}
+    size_t GetResidentCount() const {return entries.size();}
+    size_t GetResidentBytes() const {return residentBytes;}
+    float GetHitRate() const {
+        size_t total = hits + misses;
+        return total == 0 ? 0 : (float)hits / total;
+    }
+
+    void PrintStats() const {
+        std::cout << "Texture cache: " << GetResidentCount() << " resident textures, "
+            << (GetResidentBytes() / 1024) << " KiB, "
+            << hits << " hits / " << misses << " misses ("
+            << (int)(GetHitRate() * 100) << "% hit rate)" << std::endl;
+    }
+};
+
+#endif
@@ -1,5 +1,7 @@
 # Run with: python3 build.py
+# Build the asset packer instead with: python3 build.py packer
 import os
+import sys
 import platform
 
 # (1)==================== COMMON CONFIGURATION OPTIONS ======================= #
@@ -7,6 +9,11 @@ COMPILER="g++ -g -std=c++17"   # The compiler we want to use
                                 #(You may try g++ if you have trouble)
 SOURCE="./src/*.cpp"    # Where the source code lives
 EXECUTABLE="prog"        # Name of the final executable
+
+# The asset packer is a separate tool, see tools/assetPacker.cpp
+if len(sys.argv) > 1 and sys.argv[1]=="packer":
+    SOURCE="./tools/assetPacker.cpp ./src/glad.cpp"
+    EXECUTABLE="packer"
 # ======================= COMMON CONFIGURATION OPTIONS ======================= #
 
 # (2)=================== Platform specific configuration ===================== #
@@ -18,7 +25,7 @@ LIBRARIES=""            # What libraries do we want to include
 if platform.system()=="Linux":
     ARGUMENTS="-D LINUX" # -D is a #define sent to preprocessor
     INCLUDE_DIR="-I ./include/ -I ./../lib/glm/"
-    LIBRARIES="-lSDL2 -ldl"
+    LIBRARIES="-lSDL2 -ldl -pthread"
 elif platform.system()=="Darwin":
     ARGUMENTS="-D MAC" # -D is a #define sent to the preprocessor.
     INCLUDE_DIR="-I ./include/ -I/Library/Frameworks/SDL2.framework/Headers -I ./../lib/glm/"
@@ -26,7 +33,7 @@ elif platform.system()=="Darwin":
 elif platform.system()=="Windows":
     ARGUMENTS="-D MINGW -static-libgcc -static-libstdc++" 
     INCLUDE_DIR="-I./include/ -I./../lib/glm/"
-    EXECUTABLE="prog.exe"
+    EXECUTABLE=EXECUTABLE+".exe"
     LIBRARIES="-lmingw32 -lSDL2main -lSDL2"
 # (2)=================== Platform specific configuration ===================== #
 
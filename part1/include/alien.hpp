@@ -5,7 +5,7 @@
 #include <sstream>
 
 #include "../../lib/gameObject.hpp"
-#include "../../lib/collision/layer.hpp"
+#include "../../lib/collision/world.hpp"
 #include "../../lib/geometry/bulk.hpp"
 #include "../../lib/extensions/collectionUtils.hpp"
 #include "../../lib/glHelper.hpp"
@@ -34,14 +34,14 @@ public:
 
     static float zOffset;
 
-    Alien(std::string name, Transform transform, MeshHandle mesh, Material* material, CollisionLayer* layer = nullptr) 
+    Alien(std::string name, Transform transform, MeshHandle mesh, Material* material, CollisionWorld* world = nullptr, CollisionLayerIndex layer = 0) 
     : GameObject(name, transform, mesh, material) {
         collider = new SphereCollider(transform.GetPosition(), ALIEN_COLLIDER_RADIUS, {0,0,-zOffset});
         collider->OnCollisionEnter.AddListener(&CollisionHandler);
         this->AddComponent(collider);
         collider->Initialize();
-        if (layer != nullptr) {
-            AttachToCollisionLayer(layer);
+        if (world != nullptr) {
+            AttachToCollisionWorld(world, layer);
         }
         instance = (new Instance(this))->AddAttribute(vec4(1));
         Reset();
@@ -50,8 +50,8 @@ public:
         delete instance;
     }
     
-    void AttachToCollisionLayer(CollisionLayer* layer) {
-        layer->AddCollider(collider);
+    void AttachToCollisionWorld(CollisionWorld* world, CollisionLayerIndex layer) {
+        world->AddCollider(collider, layer);
     }
     void SetColor(glm::vec4 newColor) {
         instance->extraAttribs.at(0) = newColor;
@@ -70,9 +70,20 @@ public:
         
     }
 
+    // When set, layouts are parsed from this text instead of the layout file, for example with the contents from an asset pack
+    static std::string layoutData;
+    static constexpr const char* LAYOUT_FILE = "./media/data/alien_layouts.txt";
+
     static vector<vector<vector<unsigned char>>> ReadLayouts() {
         //std::cout << "Reading alien layouts" << std::endl;
-        ifstream layoutFile("./media/data/alien_layouts.txt");
+        if (layoutData != "") {
+            std::istringstream layoutStream(layoutData);
+            return ReadLayouts(layoutStream);
+        }
+        ifstream layoutFile(LAYOUT_FILE);
+        return ReadLayouts(layoutFile);
+    }
+    static vector<vector<vector<unsigned char>>> ReadLayouts(std::istream& layoutFile) {
         vector<vector<vector<unsigned char>>> result;
 
         std::string line;
@@ -121,6 +132,7 @@ public:
 };
 
 float Alien::zOffset {-0.25f};
+std::string Alien::layoutData {""};
 std::vector<glm::vec4> Alien::colors {
     {
         {1,0.2,0.2,1},
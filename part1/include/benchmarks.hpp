@@ -0,0 +1,837 @@
+#ifndef BENCHMARKS_HPP
+#define BENCHMARKS_HPP
+
+// Offline measurements and correctness checks that run in place of the game loop.
+// Usage: ./prog --benchmark <name>
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <functional>
+
+#include "../../lib/glHelper.hpp"
+#include "../../lib/texture.hpp"
+#include "../../lib/mipmaps.hpp"
+#include "../../lib/entities.hpp"
+#include "../../lib/particles.hpp"
+#include "../../lib/jobs.hpp"
+#include "../../lib/collision/layer.hpp"
+#include "../../lib/collision/world.hpp"
+#include "../../lib/extensions/allocations.hpp"
+#include "../../lib/readers/ppmReader.hpp"
+#include "../../lib/readers/objReader.hpp"
+
+const std::vector<std::string> BUNDLED_TEXTURES = {
+    "./media/objects/Background.ppm",
+    "./media/objects/BulletTexture.ppm",
+    "./media/objects/Flame.ppm",
+    "./media/objects/StarTexture.ppm"
+};
+
+// Runs the given function a number of times and returns the average duration in milliseconds.
+double TimeAverageMs(int iterations, const std::function<void()>& func) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        func();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+// Like TimeAverageMs, after one untimed run that fills whatever the function keeps between runs, such as broadphases
+double TimeWarmAverageMs(int iterations, const std::function<void()>& func) {
+    func();
+    return TimeAverageMs(iterations, func);
+}
+
+void BenchmarkTextureLoad(GLProgram* program, int iterations = 5) {
+    std::cout << "texture load (" << iterations << " iterations each)" << std::endl;
+    for (const std::string& file : BUNDLED_TEXTURES) {
+        Image img;
+        double decodeMs = TimeAverageMs(iterations, [&]() {
+            img = PpmReader::ReadPpm(file);
+        });
+        double flipMs = TimeAverageMs(iterations, [&]() {
+            img.FlipVertical();
+        });
+        double uploadMs = TimeAverageMs(iterations, [&]() {
+            Texture2D tex = program->LoadTexture(&img, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, false, false);
+            glFinish();
+            GLuint handle = tex.GetHandle();
+            glDeleteTextures(1, &handle);
+        });
+        std::cout << "  " << file << " (" << img.width << "x" << img.height << ")"
+            << "  decode " << decodeMs << " ms"
+            << "  flip " << flipMs << " ms"
+            << "  upload " << uploadMs << " ms" << std::endl;
+    }
+}
+
+// Compares letting the driver build mip chains against building them on the CPU and uploading every level
+void BenchmarkMipmaps(int iterations = 5) {
+    std::cout << "mip chain generation (" << iterations << " iterations each)" << std::endl;
+    for (const std::string& file : BUNDLED_TEXTURES) {
+        Image img = PpmReader::ReadPpm(file);
+        double driverMs = TimeAverageMs(iterations, [&]() {
+            GLuint handle;
+            glGenTextures(1, &handle);
+            UploadTexture(handle, img, img.data.data());
+            glFinish();
+            glDeleteTextures(1, &handle);
+        });
+        std::vector<Image> levels;
+        double buildMs = TimeAverageMs(iterations, [&]() {
+            levels = BuildMipChain(img);
+        });
+        std::vector<ImageView> views = ViewLevels(levels);
+        double uploadMs = TimeAverageMs(iterations, [&]() {
+            GLuint handle;
+            glGenTextures(1, &handle);
+            UploadTextureLevels(handle, views.data(), views.size());
+            glFinish();
+            glDeleteTextures(1, &handle);
+        });
+        std::cout << "  " << file << " (" << img.width << "x" << img.height << ", " << levels.size() << " levels)"
+            << "  glGenerateMipmap " << driverMs << " ms"
+            << "  cpu build " << buildMs << " ms"
+            << "  level upload " << uploadMs << " ms"
+            << "  (cpu total " << (buildMs + uploadMs) << " ms)" << std::endl;
+    }
+}
+
+// Particle simulated the way game objects used to be: state in the object, advanced by a virtual Update
+class LegacyParticle : public GameObject {
+public:
+    float initialLifetime = 1000;
+    float lifetime = 1000;
+    vec3 initialVelocity;
+    vec3 velocity;
+    vec3 angularVelocity;
+    vec3 initialScale = vec3(1);
+    vec4 color;
+    LegacyParticle(vec3 velocity, vec3 angularVelocity) : GameObject("Legacy Particle", Transform()) {
+        this->initialVelocity = this->velocity = velocity;
+        this->angularVelocity = angularVelocity;
+    }
+    virtual void Update(GLProgram* program) {
+        float t = lifetime / initialLifetime;
+        transform.Translate(velocity * program->deltaTime);
+        transform.SetScale(initialScale * t);
+        transform.Rotate(angularVelocity * program->deltaTime);
+        velocity = initialVelocity * (0.3f + 0.7f * t);
+        color = vec4(1) * t + vec4(0.4,0.2,1,1) * (1 - t);
+        lifetime -= program->deltaTime;
+    }
+};
+
+// Compares a frame of particle simulation through per-object virtual Updates against the entity systems,
+// both on their own and with every entity synced back into a GameObject through an EntityBinding
+void BenchmarkEntities(GLProgram* program, int count = 10000, int iterations = 100) {
+    std::cout << "particle simulation, " << count << " entities (" << iterations << " frames each)" << std::endl;
+    const float FRAME_TIME = 1 / 60.0f;
+    float previousDeltaTime = program->deltaTime;
+    program->deltaTime = FRAME_TIME;
+
+    std::vector<GameObject*> legacy;
+    for (int i = 0; i < count; ++i) {
+        legacy.push_back(new LegacyParticle(RandomPointAround({0,0,0}, 0, 4), RandomPointAround({0,0,0}, 0, 8)));
+    }
+    double legacyMs = TimeAverageMs(iterations, [&]() {
+        for (GameObject* go : legacy) {
+            if (!go->IsEnabled()) continue;
+            go->Update(program);
+        }
+    });
+
+    EntityStore store;
+    for (int i = 0; i < count; ++i) {
+        EntityLocation entity = store.Locate(store.Create(ENTITY_PARTICLE));
+        entity.archetype->maxLifetimes[entity.row] = entity.archetype->lifetimes[entity.row] = 1000;
+        entity.archetype->baseVelocities[entity.row] = RandomPointAround({0,0,0}, 0, 4);
+        entity.archetype->angularVelocities[entity.row] = RandomPointAround({0,0,0}, 0, 8);
+    }
+    double systemsMs = TimeAverageMs(iterations, [&]() {
+        store.Update(FRAME_TIME);
+    });
+
+    EntityStore boundStore;
+    std::vector<GameObject*> bound;
+    std::vector<vec4> colors(count);
+    for (int i = 0; i < count; ++i) {
+        GameObject* go = new GameObject("Bound Particle", Transform());
+        EntityBinding* binding = new EntityBinding(&boundStore, &colors[i]);
+        go->AddComponent(binding);
+        EntityLocation entity = binding->Spawn(ENTITY_PARTICLE);
+        entity.archetype->maxLifetimes[entity.row] = entity.archetype->lifetimes[entity.row] = 1000;
+        entity.archetype->baseVelocities[entity.row] = RandomPointAround({0,0,0}, 0, 4);
+        entity.archetype->angularVelocities[entity.row] = RandomPointAround({0,0,0}, 0, 8);
+        bound.push_back(go);
+    }
+    double boundMs = TimeAverageMs(iterations, [&]() {
+        boundStore.Update(FRAME_TIME);
+        SyncBindings(boundStore, program);
+    });
+
+    std::cout << "  virtual Update per object " << legacyMs << " ms/frame" << std::endl
+        << "  entity systems " << systemsMs << " ms/frame" << std::endl
+        << "  entity systems + GameObject sync " << boundMs << " ms/frame" << std::endl;
+
+    for (GameObject* go : legacy) delete go;
+    for (GameObject* go : bound) {
+        go->Destroy(program);
+        delete go;
+    }
+    program->deltaTime = previousDeltaTime;
+}
+
+// Measures the transform copies made while drawing: world transforms of parented objects and plain copies.
+// Both should run without touching the heap.
+void BenchmarkTransforms(int count = 10000, int iterations = 100) {
+    std::cout << "transform copies, " << count << " objects (" << iterations << " frames each)" << std::endl;
+    GameObject root("Root", Transform({0,1,0}));
+    std::vector<GameObject*> objects;
+    for (int i = 0; i < count; ++i) {
+        GameObject* go = new GameObject("Child", Transform(RandomPointAround({0,0,0}, 0, 4)));
+        go->SetParent(&root);
+        objects.push_back(go);
+    }
+    std::vector<Transform> copies(count);
+
+    size_t startAllocations = AllocationCount();
+    double copyMs = TimeAverageMs(iterations, [&]() {
+        for (int i = 0; i < count; ++i) {
+            copies[i] = objects[i]->transform;
+        }
+    });
+    size_t copyAllocations = AllocationCount() - startAllocations;
+
+    startAllocations = AllocationCount();
+    double worldMs = TimeAverageMs(iterations, [&]() {
+        // Moving the root makes every child rebuild its world transform
+        root.transform.Translate({0.01f,0,0});
+        for (GameObject* go : objects) {
+            copies[0] = go->GetGlobalTransform();
+            go->GetWorldMatrix();
+        }
+    });
+    size_t worldAllocations = AllocationCount() - startAllocations;
+
+    std::cout << "  copy " << copyMs << " ms/frame, " << (double)copyAllocations / iterations << " allocations/frame" << std::endl
+        << "  world transform rebuild " << worldMs << " ms/frame, " << (double)worldAllocations / iterations << " allocations/frame" << std::endl;
+    for (GameObject* go : objects) delete go;
+}
+
+// Measures a particle system frame (simulation plus writing the instance buffer), with and without the SSE kernels.
+void BenchmarkParticles(int iterations = 20) {
+    FastRandom random;
+    for (int count : {100000, 300000}) {
+        std::cout << "particles, " << count << " alive (" << iterations << " frames each)" << std::endl;
+        std::vector<float> instances(count * PARTICLE_INSTANCE_FLOATS);
+        for (bool simd : {false, true}) {
+            ParticleSystem particles(count);
+            particles.useSimd = simd;
+            for (int i = 0; i < count; ++i) {
+                ParticleParams params;
+                params.position = random.PointInShell(0, 4);
+                params.velocity = random.PointInShell(0.5, 4);
+                params.angles = random.PointInShell(0, PI);
+                params.angularVelocity = random.PointInShell(0, 12);
+                // Long enough that every particle survives the measurement
+                params.lifetime = 1000;
+                particles.Emit(params);
+            }
+            double updateMs = TimeAverageMs(iterations, [&]() {
+                particles.Update(0.016f);
+            });
+            double writeMs = TimeAverageMs(iterations, [&]() {
+                particles.WriteInstances(instances.data());
+            });
+            std::cout << "  " << (simd ? "sse " : "scalar ") << "update " << updateMs << " ms/frame, instance write " << writeMs << " ms/frame" << std::endl;
+        }
+    }
+}
+
+// Measures the work the program splits across its job system, single threaded and then with every worker.
+void BenchmarkJobs(GLProgram* program, int count = 300000, int iterations = 20) {
+    JobSystem& jobs = program->jobs;
+    std::cout << "jobs, " << jobs.ThreadCount() << " threads (" << iterations << " frames each)" << std::endl;
+    FastRandom random;
+    ParticleSystem particles(count);
+    for (int i = 0; i < count; ++i) {
+        ParticleParams params;
+        params.velocity = random.PointInShell(0.5, 4);
+        params.angularVelocity = random.PointInShell(0, 12);
+        params.lifetime = 1000;
+        particles.Emit(params);
+    }
+    std::vector<float> instances(count * PARTICLE_INSTANCE_FLOATS);
+    for (JobSystem* system : {(JobSystem*)nullptr, &jobs}) {
+        particles.jobs = system;
+        double particleMs = TimeAverageMs(iterations, [&]() {
+            particles.Update(0.016f);
+            particles.WriteInstances(instances.data());
+        });
+        std::cout << "  " << count << " particles " << (system == nullptr ? "single thread " : "jobs ") << particleMs << " ms/frame" << std::endl;
+    }
+
+    EntityStore store;
+    for (int i = 0; i < count / 10; ++i) {
+        EntityLocation entity = store.Locate(store.Create(ENTITY_PARTICLE));
+        entity.archetype->maxLifetimes[entity.row] = entity.archetype->lifetimes[entity.row] = 1000;
+        entity.archetype->baseVelocities[entity.row] = random.PointInShell(0.5, 4);
+        entity.archetype->angularVelocities[entity.row] = random.PointInShell(0, 12);
+    }
+    double serialMs = TimeAverageMs(iterations, [&]() {
+        store.Update(0.016f);
+    });
+    double graphMs = TimeAverageMs(iterations, [&]() {
+        store.Update(0.016f, jobs);
+    });
+    std::cout << "  " << count / 10 << " entities in order " << serialMs << " ms/frame, as a graph " << graphMs << " ms/frame" << std::endl;
+}
+
+// Colliders of a collision benchmark, each standing on its own GameObject, which are deleted along with the scene.
+// Every object remembers where it was placed, so the scene can wobble around those places from frame to frame.
+struct BenchmarkScene {
+    std::vector<GameObject*> objects;
+    std::vector<Collider*> colliders;
+    std::vector<vec3> places;
+    int frame = 0;
+
+    BenchmarkScene() = default;
+    BenchmarkScene(const BenchmarkScene&) = delete;
+    BenchmarkScene& operator=(const BenchmarkScene&) = delete;
+    ~BenchmarkScene() {
+        for (Collider* collider : colliders) delete collider;
+        for (GameObject* object : objects) delete object;
+    }
+    // Puts the collider on a new object standing on the transform
+    template <typename T>
+    T* Add(T* collider, const Transform& transform) {
+        GameObject* object = new GameObject("collider", transform);
+        object->AddComponent(collider);
+        collider->Initialize();
+        objects.push_back(object);
+        colliders.push_back(collider);
+        places.push_back(transform.GetPosition());
+        return collider;
+    }
+    // Moves every object up to amplitude away from its place, around a circle of its own
+    void Wobble(float amplitude) {
+        frame++;
+        for (size_t i = 0; i < objects.size(); ++i) {
+            objects[i]->transform.SetPosition(places[i] + amplitude * vec3(sin(frame * 0.1f + i), cos(frame * 0.1f + i), 0));
+        }
+    }
+};
+
+// Times the given collision broadphases on two layers of count colliders each, the i-th of each layer placed at place(i, layer).
+// With drift set, every collider also wobbles by up to that much every frame, like a coherent scene would.
+// With a job system, the checks find their pairs across its threads.
+void TimeBroadphases(const std::vector<CollisionBroadphase>& broadphases, int count, int iterations, float drift, const std::function<vec3(int, int)>& place, JobSystem* jobs = nullptr) {
+    CollisionLayer layers[2];
+    layers[0].CollidesWith(&layers[1]);
+    BenchmarkScene scene;
+    for (int i = 0; i < count; ++i) {
+        for (int layer = 0; layer < 2; ++layer) {
+            vec3 position = place(i, layer);
+            layers[layer].AddCollider(scene.Add(new BoxCollider(position, vec3(0.5, 0.5, 0.5)), Transform(position)));
+        }
+    }
+    const char* names[] = {"sweep", "grid", "persistent", "batch"};
+    for (CollisionBroadphase broadphase : broadphases) {
+        layers[0].SetBroadphase(broadphase);
+        layers[1].SetBroadphase(broadphase);
+        double checkMs = TimeWarmAverageMs(iterations, [&]() {
+            if (drift > 0) scene.Wobble(drift);
+            layers[0].CollisionPrep();
+            layers[1].CollisionPrep();
+            layers[0].CheckCollisions(jobs);
+        });
+        std::cout << "  " << count << " per layer " << names[broadphase] << " " << checkMs << " ms/frame" << std::endl;
+    }
+}
+
+// Times layers set up as separate collision layers and as a single collision world. Each layer collides with the next one,
+// or with every other one when everyPair is set. Every layer holds count colliders around the points of a lattice,
+// wobbling a little every frame without ever touching.
+void TimeLayerMatrix(CollisionBroadphase broadphase, int layerCount, bool everyPair, int count, int iterations) {
+    std::vector<CollisionLayer> layers(layerCount);
+    CollisionWorld world;
+    for (int layer = 0; layer < layerCount; ++layer) {
+        layers[layer].SetBroadphase(broadphase);
+        for (int other = layer + 1; other < layerCount; ++other) {
+            if (!everyPair && other != layer + 1) continue;
+            layers[layer].CollidesWith(&layers[other]);
+            world.SetLayersCollide(layer, other);
+        }
+    }
+    world.SetBroadphase(broadphase);
+    int side = (int)std::ceil(std::sqrt((float)count));
+    auto place = [side](int i, int layer) {
+        return vec3(2 * (i % side) + 0.6f * (layer % 2), 2 * (i / side) + 0.6f * (layer / 2 % 2), 0.6f * (layer / 4));
+    };
+    BenchmarkScene scene;
+    for (int layer = 0; layer < layerCount; ++layer) {
+        for (int i = 0; i < count; ++i) {
+            BoxCollider* collider = scene.Add(new BoxCollider(place(i, layer), vec3(0.5, 0.5, 0.5)), Transform(place(i, layer)));
+            layers[layer].AddCollider(collider);
+            world.AddCollider(collider, layer);
+        }
+    }
+    double layersMs = TimeWarmAverageMs(iterations, [&]() {
+        scene.Wobble(0.04f);
+        for (CollisionLayer& layer : layers) layer.CollisionPrep();
+        for (CollisionLayer& layer : layers) layer.CheckCollisions();
+    });
+    double worldMs = TimeWarmAverageMs(iterations, [&]() {
+        scene.Wobble(0.04f);
+        world.CheckCollisions();
+    });
+    const char* names[] = {"sweep", "grid", "persistent", "batch"};
+    std::cout << "  " << layerCount << " layers of " << count << " " << names[broadphase] << ", as layers " << layersMs << " ms/frame, as a world " << worldMs << " ms/frame" << std::endl;
+    world.Clear();
+}
+
+// Compares the collision broadphases. No pair ever collides, so the timings are purely the cost of finding candidates.
+void BenchmarkCollision(GLProgram* program, int iterations = 5) {
+    const std::vector<CollisionBroadphase> broadphases = {BROADPHASE_SWEEP, BROADPHASE_GRID, BROADPHASE_PERSISTENT};
+    // Every collider shares the same X range, the worst case of the sweep
+    std::cout << "collision, two layers stacked in one column (" << iterations << " frames each)" << std::endl;
+    for (int count : {250, 1000, 4000}) {
+        TimeBroadphases(broadphases, count, iterations, 0, [](int i, int layer) {
+            return vec3(0, 2 * i + layer, 0);
+        });
+    }
+    // Colliders scattered around the points of a lattice, moving a little every frame
+    auto timeDrifting = [&](int count, JobSystem* jobs) {
+        int side = (int)std::ceil(std::sqrt((float)count));
+        std::vector<vec3> scatter(count * 2);
+        FastRandom random;
+        for (vec3& offset : scatter) offset = vec3(random.Value(-0.1f, 0.1f), random.Value(-0.1f, 0.1f), random.Value(-0.1f, 0.1f));
+        TimeBroadphases(broadphases, count, iterations * 10, 0.1f, [side, &scatter](int i, int layer) {
+            return vec3(2 * (i % side) + layer, 2 * (i / side), 0) + scatter[i * 2 + layer];
+        }, jobs);
+    };
+    std::cout << "collision, two layers drifting on a plane (" << iterations * 10 << " frames each)" << std::endl;
+    for (int count : {1000, 4000, 16000}) {
+        timeDrifting(count, nullptr);
+    }
+    // The largest one again, finding pairs across the job system
+    std::cout << "collision, two layers drifting on a plane, " << program->jobs.ThreadCount() << " threads (" << iterations * 10 << " frames each)" << std::endl;
+    timeDrifting(16000, &program->jobs);
+    // A row of bullets under a formation, small enough to test all against all
+    std::cout << "collision, bullets under a formation (" << iterations * 100 << " frames each)" << std::endl;
+    TimeBroadphases({BROADPHASE_SWEEP, BROADPHASE_GRID, BROADPHASE_PERSISTENT, BROADPHASE_BATCH}, 64, iterations * 100, 0.1f, [](int i, int layer) {
+        return layer == 0 ? vec3(i * 0.125f, -2, 0) : vec3(i % 8, 2 + i / 8, 0);
+    });
+    // A few small interacting layers, the only size at which a world can afford to batch every collider
+    std::cout << "collision, small layers colliding with the next layer (" << iterations * 100 << " frames each)" << std::endl;
+    for (CollisionBroadphase broadphase : {BROADPHASE_SWEEP, BROADPHASE_GRID, BROADPHASE_PERSISTENT, BROADPHASE_BATCH}) {
+        TimeLayerMatrix(broadphase, 4, false, 16, iterations * 100);
+    }
+    // Several interacting layers, where separate layers each check against every layer they collide with
+    // while a world runs a single broadphase over all of them
+    for (bool everyPair : {false, true}) {
+        std::cout << "collision, layers colliding with " << (everyPair ? "every other layer" : "the next layer") << " (" << iterations * 4 << " frames each)" << std::endl;
+        for (CollisionBroadphase broadphase : broadphases) {
+            for (int layerCount : {4, 8}) {
+                TimeLayerMatrix(broadphase, layerCount, everyPair, 4000, iterations * 4);
+            }
+        }
+    }
+}
+
+// Times raycasts and overlap queries on a collision world of count colliders, half boxes and half spheres,
+// scattered in a slab that grows with the count so the density stays the same, against testing every collider.
+// Every frame the colliders drift a little and the query tree catches up with them. Every query is then checked against
+// testing every collider. Returns the number of results that differ.
+int TimeQueries(int count, int queries, int iterations) {
+    CollisionWorld world;
+    float side = 4 * std::sqrt((float)count);
+    FastRandom random;
+    BenchmarkScene scene;
+    for (int i = 0; i < count; ++i) {
+        vec3 position(random.Value(0, side), random.Value(0, side), random.Value(-4, 4));
+        Collider* collider = i % 2 == 0 ? (Collider*)new BoxCollider(position, vec3(random.Value(0.2f, 1), random.Value(0.2f, 1), 0.5f))
+                                        : (Collider*)new SphereCollider(position, random.Value(0.2f, 1));
+        scene.Add(collider, Transform(position));
+    }
+    const std::vector<Collider*>& colliders = scene.colliders;
+    double buildMs = TimeAverageMs(1, [&]() {
+        for (int i = 0; i < count; ++i) world.AddCollider(colliders[i], i % 4);
+    });
+    double refitMs = TimeAverageMs(iterations, [&]() {
+        scene.Wobble(0.05f);
+        world.UpdateQueryTree();
+    });
+
+    // Rays across the whole slab, and regions a few colliders wide
+    std::vector<vec3> origins(queries);
+    std::vector<vec3> directions(queries);
+    for (int i = 0; i < queries; ++i) {
+        origins[i] = vec3(random.Value(0, side), random.Value(0, side), 0);
+        float angle = random.Value(0, 2 * M_PI);
+        directions[i] = vec3(cos(angle), sin(angle), random.Value(-0.05f, 0.05f));
+    }
+    float rayLength = side * 0.25f;
+    std::vector<std::vector<RaycastHit>> rayHits(queries);
+    std::vector<RaycastHit> firstHits(queries);
+    std::vector<char> firstFound(queries);
+    std::vector<std::vector<OverlapHit>> sphereHits(queries);
+    std::vector<std::vector<OverlapHit>> boxHits(queries);
+    double rayMs = TimeAverageMs(iterations, [&]() {
+        for (int i = 0; i < queries; ++i) rayHits[i] = world.Raycast(origins[i], directions[i], rayLength);
+    });
+    double firstMs = TimeAverageMs(iterations, [&]() {
+        for (int i = 0; i < queries; ++i) firstFound[i] = world.RaycastFirst(origins[i], directions[i], firstHits[i], rayLength);
+    });
+    double sphereMs = TimeAverageMs(iterations, [&]() {
+        for (int i = 0; i < queries; ++i) sphereHits[i] = world.SphereOverlap(origins[i], 4);
+    });
+    double boxMs = TimeAverageMs(iterations, [&]() {
+        for (int i = 0; i < queries; ++i) boxHits[i] = world.BoxOverlap(Bounds(origins[i] - vec3(4), origins[i] + vec3(4)));
+    });
+    std::vector<std::vector<RaycastHit>> bruteHits(queries);
+    double bruteMs = TimeAverageMs(iterations, [&]() {
+        for (int i = 0; i < queries; ++i) {
+            std::vector<RaycastHit>& hits = bruteHits[i];
+            hits.clear();
+            // Normalized the way the world does, so grazing rays solve the very same quadratic
+            vec3 unit = directions[i] / glm::length(directions[i]);
+            for (Collider* collider : colliders) {
+                float distance;
+                if (RaycastCollider(collider, origins[i], unit, rayLength, distance)) hits.push_back({collider, distance, origins[i] + unit * distance});
+            }
+            std::stable_sort(hits.begin(), hits.end(), [](const RaycastHit& a, const RaycastHit& b) {
+                return a.distance < b.distance;
+            });
+        }
+    });
+
+    // Every answer of the tree has to match testing every collider: the same colliders, and the same nearest hit
+    auto collidersOf = [](const auto& hits) {
+        std::vector<Collider*> result;
+        for (const auto& hit : hits) result.push_back(hit.collider);
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    size_t hitCount = 0;
+    int mismatches = 0;
+    for (int i = 0; i < queries; ++i) {
+        const std::vector<RaycastHit>& brute = bruteHits[i];
+        std::vector<Collider*> inSphere;
+        std::vector<Collider*> inBox;
+        for (Collider* collider : colliders) {
+            if (DistanceToCollider(collider, origins[i]) <= 4) inSphere.push_back(collider);
+            if (BoxOverlapsCollider(collider, origins[i] - vec3(4), origins[i] + vec3(4))) inBox.push_back(collider);
+        }
+        std::sort(inSphere.begin(), inSphere.end());
+        std::sort(inBox.begin(), inBox.end());
+        hitCount += brute.size();
+        mismatches += collidersOf(rayHits[i]) != collidersOf(brute);
+        mismatches += firstFound[i] != !brute.empty() || (firstFound[i] && firstHits[i].distance != brute[0].distance);
+        mismatches += collidersOf(sphereHits[i]) != inSphere;
+        mismatches += collidersOf(boxHits[i]) != inBox;
+    }
+    std::cout << "  " << count << " colliders, tree of height " << world.GetQueryTree().GetHeight() << " built in " << buildMs << " ms, refit " << refitMs << " ms/frame" << std::endl;
+    std::cout << "    " << queries << " queries, raycast " << rayMs << " ms, first hit " << firstMs << " ms, sphere " << sphereMs << " ms, box " << boxMs
+              << " ms, raycast testing every collider " << bruteMs << " ms (" << hitCount << " hits, " << mismatches << " results differing from it)" << std::endl;
+    world.Clear();
+    return mismatches;
+}
+
+// Scales the collision world queries from thousands to a hundred thousand colliders.
+// Returns the number of results that differ from testing every collider.
+int BenchmarkQueries(int iterations = 5) {
+    std::cout << "collision queries (" << iterations << " frames each)" << std::endl;
+    int mismatches = 0;
+    for (int count : {10000, 30000, 100000}) {
+        mismatches += TimeQueries(count, 1000, iterations);
+    }
+    return mismatches;
+}
+
+// Times building a mesh BVH, then rays and spheres against a collider placed with it, turned and scaled so every query
+// goes through the map to mesh space. Rays cross the mesh's bounds from anywhere around them, against testing every triangle
+// with a few of them, which then checks the answers of the BVH for those. Queries are reported in microseconds each.
+// Returns the number of queries whose answer differs from testing every triangle.
+int TimeMeshBvh(const std::string& name, const std::vector<vec3>& positions, const std::vector<uint32_t>& indices, int queries, int iterations) {
+    MeshBvh bvh;
+    double buildMs = TimeAverageMs(iterations, [&]() {
+        bvh.Build(positions, indices);
+    });
+    BenchmarkScene scene;
+    MeshCollider* collider = scene.Add(new MeshCollider(&bvh, vec3(0)), Transform(vec3(1, 2, 3), glm::normalize(vec3(0.3f, 0.2f, 1)), vec3(0, 1, 0), vec3(1.5f, 2, 1)));
+
+    Bounds bounds = collider->GetBounds();
+    vec3 center = (bounds.GetMinBound() + bounds.GetMaxBound()) * 0.5f;
+    float reach = glm::length(bounds.GetMaxBound() - bounds.GetMinBound()) * 0.5f;
+    FastRandom random;
+    auto around = [&]() {
+        return center + reach * vec3(random.Value(-1, 1), random.Value(-1, 1), random.Value(-1, 1));
+    };
+    std::vector<vec3> origins(queries);
+    std::vector<vec3> directions(queries);
+    std::vector<vec3> centers(queries);
+    for (int i = 0; i < queries; ++i) {
+        origins[i] = around();
+        directions[i] = glm::normalize(around() - origins[i]);
+        centers[i] = around();
+    }
+    float radius = reach * 0.05f;
+    std::vector<float> rayDistances(queries);
+    std::vector<char> sphereHits(queries);
+    double rayMs = TimeAverageMs(iterations, [&]() {
+        for (int i = 0; i < queries; ++i) {
+            if (!collider->Raycast(origins[i], directions[i], INFINITY, rayDistances[i])) rayDistances[i] = INFINITY;
+        }
+    });
+    double sphereMs = TimeAverageMs(iterations, [&]() {
+        for (int i = 0; i < queries; ++i) sphereHits[i] = collider->OverlapsEllipsoid(centers[i], vec3(radius));
+    });
+    int bruteQueries = std::min(queries, 100);
+    mat4 model = scene.objects[0]->transform.GetModelMatrix();
+    std::vector<vec3> world(positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) world[i] = vec3(model * vec4(positions[i], 1));
+    std::vector<float> bruteDistances(bruteQueries, INFINITY);
+    double bruteMs = TimeAverageMs(1, [&]() {
+        for (int i = 0; i < bruteQueries; ++i) {
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                float distance;
+                if (RayIntersectsTriangle(origins[i], directions[i], world[indices[t]], world[indices[t + 1]], world[indices[t + 2]], bruteDistances[i], distance)) bruteDistances[i] = distance;
+            }
+        }
+    });
+
+    // The BVH works in mesh space, so its answers may differ from the world space ones by rounding. Distances have to agree
+    // within a millionth of the mesh's size, and only spheres within that of touching the surface may disagree on overlapping it.
+    float tolerance = reach * 1e-6f;
+    int hits = 0;
+    int mismatches = 0;
+    for (int i = 0; i < bruteQueries; ++i) {
+        hits += bruteDistances[i] < INFINITY;
+        if (std::isinf(rayDistances[i]) != std::isinf(bruteDistances[i]) || std::abs(rayDistances[i] - bruteDistances[i]) > tolerance) mismatches++;
+        float closest = INFINITY;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            vec3 delta = centers[i] - ClosestPointOnTriangle(centers[i], world[indices[t]], world[indices[t + 1]], world[indices[t + 2]]);
+            closest = std::min(closest, glm::length(delta));
+        }
+        if ((bool)sphereHits[i] != (closest <= radius) && std::abs(closest - radius) > tolerance) mismatches++;
+    }
+    std::cout << "  " << name << ", " << indices.size() / 3 << " triangles, " << bvh.GetNodes().size() << " nodes of depth " << bvh.GetDepth()
+              << " built in " << buildMs << " ms" << std::endl;
+    std::cout << "    raycast " << rayMs * 1000 / queries << " us, sphere " << sphereMs * 1000 / queries
+              << " us, raycast testing every triangle " << bruteMs * 1000 / bruteQueries << " us (" << hits << " hits, " << mismatches << " results differing from it)" << std::endl;
+    return mismatches;
+}
+
+// Unit sphere of the given number of rings, with twice as many segments around it
+void MakeSphereMesh(int rings, std::vector<vec3>& positions, std::vector<uint32_t>& indices) {
+    int segments = rings * 2;
+    for (int r = 0; r <= rings; ++r) {
+        float polar = M_PI * r / rings;
+        for (int s = 0; s <= segments; ++s) {
+            float azimuth = 2 * M_PI * s / segments;
+            positions.push_back(vec3(sin(polar) * cos(azimuth), cos(polar), sin(polar) * sin(azimuth)));
+        }
+    }
+    for (int r = 0; r < rings; ++r) {
+        for (int s = 0; s < segments; ++s) {
+            uint32_t first = r * (segments + 1) + s;
+            uint32_t second = first + segments + 1;
+            indices.insert(indices.end(), {first, second, first + 1, second, second + 1, first + 1});
+        }
+    }
+}
+
+// Builds and queries the BVH of the ship's hull, then of spheres with more and more triangles.
+// Returns the number of queries whose answer differs from testing every triangle.
+int BenchmarkMeshes(int iterations = 5) {
+    std::cout << "mesh colliders (" << iterations << " runs each)" << std::endl;
+    int mismatches = 0;
+    std::vector<ObjData> objects = ObjReader::ReadObj("./media/objects/rocket.obj");
+    if (!objects.empty()) {
+        std::vector<vec3> positions;
+        for (const VertexData& data : objects[0].mesh->GetData()) positions.push_back(data.pos);
+        std::vector<GLuint> elements = objects[0].mesh->GetElementArrayBuffer();
+        mismatches += TimeMeshBvh("rocket.obj", positions, std::vector<uint32_t>(elements.begin(), elements.end()), 10000, iterations);
+    }
+    for (int rings : {64, 256, 512}) {
+        std::vector<vec3> positions;
+        std::vector<uint32_t> indices;
+        MakeSphereMesh(rings, positions, indices);
+        mismatches += TimeMeshBvh("sphere", positions, indices, 10000, iterations);
+    }
+    return mismatches;
+}
+
+const char* const NARROW_PHASE_SHAPE_NAMES[COLLIDER_SHAPE_COUNT] = {"sphere", "ellipsoid", "box", "mesh"};
+
+// Collider of the given shape somewhere around the origin, of a random size. Meshes are placed with the given BVH, turned at random.
+Collider* RandomNarrowPhaseCollider(ColliderShape shape, const MeshBvh* bvh, FastRandom& random) {
+    vec3 center(random.Value(-1.5f, 1.5f), random.Value(-1.5f, 1.5f), random.Value(-1.5f, 1.5f));
+    if (shape == COLLIDER_SPHERE) return new SphereCollider(center, random.Value(0.1f, 1));
+    if (shape == COLLIDER_ELLIPSOID) return new EllipsoidCollider(center, random.Value(0.3f, 1), vec3(random.Value(0.2f, 2), random.Value(0.2f, 2), random.Value(0.2f, 2)));
+    if (shape == COLLIDER_BOX) return new BoxCollider(center, vec3(random.Value(0.1f, 2), random.Value(0.1f, 2), random.Value(0.1f, 2)));
+    MeshCollider* mesh = new MeshCollider(bvh, center, vec3(random.Value(0.3f, 1.5f), random.Value(0.3f, 1.5f), random.Value(0.3f, 1.5f)));
+    vec3 axis = glm::normalize(vec3(random.Value(0.1f, 1), random.Value(-1, 1), random.Value(-1, 1)));
+    float angle = random.Value(0, PI * 2);
+    mesh->SetOrientation(mat3(glm::rotate(vec3(1, 0, 0), angle, axis), glm::rotate(vec3(0, 1, 0), angle, axis), glm::rotate(vec3(0, 0, 1), angle, axis)));
+    return mesh;
+}
+
+// Whether a point sampled on a grid with the given number of steps along every axis lies in both colliders.
+// The grid spans the overlap of their bounds. Meshes collide by their surface, so with a mesh the samples are spread over its
+// triangles instead: one of them has to fall inside a solid shape, and some have to fall inside another closed mesh and some
+// outside of it, since a surface that crosses the one of a closed mesh has points on both sides of it.
+bool SampledOverlap(Collider* a, Collider* b, int steps) {
+    if (b->GetShape() == COLLIDER_MESH && a->GetShape() != COLLIDER_MESH) std::swap(a, b);
+    if (a->GetShape() == COLLIDER_MESH) {
+        MeshCollider* mesh = static_cast<MeshCollider*>(a);
+        bool inside = false, outside = false;
+        for (const MeshBvhTriangle& triangle : mesh->GetBvh()->GetTriangles()) {
+            vec3 vertices[3] = {mesh->ToWorld(triangle.vertices[0]), mesh->ToWorld(triangle.vertices[1]), mesh->ToWorld(triangle.vertices[2])};
+            for (int i = 0; i <= steps; ++i) {
+                for (int j = 0; i + j <= steps; ++j) {
+                    vec3 point = vertices[0] + (vertices[1] - vertices[0]) * ((float)i / steps) + (vertices[2] - vertices[0]) * ((float)j / steps);
+                    if (b->Contains(point)) inside = true;
+                    else outside = true;
+                    if (inside && (outside || b->GetShape() != COLLIDER_MESH)) return true;
+                }
+            }
+        }
+        return false;
+    }
+    vec3 minBound = glm::max(a->GetBounds().GetMinBound(), b->GetBounds().GetMinBound());
+    vec3 maxBound = glm::min(a->GetBounds().GetMaxBound(), b->GetBounds().GetMaxBound());
+    if (glm::any(glm::greaterThan(minBound, maxBound))) return false;
+    for (int i = 0; i <= steps; ++i) {
+        for (int j = 0; j <= steps; ++j) {
+            for (int k = 0; k <= steps; ++k) {
+                vec3 point = minBound + (maxBound - minBound) * vec3(i, j, k) / (float)steps;
+                if (a->Contains(point) && b->Contains(point)) return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Checks the narrow phase tests against point sampling, over random pairs of every two shapes. Sampling can only prove an overlap:
+// a test missing one is an error, while overlaps no sample lands in are sampled again four times finer, and reported if they still
+// find nothing, as they can only be grazing contacts or wrong. Then shapes touching exactly have to overlap, and ones set just apart not.
+// Returns the number of errors.
+int CheckNarrowPhase(int pairs = 1000) {
+    std::vector<vec3> positions;
+    std::vector<uint32_t> indices;
+    MakeSphereMesh(6, positions, indices);
+    MeshBvh sphereBvh;
+    sphereBvh.Build(positions, indices);
+    int errors = 0;
+    FastRandom random;
+    std::cout << "narrow phase against point sampling (" << pairs << " pairs of every two shapes)" << std::endl;
+    for (ColliderShape first = 0; first < COLLIDER_SHAPE_COUNT; ++first) {
+        for (ColliderShape second = first; second < COLLIDER_SHAPE_COUNT; ++second) {
+            int overlapping = 0, missed = 0, asymmetric = 0, thin = 0, unconfirmed = 0;
+            for (int i = 0; i < pairs; ++i) {
+                Collider* a = RandomNarrowPhaseCollider(first, &sphereBvh, random);
+                Collider* b = RandomNarrowPhaseCollider(second, &sphereBvh, random);
+                bool tested = NARROW_PHASE_TESTS[first][second](a, b);
+                asymmetric += tested != NARROW_PHASE_TESTS[second][first](b, a);
+                bool sampled = SampledOverlap(a, b, 24);
+                overlapping += tested;
+                missed += sampled && !tested;
+                if (tested && !sampled) {
+                    ++thin;
+                    unconfirmed += !SampledOverlap(a, b, 96);
+                }
+                delete a;
+                delete b;
+            }
+            errors += missed + asymmetric;
+            std::cout << "  " << NARROW_PHASE_SHAPE_NAMES[first] << " / " << NARROW_PHASE_SHAPE_NAMES[second] << ": " << overlapping << " overlapping, "
+                      << missed << " missed, " << asymmetric << " asymmetric, " << thin << " thinner than the grid, " << unconfirmed << " never sampled" << std::endl;
+        }
+    }
+
+    // Cube of side 2 around its center, for meshes touching flat faces
+    std::vector<vec3> cubePositions = {
+        vec3(-1, -1, -1), vec3(1, -1, -1), vec3(1, 1, -1), vec3(-1, 1, -1),
+        vec3(-1, -1, 1), vec3(1, -1, 1), vec3(1, 1, 1), vec3(-1, 1, 1)
+    };
+    std::vector<uint32_t> cubeIndices = {
+        0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+        3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5
+    };
+    MeshBvh cubeBvh;
+    cubeBvh.Build(cubePositions, cubeIndices);
+    // Every case touches along the X axis at x = 1 (or x = 2 from an ellipsoid's tip), apart by the gap
+    const float gap = 1.0f / 64;
+    struct EdgeCase {
+        const char* name;
+        std::function<Collider*(float)> first;
+        std::function<Collider*(float)> second;
+    };
+    const std::vector<EdgeCase> edgeCases = {
+        {"spheres", [](float) { return new SphereCollider(vec3(0), 1); }, [](float apart) { return new SphereCollider(vec3(2 + apart, 0, 0), 1); }},
+        {"box faces", [](float) { return new BoxCollider(vec3(0), vec3(2)); }, [](float apart) { return new BoxCollider(vec3(2 + apart, 0, 0), vec3(2)); }},
+        {"box edges", [](float) { return new BoxCollider(vec3(0), vec3(2)); }, [](float apart) { return new BoxCollider(vec3(2 + apart, 2, 0), vec3(2)); }},
+        {"sphere on a box face", [](float) { return new BoxCollider(vec3(0), vec3(2)); }, [](float apart) { return new SphereCollider(vec3(2 + apart, 0, 0), 1); }},
+        {"ellipsoid tip on a box", [](float) { return new EllipsoidCollider(vec3(0), vec3(2, 0.5f, 0.5f)); }, [](float apart) { return new BoxCollider(vec3(3 + apart, 0, 0), vec3(2)); }},
+        {"ellipsoid tip on a sphere", [](float) { return new EllipsoidCollider(vec3(0), vec3(2, 0.5f, 0.5f)); }, [](float apart) { return new SphereCollider(vec3(3 + apart, 0, 0), 1); }},
+        {"ellipsoid tips", [](float) { return new EllipsoidCollider(vec3(0), vec3(2, 0.5f, 0.5f)); }, [](float apart) { return new EllipsoidCollider(vec3(3 + apart, 0, 0), vec3(1, 0.5f, 0.25f)); }},
+        {"sphere on a mesh face", [&](float) { return new MeshCollider(&cubeBvh, vec3(0)); }, [](float apart) { return new SphereCollider(vec3(2 + apart, 0, 0), 1); }},
+        {"box on a mesh face", [&](float) { return new MeshCollider(&cubeBvh, vec3(0)); }, [](float apart) { return new BoxCollider(vec3(2 + apart, 0.5f, 0.5f), vec3(2)); }},
+        {"mesh faces", [&](float) { return new MeshCollider(&cubeBvh, vec3(0)); }, [&](float apart) { return new MeshCollider(&cubeBvh, vec3(2 + apart, 0.5f, 0.5f)); }}
+    };
+    std::cout << "narrow phase, touching shapes" << std::endl;
+    for (const EdgeCase& edgeCase : edgeCases) {
+        for (float apart : {0.0f, gap}) {
+            Collider* a = edgeCase.first(apart);
+            Collider* b = edgeCase.second(apart);
+            bool forward = a->CollidesWith(b);
+            bool backward = b->CollidesWith(a);
+            bool expected = apart == 0;
+            if (forward != expected || backward != expected) {
+                ++errors;
+                std::cout << "  " << edgeCase.name << (expected ? " touching" : " apart") << ": reported " << forward << " / " << backward
+                          << ", expected " << expected << std::endl;
+            }
+            delete a;
+            delete b;
+        }
+    }
+    std::cout << "narrow phase: " << errors << " errors" << std::endl;
+    return errors;
+}
+
+// Returns false if no benchmark with the given name exists, or if a correctness check it runs fails.
+bool RunBenchmark(const std::string& name, GLProgram* program) {
+    if (name == "textures") {
+        BenchmarkTextureLoad(program);
+    } else if (name == "mips") {
+        BenchmarkMipmaps();
+    } else if (name == "entities") {
+        BenchmarkEntities(program);
+    } else if (name == "transforms") {
+        BenchmarkTransforms();
+    } else if (name == "particles") {
+        BenchmarkParticles();
+    } else if (name == "jobs") {
+        BenchmarkJobs(program);
+    } else if (name == "collision") {
+        BenchmarkCollision(program);
+    } else if (name == "queries") {
+        return BenchmarkQueries() == 0;
+    } else if (name == "meshes") {
+        return BenchmarkMeshes() == 0;
+    } else if (name == "narrowphase") {
+        return CheckNarrowPhase() == 0;
+    } else {
+        std::cerr << "Unknown benchmark " << name << ". Available: textures, mips, entities, transforms, particles, jobs, collision, queries, meshes, narrowphase" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif
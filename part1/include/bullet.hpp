@@ -6,7 +6,7 @@
 #include "../../lib/glHelper.hpp"
 #include "../../lib/gameObject.hpp"
 #include "../../lib/collision/collider.hpp"
-#include "../../lib/collision/layer.hpp"
+#include "../../lib/collision/world.hpp"
 #include "../../lib/collision/bounds.hpp"
 #include "../../lib/extensions/math.hpp"
 
@@ -21,17 +21,20 @@ private:
 public:
     Collider* collider = nullptr;
     Instance* instance = nullptr;
-    Bullet(std::string name, Transform transform, MeshHandle mesh, Material* material, CollisionLayer* layer = nullptr) 
+    Bullet(std::string name, Transform transform, MeshHandle mesh, Material* material, CollisionWorld* world = nullptr, CollisionLayerIndex layer = 0) 
     : GameObject(name, transform, mesh, material) {
         collider = new EllipsoidCollider(transform.GetPosition(), BULLET_COLLIDER_SIZE);
+        // Bullets move further than their length in a slow frame
+        collider->SetContinuous(true);
         this->AddComponent(collider);
         light = new Light(LightData({0,0,0},{0.5,0.5,1},{1,0.3f,0.05f,0.0f},0.0f,3.0f,3.0f));
         this->AddComponent(light);
         collider->Initialize();
         this->instance = new Instance(this);
+        parallelUpdate = true;
         Reset();
-        if (layer != nullptr) {
-            AttachToCollisionLayer(layer);
+        if (world != nullptr) {
+            AttachToCollisionWorld(world, layer);
         }
     }
     ~Bullet() {
@@ -43,13 +46,16 @@ public:
     static Transform BuildBulletTransform(glm::vec3 position, glm::vec3 firingDirection = {0,1,0}) {
         return Transform(position, firingDirection, {0,0,-1});
     }
-    void AttachToCollisionLayer(CollisionLayer* layer) {
-        layer->AddCollider(collider);
+    void AttachToCollisionWorld(CollisionWorld* world, CollisionLayerIndex layer) {
+        world->AddCollider(collider, layer);
     }
-    virtual void Update(GLProgram* program) {
+    // Motion only touches this bullet, so it runs on the worker threads
+    virtual void ParallelUpdate(GLProgram* program) {
         transform.Translate(VELOCITY * program->deltaTime);
         transform.RotateY(spinSpeed * program->deltaTime);
-        if (!BULLET_BOUNDS.Contains(transform.position)) {
+    }
+    virtual void Update(GLProgram* program) {
+        if (!BULLET_BOUNDS.Contains(transform.GetPosition())) {
             SetEnabled(false, program);
         }
     }
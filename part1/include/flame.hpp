@@ -1,64 +1,23 @@
 #ifndef FLAME_HPP
 #define FLAME_HPP
 
-#include <string>
+#include "../../lib/particles.hpp"
+#include "../../lib/extensions/math.hpp"
 
-#include "../../lib/glHelper.hpp"
-#include "../../lib/gameObject.hpp"
+// Emits a single flame from the ship's thruster at the given position
+inline void EmitFlame(ParticleSystem& particles, FastRandom& random, glm::vec3 position) {
+    ParticleParams params;
+    params.position = position;
+    params.angles = glm::vec3(0, random.Value(0, PI * 2), 0);
+    params.scale = random.Value(0.15f, 0.35f);
+    params.lifetime = random.Value(0.5f, 1.5f);
+    float initialSpeed = random.Value(2, 5);
+    vec2 xyOffset = random.PointInRing(0,1);
+    params.velocity = normalize(glm::vec3(xyOffset.x, -3, xyOffset.y)) * initialSpeed;
+    params.angularVelocity = normalize(random.PointInShell(0, 8));
+    params.startColor = glm::vec4(1,1,1,1);
+    params.endColor = glm::vec4(0.4,0.2,1,1);
+    particles.Emit(params);
+}
 
-class Flame : public GameObject {
-private:
-    float initialLifetime;
-    float lifetime;
-    vec3 initialVelocity;
-    vec3 velocity;
-    vec3 angularVelocity;
-    vec3 initialScale;
-public:
-    Instance* instance;
-    Flame(std::string name, Transform transform, MeshHandle mesh, Material* material) 
-    : GameObject(name, transform, mesh, material) {
-        this->instance = new Instance(this);
-        this->instance->AddAttribute(vec4(1));
-        Reset();
-    }
-    ~Flame() {
-        delete instance;
-    }
-    void Reset() {
-        vec2 xyRotation = RandomPointAround({0,0},1);
-        transform.SetForwardVector({xyRotation.x,0,xyRotation.y}, false);
-        transform.SetUpVector({0,1,0});
-        this->initialLifetime = RandomValue(0.5,1.5);
-        this->lifetime = initialLifetime;
-        float initialSpeed = RandomValue(2, 5);
-        vec2 xyOffset = RandomPointAround({0,0},0,1);
-        this->initialVelocity = normalize(glm::vec3(xyOffset.x, -3, xyOffset.y)) * initialSpeed;
-        this->velocity = initialVelocity;
-        this->angularVelocity = normalize(RandomPointAround({0,0,0}, 0, 8));
-        this->initialScale = vec3(RandomValue(0.15f, 0.35f));
-        transform.SetScale(initialScale);
-    }
-    static glm::vec3 VelocityCurve(glm::vec3 v0, float t) {
-        return v0 * (0.3f + 0.7f * t);
-    }
-    static glm::vec3 ScaleCurve(glm::vec3 s0, float t) {
-        return s0 * t;
-    }
-    static glm::vec4 ColorCurve(float t) {
-        return glm::vec4(1,1,1,1) * t + glm::vec4(0.4,0.2,1,1) * (1 - t);
-    }
-    virtual void Update(GLProgram* program) {
-        transform.Translate(velocity * program->deltaTime);
-        transform.SetScale(ScaleCurve(initialScale, lifetime / initialLifetime));
-        transform.Rotate(angularVelocity * program->deltaTime);
-        velocity = VelocityCurve(initialVelocity, lifetime / initialLifetime);
-        instance->extraAttribs.at(0) = ColorCurve(lifetime / initialLifetime);
-        lifetime -= program->deltaTime;
-        if (lifetime < 0) {
-            this->SetEnabled(false, program);
-        }
-    }
-};
-
-#endif
\ No newline at end of file
+#endif
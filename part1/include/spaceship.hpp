@@ -6,6 +6,7 @@
 
 #include "../../lib/gameObject.hpp"
 #include "../../lib/pools.hpp"
+#include "../../lib/particles.hpp"
 #include "../../lib/geometry/mesh.hpp"
 #include "../../lib/shader.hpp"
 #include "../../lib/input.hpp"
@@ -33,7 +34,8 @@ class SpaceShip : public GameObject {
     float maxAngle = 30 * pi<float>() / 2;
 
     GameObjectPool<Bullet>* bulletPool;
-    GameObjectPool<Flame>* flamePool;
+    ParticleSystem* flames;
+    FastRandom flameRandom;
 
     float firingTimer = 0;
     float thrustTimer = 0;
@@ -51,17 +53,18 @@ public:
         }
     });
 
-    SpaceShip(std::string name, Transform transform, MeshHandle mesh, Material* material, GameObjectPool<Bullet>* bulletPool, GameObjectPool<Flame>* flamePool, CollisionLayer* layer = nullptr) 
+    // The hull is the BVH of the ship's mesh, which the ship collides with as drawn
+    SpaceShip(std::string name, Transform transform, MeshHandle mesh, Material* material, const MeshBvh* hull, GameObjectPool<Bullet>* bulletPool, ParticleSystem* flames, CollisionWorld* world = nullptr, CollisionLayerIndex layer = 0) 
     : GameObject(name, transform, mesh, material) {
-        collider = new BoxCollider(transform.GetPosition(), {0.65, 1.5, 1}, {0,0.75,0});
+        collider = new MeshCollider(hull, transform.GetPosition());
         this->AddComponent(collider);
         collider->Initialize();
         collider->OnCollisionEnter.AddListener(&OnCollisionHandler);
 
         this->bulletPool = bulletPool;
-        this->flamePool = flamePool;
-        if (layer != nullptr) {
-            AttachToCollisionLayer(layer);
+        this->flames = flames;
+        if (world != nullptr) {
+            AttachToCollisionWorld(world, layer);
         }
         Reset();
     }
@@ -69,8 +72,8 @@ public:
         transform.SetPosition({0,-4.5f,0});
     }
     
-    void AttachToCollisionLayer(CollisionLayer* layer) {
-        layer->AddCollider(collider);
+    void AttachToCollisionWorld(CollisionWorld* world, CollisionLayerIndex layer) {
+        world->AddCollider(collider, layer);
     }
 
     virtual void HandleMotion(GLProgram* program) {
@@ -104,9 +107,7 @@ public:
         if (thrustTimer < MIN_THRUST_TIMER) thrustTimer = MIN_THRUST_TIMER;
         while (thrustTimer <= 0) {
             thrustTimer += THRUST_COOLDOWN;
-            Flame* newFlame = flamePool->FetchUnused();
-            newFlame->transform.SetPosition(transform.GetPosition() + FLAME_OFFSET + RandomValue(-1,1) * FLAME_OFFSET_SPREAD);
-            newFlame->Reset();
+            EmitFlame(*flames, flameRandom, transform.GetPosition() + FLAME_OFFSET + flameRandom.Value(-1,1) * FLAME_OFFSET_SPREAD);
         }
     }
 
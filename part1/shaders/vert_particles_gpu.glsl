@@ -0,0 +1,70 @@
+#version 410 core
+// Draws particle records straight from the transform feedback state buffer.
+// Pairs with frag_unlit_instanced_colored.glsl
+layout(location=0) in vec3 position;
+layout(location=1) in vec2 vertexUv;
+layout(location=2) in vec3 vertexNormals;
+layout(location=3) in vec3 vertexTangent;
+
+layout(location=5) in vec3 particlePosition;
+layout(location=6) in vec3 particleAngles;
+// Scale, remaining life, 1 / max life
+layout(location=7) in vec3 particleLifetime;
+layout(location=8) in vec4 particleStartColor;
+layout(location=9) in vec4 particleEndColor;
+
+// Uniform variables
+uniform mat4 u_ViewProjectionMatrix;
+uniform mat4 u_ViewMatrix;
+uniform mat4 u_ProjectionMatrix;
+uniform float u_Time;
+
+out vec3 v_vertex;
+out vec3 v_vertexNormals;
+out vec3 v_rawNormals;
+out vec2 v_vertexUv;
+out mat4 v_ModelMatrix;
+out mat4 v_ViewMatrix;
+out mat4 v_ViewModelTBNMatrix;
+out float v_Time;
+
+// Pass instance data to the fragment shader
+out vec4 i_color;
+
+void main()
+{
+    // Expired particles shrink to nothing, so their triangles are never rasterized
+    float t = clamp(particleLifetime.y * particleLifetime.z, 0.0, 1.0);
+    float scale = particleLifetime.x * t;
+    vec3 s = sin(particleAngles);
+    vec3 c = cos(particleAngles);
+    // Rotation Z * Y * X, the same as the CPU particle system
+    mat4 modelMatrix = mat4(
+        vec4(c.y * c.z, c.y * s.z, -s.y, 0) * scale,
+        vec4(s.x * s.y * c.z - c.x * s.z, s.x * s.y * s.z + c.x * c.z, s.x * c.y, 0) * scale,
+        vec4(c.x * s.y * c.z + s.x * s.z, c.x * s.y * s.z - s.x * c.z, c.x * c.y, 0) * scale,
+        vec4(particlePosition, 1)
+    );
+
+    v_vertex        = (u_ViewMatrix * modelMatrix * vec4(position, 1.0f)).xyz;
+    v_vertexNormals = (u_ViewMatrix * modelMatrix * vec4(vertexNormals, 0.0f)).xyz;
+    v_rawNormals    = vertexNormals;
+    v_vertexUv      = vertexUv;
+    v_Time          = u_Time;
+
+    i_color = mix(particleEndColor, particleStartColor, t);
+
+    vec3 bitangent = cross(vertexNormals, normalize(vertexTangent));
+    mat4 TBNMatrix = mat4(
+        vec4(normalize(vertexTangent), 0),
+        vec4(bitangent, 0),
+        vec4(vertexNormals, 0),
+        vec4(0,0,0,1)
+    );
+    v_ViewModelTBNMatrix = u_ViewMatrix * modelMatrix * TBNMatrix;
+
+    v_ModelMatrix = modelMatrix;
+    v_ViewMatrix  = u_ViewMatrix;
+
+    gl_Position = u_ViewProjectionMatrix * modelMatrix * vec4(position, 1.0f);
+}
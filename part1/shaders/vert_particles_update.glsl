@@ -0,0 +1,37 @@
+#version 410 core
+// Advances one particle record per vertex. The outputs are captured with transform feedback
+// into the other state buffer, nothing is rasterized.
+layout(location=0) in vec3 position;
+layout(location=1) in vec3 velocity;
+layout(location=2) in vec3 angles;
+layout(location=3) in vec3 angularVelocity;
+// Scale, remaining life, 1 / max life
+layout(location=4) in vec3 lifetime;
+layout(location=5) in vec4 startColor;
+layout(location=6) in vec4 endColor;
+
+uniform float u_DeltaTime;
+// Fraction of its initial speed a particle keeps at the end of its life
+uniform float u_FinalSpeedFactor;
+
+out vec3 o_Position;
+out vec3 o_Velocity;
+out vec3 o_Angles;
+out vec3 o_AngularVelocity;
+out vec3 o_Lifetime;
+out vec4 o_StartColor;
+out vec4 o_EndColor;
+
+void main()
+{
+    float t = max(lifetime.y, 0.0) * lifetime.z;
+    float speedFactor = u_FinalSpeedFactor + (1.0 - u_FinalSpeedFactor) * t;
+
+    o_Position        = position + velocity * speedFactor * u_DeltaTime;
+    o_Velocity        = velocity;
+    o_Angles          = angles + angularVelocity * u_DeltaTime;
+    o_AngularVelocity = angularVelocity;
+    o_Lifetime        = vec3(lifetime.x, lifetime.y - u_DeltaTime, lifetime.z);
+    o_StartColor      = startColor;
+    o_EndColor        = endColor;
+}
@@ -9,10 +9,14 @@
 #include "../../lib/geometry/mesh.hpp"
 #include "../../lib/readers/objReader.hpp"
 #include "../../lib/readers/ppmReader.hpp"
+#include "../../lib/readers/packReader.hpp"
 #include "../../lib/glHelper.hpp"
 #include "../../lib/components/light.hpp"
 #include "../../lib/geometry/bulk.hpp"
 #include "../../lib/pools.hpp"
+#include "../../lib/particles.hpp"
+#include "../../lib/gpuParticles.hpp"
+#include "../../lib/extensions/allocations.hpp"
 
 #include "../include/alien.hpp"
 #include "../include/bullet.hpp"
@@ -20,6 +24,7 @@
 #include "../include/flame.hpp"
 #include "../include/blastParticle.hpp"
 #include "../include/glare.hpp"
+#include "../include/benchmarks.hpp"
 
 using namespace std;
 using namespace glm;
@@ -34,22 +39,21 @@ GameObject* star;
 SpaceShip* ship;
 GameObjectPool<Alien>* alienPool;
 GameObjectPool<Bullet>* bulletPool;
-GameObjectPool<Flame>* flamePool;
-GameObjectPool<BlastParticle>* blastPool;
+GpuParticleSystem* flameParticles;
+GpuParticleSystem* blastParticles;
 GameObjectPool<Glare>* glarePool;
 
 GameObject* g_defeatScreen;
 GameObject* g_victoryScreen;
 
-CollisionLayer g_playerBulletLayer;
-CollisionLayer g_playerLayer;
-CollisionLayer g_alienLayer;
-std::vector<CollisionLayer*> g_collisionLayers;
+// Bullets hit aliens, aliens hit the player
+const CollisionLayerIndex PLAYER_LAYER = 0;
+const CollisionLayerIndex PLAYER_BULLET_LAYER = 1;
+const CollisionLayerIndex ALIEN_LAYER = 2;
+CollisionWorld g_collisionWorld;
 
 InstancedRenderer alienRenderer;
-InstancedRenderer fireRenderer;
 InstancedRenderer bulletRenderer;
-InstancedRenderer blastRenderer;
 
 Shader* colliderShader;
 
@@ -151,12 +155,7 @@ EventHandler<Alien*> OnAlienKilledHandler = EventHandler<Alien*>([](Alien* a){
     Glare* g = glarePool->FetchUnused();
     g->Reset();
     g->transform.SetPosition(position + glm::vec3(0,0,2));
-    for (int i = 0; i < blastParticleCount; i++) {
-        BlastParticle* b = blastPool->FetchUnused();
-        b->Reset();
-        b->transform.SetPosition(position);
-        b->SetColor(alienColor);
-    }
+    EmitBlastBurst(*blastParticles, GlobalFastRandom(), position, alienColor, blastParticleCount);
     if (liveAlienCount <= 0 && victoryTimer <= 0) {
         victoryTimer = 1;
     }
@@ -182,11 +181,10 @@ EventHandler<SpaceShip*> OnShipKilledHandler = EventHandler<SpaceShip*>([](Space
     Glare* g = glarePool->FetchUnused();
     g->Reset();
     g->transform.SetPosition(s->transform.GetPosition() + glm::vec3(0,0,2));
-    for (int i = 0; i < 100; i++) {
-        BlastParticle* b = blastPool->FetchUnused();
-        b->Reset();
-        b->transform.SetPosition(s->transform.GetPosition());
-        b->SetColor(Sample(shipExplosionColors));
+    glm::vec3 position = s->transform.GetPosition();
+    FastRandom& random = GlobalFastRandom();
+    for (int i = 0; i < 100; ++i) {
+        EmitBlast(*blastParticles, random, position, shipExplosionColors[random.Range(0, shipExplosionColors.size())]);
     }
 });
 
@@ -199,8 +197,14 @@ void MainLoop(GLProgram* program) {
     bool drawColliders = false;
     bool aliensMoveRight = true;
     bool descending = false;
+    // Heap allocations per frame, averaged and printed once per second while enabled
+    bool reportAllocations = false;
+    size_t reportedAllocations = 0;
+    int reportedFrames = 0;
+    float reportTimer = 0;
 
     while(program->programState != STATE_QUIT) {
+        size_t frameStartAllocations = AllocationCount();
         // Handle events
         SDL_Event e;
         while (SDL_PollEvent(&e)) {
@@ -222,6 +226,9 @@ void MainLoop(GLProgram* program) {
                     case SDL_SCANCODE_C:
                         drawColliders = !drawColliders;
                         break;
+                    case SDL_SCANCODE_F:
+                        reportAllocations = !reportAllocations;
+                        break;
                     case SDL_SCANCODE_R:
                         ResetGame(program);
                         drawColliders = false;
@@ -257,12 +264,12 @@ void MainLoop(GLProgram* program) {
         for (Alien* a : alienPool->GetObjects()) {
             if (!a->IsEnabled()) continue;
             a->transform.Translate(motion);
-            if (a->transform.position.y < PLAY_AREA.GetMinBound().y) {
+            if (a->transform.GetPosition().y < PLAY_AREA.GetMinBound().y) {
                 StartDefeat();
             }
             if (!descending) {
-                if ((aliensMoveRight && a->transform.position.x > PLAY_AREA.GetMaxBound().x) ||
-                   (!aliensMoveRight && a->transform.position.x < PLAY_AREA.GetMinBound().x)
+                if ((aliensMoveRight && a->transform.GetPosition().x > PLAY_AREA.GetMaxBound().x) ||
+                   (!aliensMoveRight && a->transform.GetPosition().x < PLAY_AREA.GetMinBound().x)
                 ) {
                     descending = true;
                     alienTimer = alienVerticalPeriod;
@@ -271,11 +278,7 @@ void MainLoop(GLProgram* program) {
         }
 
         // Calculate collisions
-        for (CollisionLayer* layer : g_collisionLayers) {
-            layer->CollisionPrep();
-        }
-        g_playerBulletLayer.CheckCollisions();
-        g_alienLayer.CheckCollisions();
+        g_collisionWorld.CheckCollisions(&program->jobs);
 
         // Kick off the automated render pipeline, but don't swap the window buffer yet!
         program->Render(false, true, false);
@@ -283,8 +286,7 @@ void MainLoop(GLProgram* program) {
         // Draw colliders
         if (drawColliders) {
             glm::mat4 vpMatrix = program->camera.GetVPMatrix(program->GetScreenSize());
-            for (GameObject* obj : program->GetGameObjects()) {
-                if (!obj->IsEnabled()) continue;
+            for (GameObject* obj : program->GetActiveObjects()) {
                 for (Collider* col : obj->GetComponents<Collider>()) {
                     col->Render(colliderShader, vpMatrix);
                 }
@@ -305,11 +307,83 @@ void MainLoop(GLProgram* program) {
 
         program->SwapWindow();
         //std::cout << "Render Cycle Completed" << std::endl;
+
+        if (reportAllocations) {
+            reportedAllocations += AllocationCount() - frameStartAllocations;
+            reportedFrames++;
+            reportTimer += program->deltaTime;
+            if (reportTimer >= 1) {
+                std::cout << "Heap allocations per frame: " << (float)reportedAllocations / reportedFrames << std::endl;
+                reportedAllocations = 0;
+                reportedFrames = 0;
+                reportTimer = 0;
+            }
+        }
     }
 }
 
 MeshHandle g_alienMesh; 
 Material* g_alienMat;
+// Collides for the ship, so it has to live as long as the ship does
+MeshBvh g_shipHull;
+
+// Built by the asset packer (see build.py), the game falls back to parsing the loose files if it is missing
+const std::string ASSET_PACK_FILE = "./media/assets.pack";
+AssetPackReader g_assetPack;
+
+// The parts of a model the game uses, whether it was mapped from the asset pack or parsed from its file
+struct LoadedModel {
+    std::string name;
+    MeshHandle mesh;
+    RawMtl materialData;
+};
+
+// Starts parsing a model in the background, unless the asset pack already holds it
+std::shared_future<vector<ObjData>> RequestObj(AssetLoader& loader, const std::string& file) {
+    if (g_assetPack.HasObj(file)) return std::shared_future<vector<ObjData>>();
+    return loader.LoadObj(file);
+}
+std::shared_future<vector<RawMtl>> RequestMtl(AssetLoader& loader, const std::string& file) {
+    if (g_assetPack.HasMtl(file)) return std::shared_future<vector<RawMtl>>();
+    return loader.LoadMtl(file);
+}
+
+// Uploads the first object of a model, waiting for its parse if it was not packed
+LoadedModel LoadModel(GLProgram* program, const std::string& file, const std::shared_future<vector<ObjData>>& parsed) {
+    LoadedModel result;
+    if (!parsed.valid()) {
+        PackedObj obj = g_assetPack.GetObjs(file).at(0);
+        result.name = obj.name;
+        result.mesh = program->LoadMesh(&obj.mesh);
+        result.materialData = obj.materialData;
+        return result;
+    }
+    const ObjData& obj = parsed.get().at(0);
+    result.name = obj.name;
+    result.mesh = program->LoadMesh(obj.mesh.get());
+    result.materialData = obj.materialData;
+    return result;
+}
+RawMtl LoadMtlData(const std::string& file, const std::shared_future<vector<RawMtl>>& parsed) {
+    if (!parsed.valid()) return g_assetPack.GetMtls(file).at(0);
+    return parsed.get().at(0);
+}
+// Collision BVH of the first object of a model. Taken from the asset pack if it was baked there intact, built from the mesh otherwise.
+void LoadMeshBvh(const std::string& file, const std::shared_future<vector<ObjData>>& parsed, MeshBvh& result) {
+    if (g_assetPack.GetMeshBvh(file, result)) return;
+    if (parsed.valid()) {
+        result.Build(*parsed.get().at(0).mesh);
+        return;
+    }
+    // Packed vertices start with their position
+    PackedObj obj = g_assetPack.GetObjs(file).at(0);
+    std::vector<glm::vec3> positions;
+    for (size_t i = 0; i < obj.mesh.vertexCount; ++i) {
+        const GLfloat* vertex = obj.mesh.vertices + i * obj.mesh.floatsPerVertex;
+        positions.push_back(glm::vec3(vertex[0], vertex[1], vertex[2]));
+    }
+    result.Build(positions, std::vector<uint32_t>(obj.mesh.indices, obj.mesh.indices + obj.mesh.indexCount));
+}
 
 /**
 * The entry point into our C++ programs.
@@ -336,6 +410,13 @@ int main( int argc, char* args[] ){
     */
     cout << "Initialized program" << endl;
 
+    if (argc > 2 && std::string(args[1]) == "--benchmark") {
+        // Unknown names and failed checks exit with an error
+        bool passed = RunBenchmark(args[2], program);
+        delete program;
+        return passed ? 0 : 1;
+    }
+
 	// 2. Create our graphics pipeline
 	// 	- At a minimum, this means the vertex and fragment shader
 	Shader* unlitShader = program->BuildPipeline("./shaders/vert_unlit.glsl", "./shaders/frag_unlit.glsl");
@@ -346,14 +427,12 @@ int main( int argc, char* args[] ){
     Shader* bulletShader= program->BuildPipeline("./shaders/vert_unlit_instanced.glsl", "./shaders/frag_unlit_instanced.glsl");
     Shader* uiShader    = program->BuildPipeline("./shaders/vert_ui.glsl", "./shaders/frag_unlit.glsl");
     colliderShader      = program->BuildPipeline("./shaders/vert_collider.glsl", "./shaders/frag_collider.glsl");
+    Shader* particleShader       = program->BuildPipeline("./shaders/vert_particles_gpu.glsl", "./shaders/frag_unlit_instanced_colored.glsl");
+    Shader* particleUpdateShader = program->BuildFeedbackPipeline("./shaders/vert_particles_update.glsl", PARTICLE_FEEDBACK_VARYINGS);
 
     cout << "Built Shader Pipelines" << endl;
 
-    g_playerBulletLayer.CollidesWith(&g_alienLayer);
-    g_alienLayer.CollidesWith(&g_playerLayer);
-    g_collisionLayers.push_back(&g_playerLayer);
-    g_collisionLayers.push_back(&g_playerBulletLayer);
-    g_collisionLayers.push_back(&g_alienLayer);
+    g_collisionWorld.SetLayersCollide(PLAYER_BULLET_LAYER, ALIEN_LAYER)->SetLayersCollide(ALIEN_LAYER, PLAYER_LAYER);
 
     //  - Create images
     Image img = Image::Solid(Pixel(255,255,255));
@@ -361,87 +440,103 @@ int main( int argc, char* args[] ){
     img = Image::Solid(Pixel(128,128,255));
     Texture2D blankNormal = program->LoadTexture(&img);
 
-    ObjData alienObjData = ObjReader::ReadObj("./media/objects/alien.obj").at(0);
-    g_alienMesh = program->LoadMesh(alienObjData.mesh.get());
+    // Map the asset pack if it was built, everything it holds skips parsing altogether
+    if (g_assetPack.Open(ASSET_PACK_FILE)) {
+        program->MountPack(&g_assetPack);
+        if (g_assetPack.HasData(Alien::LAYOUT_FILE)) Alien::layoutData = g_assetPack.GetData(Alien::LAYOUT_FILE);
+        cout << "Mounted asset pack " << ASSET_PACK_FILE << endl;
+    }
+
+    // Parse every unpacked model and UI material in parallel, unpacked textures are streamed in after the first frames
+    AssetLoader& loader = program->GetAssetLoader();
+    program->streamTextures = true;
+    auto alienObjFuture  = RequestObj(loader, "./media/objects/alien.obj");
+    auto shipObjFuture   = RequestObj(loader, "./media/objects/rocket.obj");
+    auto bulletObjFuture = RequestObj(loader, "./media/objects/bullet.obj");
+    auto starObjFuture   = RequestObj(loader, "./media/objects/star.obj");
+    auto fireObjFuture   = RequestObj(loader, "./media/objects/flame.obj");
+    auto blastObjFuture  = RequestObj(loader, "./media/objects/blast.obj");
+    auto bgObjFuture     = RequestObj(loader, "./media/objects/space.obj");
+    auto victoryMtlFuture = RequestMtl(loader, "./media/objects/ui_victory.mtl");
+    auto defeatMtlFuture  = RequestMtl(loader, "./media/objects/ui_defeat.mtl");
+
+    LoadedModel alienObjData = LoadModel(program, "./media/objects/alien.obj", alienObjFuture);
+    g_alienMesh = alienObjData.mesh;
     // IMPORTANT: Change to "alienShader" once instanced rendering is fixed
     g_alienMat = program->LoadRawMtl(alienObjData.materialData, litShader, blank, blankNormal);
 
-    ObjData shipObjData = ObjReader::ReadObj("./media/objects/rocket.obj").at(0);
-    MeshHandle shipMesh = program->LoadMesh(shipObjData.mesh.get());
+    LoadedModel shipObjData = LoadModel(program, "./media/objects/rocket.obj", shipObjFuture);
+    MeshHandle shipMesh = shipObjData.mesh;
     Material* shipMat = program->LoadRawMtl(shipObjData.materialData, litShader, blank, blankNormal);
+    LoadMeshBvh("./media/objects/rocket.obj", shipObjFuture, g_shipHull);
 
-    ObjData bulletObjData = ObjReader::ReadObj("./media/objects/bullet.obj").at(0);
-    MeshHandle bulletMesh = program->LoadMesh(bulletObjData.mesh.get());
+    LoadedModel bulletObjData = LoadModel(program, "./media/objects/bullet.obj", bulletObjFuture);
+    MeshHandle bulletMesh = bulletObjData.mesh;
     // IMPORTANT: Change to "bulletShader" once instanced rendering is fixed
     Material* bulletMat = program->LoadRawMtl(bulletObjData.materialData, unlitShader, blank, blankNormal);
 
-    ObjData starObjData = ObjReader::ReadObj("./media/objects/star.obj").at(0);
-    MeshHandle starMesh = program->LoadMesh(starObjData.mesh.get());
+    LoadedModel starObjData = LoadModel(program, "./media/objects/star.obj", starObjFuture);
+    MeshHandle starMesh = starObjData.mesh;
     Material* starMat = program->LoadRawMtl(starObjData.materialData, unlitShader, blank, blankNormal);
     
-    ObjData fireObjData = ObjReader::ReadObj("./media/objects/flame.obj").at(0);
-    MeshHandle fireMesh = program->LoadMesh(fireObjData.mesh.get());
-    // IMPORTANT: Change to "fireShader" once instanced rendering is fixed
-    Material* fireMat = program->LoadRawMtl(fireObjData.materialData, unlitShader, blank, blankNormal);
-
-    ObjData blastObjData = ObjReader::ReadObj("./media/objects/blast.obj").at(0);
-    MeshHandle blastMesh = program->LoadMesh(blastObjData.mesh.get());
-    // IMPORTANT: Change to "fireShader" once instanced rendering is fixed
+    LoadedModel fireObjData = LoadModel(program, "./media/objects/flame.obj", fireObjFuture);
+    MeshHandle fireMesh = fireObjData.mesh;
+    Material* fireMat = program->LoadRawMtl(fireObjData.materialData, fireShader, blank, blankNormal);
+    Material* fireGpuMat = program->LoadRawMtl(fireObjData.materialData, particleShader, blank, blankNormal);
+
+    LoadedModel blastObjData = LoadModel(program, "./media/objects/blast.obj", blastObjFuture);
+    MeshHandle blastMesh = blastObjData.mesh;
+    // Glares are regular objects, explosion particles use their own instanced material
     Material* blastMat = program->LoadRawMtl(blastObjData.materialData, unlitShader, blank, blankNormal);
+    Material* blastParticleMat = program->LoadRawMtl(blastObjData.materialData, fireShader, blank, blankNormal);
+    Material* blastGpuMat = program->LoadRawMtl(blastObjData.materialData, particleShader, blank, blankNormal);
 
-    ObjData bgObjData = ObjReader::ReadObj("./media/objects/space.obj").at(0);
-    MeshHandle bgMesh = program->LoadMesh(bgObjData.mesh.get());
+    LoadedModel bgObjData = LoadModel(program, "./media/objects/space.obj", bgObjFuture);
+    MeshHandle bgMesh = bgObjData.mesh;
     Material* bgMat = program->LoadRawMtl(bgObjData.materialData, bgShader, blank, blankNormal);
 
-    RawMtl victoryRawMat = MtlReader::ReadMtl("./media/objects/ui_victory.mtl").at(0);
+    RawMtl victoryRawMat = LoadMtlData("./media/objects/ui_victory.mtl", victoryMtlFuture);
     Material* victoryMat = program->LoadRawMtl(victoryRawMat, uiShader, blank, blankNormal);
-    RawMtl defeatRawMat = MtlReader::ReadMtl("./media/objects/ui_defeat.mtl").at(0);
+    RawMtl defeatRawMat = LoadMtlData("./media/objects/ui_defeat.mtl", defeatMtlFuture);
     Material* defeatMat  = program->LoadRawMtl(defeatRawMat, uiShader, blank, blankNormal);
 
     std::cout << "Loaded Objects and Materials" << std::endl;
+    program->GetTextureCache().PrintStats();
     
     alienRenderer = InstancedRenderer::WithNewBuffer(&g_alienMesh, g_alienMat, 1);
-    fireRenderer  = InstancedRenderer::WithNewBuffer(&fireMesh, fireMat, 1);
     bulletRenderer = InstancedRenderer::WithNewBuffer(&bulletMesh, bulletMat);
-    blastRenderer = InstancedRenderer::WithNewBuffer(&blastMesh, blastMat, 1);
     program->Instantiate(&alienRenderer);
-    program->Instantiate(&fireRenderer);
     program->Instantiate(&bulletRenderer);
-    program->Instantiate(&blastRenderer);
+
+
+    // Simulated on the GPU when transform feedback is available, otherwise on the CPU where particles beyond the capacity are dropped
+    flameParticles = new GpuParticleSystem(1024, &fireMesh, fireMat, fireGpuMat, particleUpdateShader);
+    blastParticles = new GpuParticleSystem(8192, &blastMesh, blastParticleMat, blastGpuMat, particleUpdateShader);
+    std::cout << "Particles simulated on the " << (flameParticles->IsGpu() ? "GPU" : "CPU") << std::endl;
+    program->Instantiate(flameParticles);
+    program->Instantiate(blastParticles);
 
     std::cout << "Built Bulk Renderers" << std::endl;
 
     alienPool = new GameObjectPool<Alien>("Alien", &g_alienMesh, g_alienMat, [](std::string name, int id, MeshHandle* mesh, Material* mat) {
-        Alien* a = new Alien("Alien", Transform({0,0,0}, {0,0,-1}, {0,1,0}, ALIEN_SCALE), g_alienMesh, g_alienMat, &g_alienLayer);
+        Alien* a = new Alien("Alien", Transform({0,0,0}, {0,0,-1}, {0,1,0}, ALIEN_SCALE), g_alienMesh, g_alienMat, &g_collisionWorld, ALIEN_LAYER);
         a->OnKilled.AddListener(&OnAlienKilledHandler);
         alienRenderer.AddInstance(a->instance);
         return a;
     }, program);
     bulletPool = new GameObjectPool<Bullet>("Bullet", &bulletMesh, bulletMat, [](std::string name, int id, MeshHandle* mesh, Material* mat) {
-        Bullet* b = new Bullet(name, Transform({0,0,0}, {0,0,1}, {0,1,0}, {0.1,0.1,0.1}), *mesh, mat, &g_playerBulletLayer);
+        Bullet* b = new Bullet(name, Transform({0,0,0}, {0,0,1}, {0,1,0}, {0.1,0.1,0.1}), *mesh, mat, &g_collisionWorld, PLAYER_BULLET_LAYER);
         bulletRenderer.AddInstance(b->instance);
         b->Start(GLProgram::Instance);
         return b;
     }, program);
-    flamePool  = new GameObjectPool<Flame>("Flame", &fireMesh, fireMat, [](std::string name, int id, MeshHandle* mesh, Material* mat) {
-        Flame* f = new Flame(name, Transform({0,0,0}, {0,0,1}, {0,1,0}, {0.4,0.4,0.4}), *mesh, mat);
-        fireRenderer.AddInstance(f->instance);
-        f->Start(GLProgram::Instance);
-        return f;
-    }, program);
-    blastPool  = new GameObjectPool<BlastParticle>("Blast", &blastMesh, blastMat, [](std::string name, int id, MeshHandle* mesh, Material* mat) {
-        BlastParticle* b = new BlastParticle(name, Transform({0,0,0}, {0,0,1}, {0,1,0}, {0.4,0.4,0.4}), *mesh, mat);
-        blastRenderer.AddInstance(b->instance);
-        b->Start(GLProgram::Instance);
-        return b;
-    }, program);
     glarePool = new GameObjectPool<Glare>("Glare", &blastMesh, blastMat, [](std::string name, int id, MeshHandle* mesh, Material* mat) {
         Glare* g = new Glare(name, Transform({0,0,0}, {0,0,1}, {0,1,0}, {0,0,0}), *mesh, mat);
         g->Start(GLProgram::Instance);
         return g;
     }, program);
 
-    ship = new SpaceShip(shipObjData.name, Transform({0,0,0}, {0,0,1}, {0,1,0}, {0.25, 0.25, 0.25}), shipMesh, shipMat, bulletPool, flamePool, &g_playerLayer);
+    ship = new SpaceShip(shipObjData.name, Transform({0,0,0}, {0,0,1}, {0,1,0}, {0.25, 0.25, 0.25}), shipMesh, shipMat, &g_shipHull, bulletPool, flameParticles, &g_collisionWorld, PLAYER_LAYER);
     program->Instantiate(ship);
     ship->OnKilled.AddListener(&OnShipKilledHandler);
     
@@ -475,12 +570,22 @@ int main( int argc, char* args[] ){
 
     // 4. Call the main application loop
     program->Start();
+
+    // Create pooled objects up front, so the first shots and explosions do not allocate mid-frame.
+    bulletPool->Prewarm(16);
+    glarePool->Prewarm(8);
+
 	MainLoop(program);
 
+    PrintPoolStats(alienPool);
+    PrintPoolStats(bulletPool);
+    PrintPoolStats(glarePool);
+
 	// 5. Call the cleanup function when our program terminates
 	delete alienPool;
     delete bulletPool;
-    delete flamePool;
+    delete flameParticles;
+    delete blastParticles;
     delete program;
     // WAS UNABLE TO GET THE LIBRARY TO LINK PROPERLY
     //Mix_FreeChunk(g_laserSfx);
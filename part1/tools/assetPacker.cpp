@@ -0,0 +1,60 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../../lib/readers/packWriter.hpp"
+
+using namespace std;
+
+// Everything the game loads at startup, relative to the part1 directory
+const vector<string> DEFAULT_ASSETS = {
+    "./media/objects/alien.obj",
+    "./media/objects/rocket.obj",
+    "./media/objects/bullet.obj",
+    "./media/objects/star.obj",
+    "./media/objects/flame.obj",
+    "./media/objects/blast.obj",
+    "./media/objects/space.obj",
+    "./media/objects/ui_victory.mtl",
+    "./media/objects/ui_defeat.mtl",
+    "./media/data/alien_layouts.txt"
+};
+// Meshes the game collides against, which get their BVH baked along with them
+const vector<string> COLLISION_MESHES = {
+    "./media/objects/rocket.obj"
+};
+
+/**
+* Bakes game assets into a single pack that the game maps at startup.
+* Run from the part1 directory so the packed paths match the ones the game asks for.
+*
+* Usage: ./packer [output.pack] [files...]
+*/
+int main(int argc, char* args[]) {
+    string output = argc > 1 ? args[1] : "./media/assets.pack";
+    vector<string> files;
+    for (int i = 2; i < argc; ++i) {
+        files.push_back(args[i]);
+    }
+    bool defaults = files.empty();
+    if (defaults) files = DEFAULT_ASSETS;
+
+    AssetPackWriter writer;
+    for (const string& file : files) {
+        if (!writer.Add(file)) {
+            cerr << "Skipped " << file << endl;
+            continue;
+        }
+        cout << "Packed " << file << endl;
+    }
+    for (const string& file : defaults ? COLLISION_MESHES : vector<string>()) {
+        if (writer.AddMeshBvh(file) == 0) {
+            cerr << "Skipped the collision BVH of " << file << endl;
+            continue;
+        }
+        cout << "Packed the collision BVH of " << file << endl;
+    }
+    if (!writer.Write(output)) return 1;
+    cout << "Wrote " << writer.EntryCount() << " entries to " << output << endl;
+    return 0;
+}